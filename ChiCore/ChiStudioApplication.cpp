@@ -18,8 +18,8 @@
 
 namespace CHISTUDIO {
 
-ChiStudioApplication::ChiStudioApplication(const std::string& InAppName, glm::ivec2 InWindowSize)
-	: Application(InAppName, InWindowSize)
+ChiStudioApplication::ChiStudioApplication(const std::string& InAppName, glm::ivec2 InWindowSize, bool InIsHeadless)
+	: Application(InAppName, InWindowSize, InIsHeadless)
 {
 	HierarchyWidget = make_unique<WHierarchy>();	
 	ObjectPropertiesWidget = make_unique<WObjectProperties>();
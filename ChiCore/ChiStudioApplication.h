@@ -13,7 +13,7 @@ namespace CHISTUDIO {
 class ChiStudioApplication : public Application
 {
 public:
-	ChiStudioApplication(const std::string& InAppName, glm::ivec2 InWindowSize);
+	ChiStudioApplication(const std::string& InAppName, glm::ivec2 InWindowSize, bool InIsHeadless = false);
 	void SetupScene(bool InIncludeDefaults) override;
 	void DrawGUI(float InDeltaTime) override;
 
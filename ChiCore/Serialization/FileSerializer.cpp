@@ -506,20 +506,20 @@ void FileSerializer::DeserializeNode(YAML::Node& InData, SceneNode* InParentNode
 	}
 }
 
-void FileSerializer::Deserialize(const std::string& InFilepath)
+bool FileSerializer::Deserialize(const std::string& InFilepath)
 {
 	YAML::Node dataIn;
 	try
 	{
 		dataIn = YAML::LoadFile(InFilepath);
 	}
-	catch (YAML::ParserException e)
+	catch (const YAML::Exception&)
 	{
-		return;
+		return false;
 	}
 
 	if (!dataIn["Scene"])
-		return;
+		return false;
 
 	// Load material library
 	auto materialInfo = dataIn["MaterialInfo"];
@@ -562,6 +562,8 @@ void FileSerializer::Deserialize(const std::string& InFilepath)
 			DeserializeNode(child, root);
 		}
 	}
+
+	return true;
 }
 
 }
\ No newline at end of file
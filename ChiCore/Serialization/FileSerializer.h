@@ -13,8 +13,8 @@ public:
 	// Save the scene to the file at filepath
 	void Serialize(const std::string& InFilepath);
 
-	// Load the scene from the given filepath
-	void Deserialize(const std::string& InFilepath);
+	// Load the scene from the given filepath. Returns false if the file could not be parsed as a scene.
+	bool Deserialize(const std::string& InFilepath);
 
 private:
 	void DeserializeNode(YAML::Node& InData, class SceneNode* InParentNode);
@@ -15,7 +15,18 @@ WRendering::WRendering()
     RenderWidth = 300;
     RenderHeight = 300;
     SamplesPerPixel = 1;
+    bUseAdaptiveSampling = false;
+    MinSamplesPerPixel = 16;
+    AdaptiveNoiseThreshold = 0.01f;
+    TimeBudgetSeconds = 0.0f;
+    SamplerType = ESamplerType::Sobol;
+    bUseFixedSeed = false;
+    Seed = 0;
     MaxBounces = 1;
+    RussianRouletteStartBounce = 3;
+    LightSamplesPerHit = 1;
+    FireflyClamp = 0.0f;
+    TextureCacheMegabytes = 1024;
     FileName = "Output";
     bUseHDRI = false;
     HDRIStrength = 1.0f;
@@ -24,6 +35,41 @@ WRendering::WRendering()
     AnimationStartFrame = 0;
     AnimationEndFrame = 20;
     bUseCompositingNodes = true;
+    bSaveEXR = false;
+    NumRenderThreads = 0;
+    TileSize = 32;
+    GeometryCache = std::make_shared<FMeshGeometryCache>();
+    TextureCache = std::make_shared<FTextureCache>((size_t)TextureCacheMegabytes * 1024 * 1024);
+}
+
+FRayTraceSettings WRendering::GetRayTraceSettings() const
+{
+    FRayTraceSettings settings;
+    settings.BackgroundColor = BackgroundColor;
+    settings.bShadowsEnabled = false;
+    settings.ImageSize = glm::ivec2(RenderWidth, RenderHeight);
+    settings.MaxBounces = MaxBounces;
+    settings.RussianRouletteStartBounce = RussianRouletteStartBounce;
+    settings.LightSamplesPerHit = LightSamplesPerHit;
+    settings.FireflyClamp = FireflyClamp;
+    settings.TextureCacheMegabytes = TextureCacheMegabytes;
+    settings.SamplesPerPixel = SamplesPerPixel;
+    settings.bUseAdaptiveSampling = bUseAdaptiveSampling;
+    settings.MinSamplesPerPixel = MinSamplesPerPixel;
+    settings.AdaptiveNoiseThreshold = AdaptiveNoiseThreshold;
+    settings.TimeBudgetSeconds = TimeBudgetSeconds;
+    settings.SamplerType = SamplerType;
+    settings.bUseFixedSeed = bUseFixedSeed;
+    settings.Seed = Seed;
+    settings.HDRI = HDRI.get();
+    settings.UseHDRI = bUseHDRI;
+    settings.HDRIStrength = HDRIStrength;
+    settings.UseCompositingNodes = bUseCompositingNodes;
+    settings.UseIntelDenoise = bUseIntelDenoise;
+    settings.bSaveEXR = bSaveEXR;
+    settings.NumThreads = NumRenderThreads;
+    settings.TileSize = TileSize;
+    return settings;
 }
 
 void WRendering::Render(Application& InApplication, float InDeltaTime)
@@ -53,7 +99,7 @@ void WRendering::Render(Application& InApplication, float InDeltaTime)
             FileName = filename;
         }
     }
-    ImGui::PushMultiItemsWidths(8, 1200);
+    ImGui::PushMultiItemsWidths(22, 1200);
 
     char buffer[256];
     memset(buffer, 0, sizeof(buffer));
@@ -70,13 +116,60 @@ void WRendering::Render(Application& InApplication, float InDeltaTime)
     ImGui::PopItemWidth();
     ImGui::SliderInt("Max Bounces", &MaxBounces, 0, 10);
     ImGui::PopItemWidth();
+    ImGui::SliderInt("Roulette Start Bounce", &RussianRouletteStartBounce, 1, 10);
+    ImGui::PopItemWidth();
+    ImGui::SliderInt("Light Samples Per Hit", &LightSamplesPerHit, 1, 16);
+    ImGui::PopItemWidth();
+    ImGui::SliderFloat("Firefly Clamp", &FireflyClamp, 0.0f, 100.0f, FireflyClamp == 0.0f ? "Off" : "%.1f");
+    ImGui::PopItemWidth();
+    ImGui::SliderInt("Texture Cache (MB)", &TextureCacheMegabytes, 64, 8192);
+    ImGui::PopItemWidth();
     ImGui::SliderInt("Samples Per Pixel", &SamplesPerPixel, 1, 1000);
     ImGui::PopItemWidth();
+    ImGui::Checkbox("Adaptive Sampling", &bUseAdaptiveSampling);
+    ImGui::PopItemWidth();
+    ImGui::SliderInt("Min Samples Per Pixel", &MinSamplesPerPixel, 2, 256);
+    ImGui::PopItemWidth();
+    ImGui::SliderFloat("Noise Threshold", &AdaptiveNoiseThreshold, 0.001f, 0.1f, "%.4f");
+    ImGui::PopItemWidth();
+    ImGui::SliderFloat("Time Budget (s)", &TimeBudgetSeconds, 0.0f, 600.0f, TimeBudgetSeconds == 0.0f ? "None" : "%.1f");
+    ImGui::PopItemWidth();
+
+    const char* samplerTypeStrings[] = { "Independent", "Sobol", "Blue Noise" };
+    const char* currentSamplerTypeString = samplerTypeStrings[(int)SamplerType];
+    if (ImGui::BeginCombo("Sampler", currentSamplerTypeString))
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            bool isSelected = currentSamplerTypeString == samplerTypeStrings[i];
+            if (ImGui::Selectable(samplerTypeStrings[i], isSelected))
+            {
+                currentSamplerTypeString = samplerTypeStrings[i];
+                SamplerType = (ESamplerType)i;
+            }
+
+            if (isSelected)
+                ImGui::SetItemDefaultFocus();
+        }
+
+        ImGui::EndCombo();
+    }
+    ImGui::PopItemWidth();
+    ImGui::Checkbox("Fixed Seed", &bUseFixedSeed);
+    ImGui::PopItemWidth();
+    ImGui::InputInt("Seed", &Seed);
+    ImGui::PopItemWidth();
     ImGui::DragIntRange2("Animation Range", &AnimationStartFrame, &AnimationEndFrame, 1, 0, 2000, "Start: %d", "End: %d");
     ImGui::PopItemWidth();
     ImGui::Checkbox("Use Compositing Nodes", &bUseCompositingNodes);
     ImGui::PopItemWidth();
     ImGui::Checkbox("Use Intel Denoise", &bUseIntelDenoise);
+    ImGui::PopItemWidth();
+    ImGui::Checkbox("Save EXR", &bSaveEXR);
+    ImGui::PopItemWidth();
+    ImGui::SliderInt("Render Threads", &NumRenderThreads, 0, 256, NumRenderThreads == 0 ? "Auto" : "%d");
+    ImGui::PopItemWidth();
+    ImGui::SliderInt("Tile Size", &TileSize, 8, 128);
     ImGui::EndChild();
 
     ImGui::SameLine();
@@ -136,37 +229,18 @@ void WRendering::Render(Application& InApplication, float InDeltaTime)
 
     if (ImGui::Button("Render Image", ImVec2{ 190, 0 }))
     {
-        FRayTraceSettings settings;
-        settings.BackgroundColor = BackgroundColor;
-        settings.bShadowsEnabled = false;
-        settings.ImageSize = glm::ivec2(RenderWidth, RenderHeight);
-        settings.MaxBounces = MaxBounces;
-        settings.SamplesPerPixel = SamplesPerPixel;
-        settings.HDRI = HDRI.get();
-        settings.UseHDRI = bUseHDRI;
-        settings.HDRIStrength = HDRIStrength;
-        settings.UseCompositingNodes = bUseCompositingNodes;
-        settings.UseIntelDenoise = bUseIntelDenoise;
-        FRayTracer rayTracer(settings);
+        FRayTracer rayTracer(GetRayTraceSettings(), GeometryCache, TextureCache);
 
         DisplayTexture = rayTracer.Render(scene, FileName);
     }
     ImGui::SameLine();
     if (ImGui::Button("Render Animation", ImVec2{ 190,0 }))
     {
-        FRayTraceSettings settings;
-        settings.BackgroundColor = BackgroundColor;
-        //settings.BackgroundColor = glm::vec3(0.0f);
-        settings.bShadowsEnabled = false;
-        settings.ImageSize = glm::ivec2(RenderWidth, RenderHeight);
-        settings.MaxBounces = MaxBounces;
-        settings.SamplesPerPixel = SamplesPerPixel;
-        settings.HDRI = HDRI.get();
-        settings.UseHDRI = bUseHDRI;
-        settings.HDRIStrength = HDRIStrength;
-        settings.UseCompositingNodes = bUseCompositingNodes;
-        settings.UseIntelDenoise = bUseIntelDenoise;
-        FRayTracer rayTracer(settings);
+        // The ray tracer, and with it the render threads, is reused for every frame. Each frame is denoised, composited
+        // and saved in the background while the next one traces.
+        FRayTraceSettings settings = GetRayTraceSettings();
+        settings.MaxQueuedOutputs = 2;
+        FRayTracer rayTracer(settings, GeometryCache, TextureCache);
 
         int numFrames = AnimationEndFrame - AnimationStartFrame + 1;
         for (int i = 0; i < numFrames; i++)
@@ -176,6 +250,7 @@ void WRendering::Render(Application& InApplication, float InDeltaTime)
             DisplayTexture = rayTracer.Render(scene, fmt::format("{}_{}.png", FileName, frameNumber));
             std::cout << fmt::format("Frame {} of {} finished.", i+1, numFrames) << std::endl;
         }
+        rayTracer.WaitForOutputs();
     }
     ImGui::SameLine();
 
@@ -2,6 +2,7 @@
 
 #include "IWidget.h"
 #include "ChiGraphics/External.h"
+#include "ChiGraphics/RayTracing/Sampler.h"
 #include <vector>
 #include <memory>
 #include <string>
@@ -18,14 +19,34 @@ public:
 
 	glm::ivec2 GetImageSize() const { return glm::ivec2(RenderWidth, RenderHeight); }
 private:
+	// Gather the current widget values into settings for the ray tracer
+	struct FRayTraceSettings GetRayTraceSettings() const;
+
 	std::unique_ptr<class FTexture> DisplayTexture;
 	std::unique_ptr<class FTexture> HDRITexture;
 
+	// Mesh geometry built by earlier renders, reused while meshes are unchanged
+	std::shared_ptr<class FMeshGeometryCache> GeometryCache;
+
+	// Textures tiled by earlier renders, reused while their images are unchanged
+	std::shared_ptr<class FTextureCache> TextureCache;
+
 	std::string FileName;
 	int RenderWidth;
 	int RenderHeight;
 	int MaxBounces;
-	int SamplesPerPixel; // Corresponds to super sampling anti aliasing
+	int RussianRouletteStartBounce;
+	int LightSamplesPerHit; // Lights picked from the light tree at every shading point
+	float FireflyClamp; // 0 disables the clamp
+	int TextureCacheMegabytes;
+	int SamplesPerPixel; // Corresponds to super sampling anti aliasing. The maximum when adaptive sampling is on.
+	bool bUseAdaptiveSampling;
+	int MinSamplesPerPixel;
+	float AdaptiveNoiseThreshold;
+	float TimeBudgetSeconds; // 0 disables the budget
+	ESamplerType SamplerType;
+	bool bUseFixedSeed;
+	int Seed;
 	std::shared_ptr<class FImage> HDRI;
 	bool bUseHDRI;
 	float HDRIStrength;
@@ -35,6 +56,9 @@ private:
 	int AnimationEndFrame;
 	bool bUseCompositingNodes;
 	bool bUseIntelDenoise;
+	bool bSaveEXR;
+	int NumRenderThreads; // 0 uses one thread per hardware thread
+	int TileSize;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "AliasTable.h"
+#include <glm/glm.hpp>
+
+namespace CHISTUDIO {
+
+FAliasTable::FAliasTable(const std::vector<float>& InWeights)
+{
+    double totalWeight = 0.0;
+    for (float weight : InWeights)
+    {
+        totalWeight += glm::max(weight, 0.0f);
+    }
+    if (totalWeight <= 0.0)
+    {
+        return;
+    }
+
+    size_t count = InWeights.size();
+    Bins.resize(count);
+
+    // Scale weights so the average is one, then pair each under-full bin with an over-full one that tops it up
+    std::vector<double> scaledWeights(count);
+    std::vector<uint32_t> under;
+    std::vector<uint32_t> over;
+    for (size_t i = 0; i < count; i++)
+    {
+        double pmf = glm::max(InWeights[i], 0.0f) / totalWeight;
+        Bins[i].PMF = (float)pmf;
+        scaledWeights[i] = pmf * count;
+        (scaledWeights[i] < 1.0 ? under : over).push_back((uint32_t)i);
+    }
+
+    while (!under.empty() && !over.empty())
+    {
+        uint32_t small = under.back();
+        under.pop_back();
+        uint32_t large = over.back();
+        over.pop_back();
+
+        Bins[small].KeepProbability = (float)scaledWeights[small];
+        Bins[small].Alias = large;
+
+        scaledWeights[large] -= 1.0 - scaledWeights[small];
+        (scaledWeights[large] < 1.0 ? under : over).push_back(large);
+    }
+
+    // Whatever remains is full up to rounding error
+    for (uint32_t i : under)
+    {
+        Bins[i].KeepProbability = 1.0f;
+        Bins[i].Alias = i;
+    }
+    for (uint32_t i : over)
+    {
+        Bins[i].KeepProbability = 1.0f;
+        Bins[i].Alias = i;
+    }
+}
+
+uint32_t FAliasTable::Sample(float InU, float& OutPMF) const
+{
+    // The integer part of InU * N picks the bin, the fraction decides between its index and its alias
+    float scaled = InU * Bins.size();
+    uint32_t bin = glm::min((uint32_t)scaled, (uint32_t)Bins.size() - 1);
+    float fraction = scaled - bin;
+
+    uint32_t index = fraction < Bins[bin].KeepProbability ? bin : Bins[bin].Alias;
+    OutPMF = Bins[index].PMF;
+    return index;
+}
+
+}
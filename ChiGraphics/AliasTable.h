@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace CHISTUDIO {
+
+/** Discrete distribution over the indices of a list of non-negative weights, sampled in constant time with Walker's
+ *  alias method (built with Vose's algorithm). Each of the N bins keeps one index with some probability and otherwise
+ *  redirects to its alias.
+ */
+class FAliasTable
+{
+public:
+    FAliasTable() {}
+
+    // An empty table if every weight is zero
+    explicit FAliasTable(const std::vector<float>& InWeights);
+
+    // Pick an index from a uniform value in [0, 1), writing the probability of picking it to OutPMF
+    uint32_t Sample(float InU, float& OutPMF) const;
+
+    float GetPMF(uint32_t InIndex) const {
+        return Bins[InIndex].PMF;
+    }
+
+    size_t GetSize() const {
+        return Bins.size();
+    }
+
+    bool IsEmpty() const {
+        return Bins.empty();
+    }
+
+private:
+    struct FBin
+    {
+        // Chance of keeping this bin's own index rather than its alias
+        float KeepProbability;
+        uint32_t Alias;
+        // Normalized weight of this bin's own index
+        float PMF;
+    };
+
+    std::vector<FBin> Bins;
+};
+
+}
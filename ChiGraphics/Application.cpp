@@ -28,19 +28,26 @@
 
 namespace CHISTUDIO {
 
-	Application::Application(std::string InAppName, glm::ivec2 InWindowSize)
-		: AppName(InAppName), WindowSize(InWindowSize), bIsPreviewingRenderCamera(false)
+	Application::Application(std::string InAppName, glm::ivec2 InWindowSize, bool InIsHeadless)
+		: bIsPreviewingRenderCamera(false), WindowHandle(nullptr), AppName(InAppName), WindowSize(InWindowSize)
 	{
 		CurrentFilename = "";
 
-		InitializeGLFW();
-		InitializeGUI();
+		SetHeadless(InIsHeadless);
+		if (!InIsHeadless)
+		{
+			InitializeGLFW();
+			InitializeGUI();
+		}
 
 		CurrentSceneMode = ESceneMode::Object;
 		EditModeSelectionType = EEditModeSelectionType::Vertex;
 		Scene_ = make_unique<Scene>(make_unique<SceneNode>("Root"));
 		Scene_->SetAppRef(this);
-		Renderer_ = make_unique<Renderer>(*this);
+		if (!InIsHeadless)
+		{
+			Renderer_ = make_unique<Renderer>(*this);
+		}
 
 		KeyframeManager::GetInstance().SetAppRef(this);
 	}
@@ -49,9 +56,12 @@ namespace CHISTUDIO {
 	{
 		Scene_.release();
 		Renderer_.release();
-		DestroyGUI();
-		glfwDestroyWindow(WindowHandle);
-		glfwTerminate();
+		if (!IsHeadless())
+		{
+			DestroyGUI();
+			glfwDestroyWindow(WindowHandle);
+			glfwTerminate();
+		}
 	}
 
 	bool Application::IsFinished()
@@ -259,8 +269,7 @@ namespace CHISTUDIO {
 					// Cast a ray in object space for this hittable
 					FRay objectSpaceRay = FRay(mouseRay.GetOrigin(), mouseRay.GetDirection());
 					objectSpaceRay.ApplyTransform(hittable->InverseModelMatrix);
-					Material defaultMat;
-					bool bWasHitRecorded = hittable->Intersect(objectSpaceRay, .00001f, record, defaultMat);
+					bool bWasHitRecorded = hittable->Intersect(objectSpaceRay, .00001f, record, nullptr);
 
 					if (bWasHitRecorded)
 					{
@@ -539,7 +548,10 @@ namespace CHISTUDIO {
 	{
 		CurrentFilename = InFilename;
 		std::string fileDisplay = CurrentFilename.empty() ? "Untitled" : CurrentFilename;
-		glfwSetWindowTitle(WindowHandle, fmt::format("{} - {}", AppName, fileDisplay).c_str());
+		if (WindowHandle)
+		{
+			glfwSetWindowTitle(WindowHandle, fmt::format("{} - {}", AppName, fileDisplay).c_str());
+		}
 	}
 
 	void Application::RecursiveUpdateToTimelineFrame(int InFrame, SceneNode* InSceneNode)
@@ -15,7 +15,8 @@ namespace CHISTUDIO {
 	class Application
 	{
 	public:
-		Application(std::string InAppName, glm::ivec2 InWindowSize);
+		// A headless application creates no window, GL context or GUI. Scenes can still be built and ray traced.
+		Application(std::string InAppName, glm::ivec2 InWindowSize, bool InIsHeadless = false);
 		virtual ~Application();
 
 		bool IsFinished();
@@ -1,17 +1,17 @@
 #pragma once
 
+#include <cstdint>
 #include <limits>
 #include <ostream>
 
 #include <glm/gtx/string_cast.hpp>
-#include "ChiGraphics/Materials/Material.h"
 
 namespace CHISTUDIO {
 
 /** Used to record info from collision checks. */
 struct FHitRecord 
 {
-    FHitRecord() : Position(glm::vec3(0.0f)), Normal(glm::vec3(1.0f, 0.0, 0.0f)), UV(glm::vec2(0.0f))
+    FHitRecord() : Position(glm::vec3(0.0f)), Normal(glm::vec3(1.0f, 0.0, 0.0f)), UV(glm::vec2(0.0f)), UVScale(0.0f), MaterialIndex(0), LightIndex(-1)
     {
         Time = std::numeric_limits<float>::max(); 
     }
@@ -20,7 +20,9 @@ struct FHitRecord
     glm::vec3 Position;
     glm::vec3 Normal;
     glm::vec2 UV;
-    Material Material_;
+    float UVScale; // Distance in UV space per unit of world distance across the hit surface, 0 if unknown
+    uint32_t MaterialIndex; // Index into the ray tracer's material table
+    int32_t LightIndex; // Index into the ray tracer's render lights if the hit hittable is sampled as a light, otherwise -1
 };
 
 inline std::ostream& operator<<(std::ostream& os, const FHitRecord& InRecord)
@@ -0,0 +1,111 @@
+#include "AABB.h"
+#include "TriangleHittable.h"
+#include "MeshHittable.h"
+#include <algorithm>
+
+namespace CHISTUDIO {
+
+static bool IntervalIntersect(float* a, float* b)
+{
+    if (a[0] > b[1]) {
+        return a[0] <= b[1];
+    }
+    else {
+        return b[0] <= a[1];
+    }
+}
+
+AABB AABB::FromTriangle(const TriangleHittable& InTriangle)
+{
+    AABB bbox;
+    bbox.Minimum = bbox.Maximum = InTriangle.GetPosition(0);
+    for (int i = 1; i < 3; i++) {
+        for (int dim = 0; dim < 3; dim++) {
+            bbox.Minimum[dim] = std::min(bbox.Minimum[dim], InTriangle.GetPosition(i)[dim]);
+            bbox.Maximum[dim] = std::max(bbox.Maximum[dim], InTriangle.GetPosition(i)[dim]);
+        }
+    }
+    return bbox;
+}
+
+AABB AABB::FromMesh(const MeshHittable& InMesh)
+{
+    AABB bbox;
+    for (const FTrianglePrimitive& triangle : InMesh.GetTriangles()) {
+        bbox.UnionWith(triangle.GetBoundingBox());
+    }
+    return bbox;
+}
+
+void AABB::UnionWith(const AABB& InOther)
+{
+    for (int dim = 0; dim < 3; dim++) {
+        Minimum[dim] = std::min(Minimum[dim], InOther.Minimum[dim]);
+        Maximum[dim] = std::max(Maximum[dim], InOther.Maximum[dim]);
+    }
+}
+
+void AABB::UnionWith(const glm::vec3& InPoint)
+{
+    Minimum = glm::min(Minimum, InPoint);
+    Maximum = glm::max(Maximum, InPoint);
+}
+
+bool AABB::Overlap(const AABB& InOther) const
+{
+    for (int dim = 0; dim < 3; dim++) {
+        float ia[2] = { Minimum[dim], Maximum[dim] };
+        float ib[2] = { InOther.Minimum[dim], InOther.Maximum[dim] };
+        bool intersect = IntervalIntersect(ia, ib);
+        if (!intersect) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AABB::Contain(const AABB& InOther) const
+{
+    for (int dim = 0; dim < 3; dim++) {
+        if (Minimum[dim] > InOther.Minimum[dim] || Maximum[dim] < InOther.Maximum[dim]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+float AABB::GetSurfaceArea() const
+{
+    if (!IsValid()) {
+        return 0.0f;
+    }
+    glm::vec3 extent = GetExtent();
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+int AABB::GetLongestAxis() const
+{
+    glm::vec3 extent = GetExtent();
+    if (extent.x > extent.y && extent.x > extent.z) {
+        return 0;
+    }
+    return extent.y > extent.z ? 1 : 2;
+}
+
+AABB AABB::Transformed(const glm::mat4& InMatrix) const
+{
+    AABB result;
+    if (!IsValid()) {
+        return result;
+    }
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 point((corner & 1) ? Maximum.x : Minimum.x,
+                        (corner & 2) ? Maximum.y : Minimum.y,
+                        (corner & 4) ? Maximum.z : Minimum.z);
+        glm::vec4 transformedPoint = InMatrix * glm::vec4(point, 1.0f);
+        result.UnionWith(glm::vec3(transformedPoint) / transformedPoint.w);
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <limits>
+
+namespace CHISTUDIO {
+
+class MeshHittable;
+class TriangleHittable;
+
+/** Axis-aligned bounding box. Default constructed boxes are empty (inverted), so they can be grown with UnionWith. */
+struct AABB {
+	AABB()
+		: Minimum(glm::vec3(std::numeric_limits<float>::max())), Maximum(glm::vec3(-std::numeric_limits<float>::max())) {
+	}
+	AABB(const glm::vec3& _mn, const glm::vec3& _mx) : Minimum(_mn), Maximum(_mx) {
+	}
+	AABB(float mnx, float mny, float mnz, float mxx, float mxy, float mxz)
+		: Minimum(glm::vec3(mnx, mny, mnz)), Maximum(glm::vec3(mxx, mxy, mxz)) {
+	}
+	static AABB FromTriangle(const TriangleHittable& InTriangle);
+	static AABB FromMesh(const MeshHittable& InMesh);
+
+	void UnionWith(const AABB& InOther);
+	void UnionWith(const glm::vec3& InPoint);
+	bool Overlap(const AABB& InOther) const;
+	bool Contain(const AABB& InOther) const;
+
+	bool IsValid() const {
+		return Minimum.x <= Maximum.x && Minimum.y <= Maximum.y && Minimum.z <= Maximum.z;
+	}
+
+	glm::vec3 GetCenter() const {
+		return (Minimum + Maximum) * 0.5f;
+	}
+
+	glm::vec3 GetExtent() const {
+		return Maximum - Minimum;
+	}
+
+	float GetSurfaceArea() const;
+
+	// Index of the axis (0 = x, 1 = y, 2 = z) with the largest extent
+	int GetLongestAxis() const;
+
+	// Bounds of this box after transforming its eight corners by InMatrix
+	AABB Transformed(const glm::mat4& InMatrix) const;
+
+	/** Slab test against a ray given by its origin and per-axis reciprocal direction. Returns if the ray enters the box
+	 *  within [InT_Min, InT_Max], writing the entry distance to OutT_Entry.
+	 */
+	bool IntersectRay(const glm::vec3& InOrigin, const glm::vec3& InInverseDirection, float InT_Min, float InT_Max, float& OutT_Entry) const
+	{
+		glm::vec3 t0 = (Minimum - InOrigin) * InInverseDirection;
+		glm::vec3 t1 = (Maximum - InOrigin) * InInverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float tEntry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, InT_Min));
+		float tExit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, InT_Max));
+		OutT_Entry = tEntry;
+		return tEntry <= tExit;
+	}
+
+	glm::vec3 Minimum, Maximum;
+};
+
+}
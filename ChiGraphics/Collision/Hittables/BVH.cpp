@@ -0,0 +1,181 @@
+#include "BVH.h"
+#include <algorithm>
+#include <numeric>
+
+namespace CHISTUDIO {
+
+// Number of buckets primitive centroids are binned into when evaluating split candidates
+static const int kNumberOfSAHBins = 16;
+
+// Relative costs of visiting an interior node and intersecting a primitive, used by the surface area heuristic
+static const float kTraversalCost = 1.0f;
+static const float kIntersectionCost = 1.0f;
+
+struct FSAHBin
+{
+    AABB Bounds;
+    uint32_t Count = 0;
+};
+
+void BVH::Build(const std::vector<AABB>& InPrimitiveBounds)
+{
+    Clear();
+    if (InPrimitiveBounds.empty()) {
+        return;
+    }
+
+    std::vector<glm::vec3> centroids;
+    centroids.reserve(InPrimitiveBounds.size());
+    for (const AABB& bounds : InPrimitiveBounds) {
+        centroids.push_back(bounds.GetCenter());
+    }
+
+    PrimitiveOrder.resize(InPrimitiveBounds.size());
+    std::iota(PrimitiveOrder.begin(), PrimitiveOrder.end(), 0);
+
+    Nodes.reserve(2 * InPrimitiveBounds.size());
+    BuildNode(InPrimitiveBounds, centroids, 0, (uint32_t)InPrimitiveBounds.size(), 0);
+    Nodes.shrink_to_fit();
+}
+
+void BVH::Refit(const std::vector<AABB>& InPrimitiveBounds)
+{
+    // Children always come after their parent, so a reverse sweep visits children first
+    for (size_t nodeIndex = Nodes.size(); nodeIndex-- > 0;) {
+        FBVHNode& node = Nodes[nodeIndex];
+        AABB bounds;
+        if (node.IsLeaf()) {
+            for (uint32_t slot = node.RightChildOrFirstPrimitive; slot < node.RightChildOrFirstPrimitive + node.PrimitiveCount; slot++) {
+                bounds.UnionWith(InPrimitiveBounds[PrimitiveOrder[slot]]);
+            }
+        }
+        else {
+            bounds = Nodes[nodeIndex + 1].GetBounds();
+            bounds.UnionWith(Nodes[node.RightChildOrFirstPrimitive].GetBounds());
+        }
+        node.Minimum = bounds.Minimum;
+        node.Maximum = bounds.Maximum;
+    }
+}
+
+float BVH::GetCost() const
+{
+    float rootArea = GetBounds().GetSurfaceArea();
+    if (Nodes.empty() || rootArea <= 0.0f) {
+        return 0.0f;
+    }
+
+    float cost = 0.0f;
+    for (const FBVHNode& node : Nodes) {
+        float area = node.GetBounds().GetSurfaceArea();
+        cost += node.IsLeaf() ? area * kIntersectionCost * node.PrimitiveCount : area * kTraversalCost;
+    }
+    return cost / rootArea;
+}
+
+uint32_t BVH::BuildNode(const std::vector<AABB>& InPrimitiveBounds, const std::vector<glm::vec3>& InCentroids, uint32_t InBegin, uint32_t InEnd, int InDepth)
+{
+    uint32_t nodeIndex = (uint32_t)Nodes.size();
+    Nodes.emplace_back();
+
+    AABB bounds;
+    AABB centroidBounds;
+    for (uint32_t i = InBegin; i < InEnd; i++) {
+        bounds.UnionWith(InPrimitiveBounds[PrimitiveOrder[i]]);
+        centroidBounds.UnionWith(InCentroids[PrimitiveOrder[i]]);
+    }
+    Nodes[nodeIndex].Minimum = bounds.Minimum;
+    Nodes[nodeIndex].Maximum = bounds.Maximum;
+
+    auto makeLeaf = [&]() {
+        Nodes[nodeIndex].RightChildOrFirstPrimitive = InBegin;
+        Nodes[nodeIndex].PrimitiveCount = InEnd - InBegin;
+        return nodeIndex;
+    };
+
+    uint32_t count = InEnd - InBegin;
+    glm::vec3 centroidExtent = centroidBounds.GetExtent();
+    int longestAxis = centroidBounds.GetLongestAxis();
+    if (count == 1 || centroidExtent[longestAxis] <= 0.0f || InDepth >= kMaxDepth - 1) {
+        return makeLeaf();
+    }
+
+    // Bin centroids along every axis and find the cheapest split by the surface area heuristic
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    int bestSplit = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        if (centroidExtent[axis] <= 0.0f) {
+            continue;
+        }
+
+        FSAHBin bins[kNumberOfSAHBins];
+        float binScale = kNumberOfSAHBins / centroidExtent[axis];
+        for (uint32_t i = InBegin; i < InEnd; i++) {
+            uint32_t primitive = PrimitiveOrder[i];
+            int bin = std::min((int)((InCentroids[primitive][axis] - centroidBounds.Minimum[axis]) * binScale), kNumberOfSAHBins - 1);
+            bins[bin].Count++;
+            bins[bin].Bounds.UnionWith(InPrimitiveBounds[primitive]);
+        }
+
+        // Sweep from the right to accumulate the cost of every candidate right side, then sweep from the left
+        float rightAreaTimesCount[kNumberOfSAHBins];
+        AABB rightBounds;
+        uint32_t rightCount = 0;
+        for (int bin = kNumberOfSAHBins - 1; bin > 0; bin--) {
+            rightBounds.UnionWith(bins[bin].Bounds);
+            rightCount += bins[bin].Count;
+            rightAreaTimesCount[bin] = rightCount > 0 ? rightBounds.GetSurfaceArea() * rightCount : 0.0f;
+        }
+
+        AABB leftBounds;
+        uint32_t leftCount = 0;
+        for (int split = 1; split < kNumberOfSAHBins; split++) {
+            leftBounds.UnionWith(bins[split - 1].Bounds);
+            leftCount += bins[split - 1].Count;
+            if (leftCount == 0 || leftCount == count) {
+                continue;
+            }
+            float cost = leftBounds.GetSurfaceArea() * leftCount + rightAreaTimesCount[split];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    float parentArea = bounds.GetSurfaceArea();
+    float leafCost = kIntersectionCost * count;
+    float splitCost = parentArea > 0.0f ? kTraversalCost + kIntersectionCost * bestCost / parentArea : leafCost;
+    bool bIsSplitWorthwhile = bestAxis >= 0 && splitCost < leafCost;
+    if (!bIsSplitWorthwhile && count <= MaxLeafSize) {
+        return makeLeaf();
+    }
+
+    uint32_t middle;
+    if (bestAxis >= 0) {
+        float binScale = kNumberOfSAHBins / centroidExtent[bestAxis];
+        float axisMinimum = centroidBounds.Minimum[bestAxis];
+        auto middleIterator = std::partition(PrimitiveOrder.begin() + InBegin, PrimitiveOrder.begin() + InEnd, [&](uint32_t primitive) {
+            int bin = std::min((int)((InCentroids[primitive][bestAxis] - axisMinimum) * binScale), kNumberOfSAHBins - 1);
+            return bin < bestSplit;
+        });
+        middle = (uint32_t)(middleIterator - PrimitiveOrder.begin());
+    }
+    else {
+        // No usable bin boundary, fall back to a median split along the longest axis
+        middle = InBegin + count / 2;
+        std::nth_element(PrimitiveOrder.begin() + InBegin, PrimitiveOrder.begin() + middle, PrimitiveOrder.begin() + InEnd,
+            [&](uint32_t a, uint32_t b) { return InCentroids[a][longestAxis] < InCentroids[b][longestAxis]; });
+    }
+
+    // Left child is always the next node, so only the right child needs to be recorded
+    BuildNode(InPrimitiveBounds, InCentroids, InBegin, middle, InDepth + 1);
+    uint32_t rightIndex = BuildNode(InPrimitiveBounds, InCentroids, middle, InEnd, InDepth + 1);
+    Nodes[nodeIndex].RightChildOrFirstPrimitive = rightIndex;
+    Nodes[nodeIndex].PrimitiveCount = 0;
+    return nodeIndex;
+}
+
+}
@@ -0,0 +1,240 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include "AABB.h"
+#include "../FRay.h"
+
+namespace CHISTUDIO {
+
+/** Single node of a flattened BVH, packed into 32 bytes. Nodes are laid out depth-first, so the left child
+ *  of an interior node is always the next node in the array and only the right child index is stored.
+ *  Leaves store a contiguous range of primitives instead.
+ */
+struct FBVHNode
+{
+    glm::vec3 Minimum;
+    uint32_t RightChildOrFirstPrimitive;
+    glm::vec3 Maximum;
+    uint32_t PrimitiveCount;
+
+    bool IsLeaf() const {
+        return PrimitiveCount > 0;
+    }
+
+    AABB GetBounds() const {
+        return AABB(Minimum, Maximum);
+    }
+};
+
+static_assert(sizeof(FBVHNode) == 32, "FBVHNode is expected to be 32 bytes");
+
+/** Bounding volume hierarchy over an arbitrary list of primitive bounds, stored as one contiguous array of nodes.
+ *  Built top-down with the binned surface area heuristic. Leaves hold at most MaxLeafSize primitives, unless their
+ *  centroids are all identical. After building, owners should reorder their primitives to match GetPrimitiveOrder(),
+ *  so that leaf ranges index the primitives directly.
+ */
+class BVH
+{
+public:
+    BVH(uint32_t InMaxLeafSize = 4) : MaxLeafSize(InMaxLeafSize) {
+    }
+
+    void Build(const std::vector<AABB>& InPrimitiveBounds);
+
+    /** Update node bounds for primitives that moved, keeping the tree's structure. InPrimitiveBounds is indexed like the
+     *  array passed to Build and must have the same size. Much cheaper than rebuilding, but the tree degrades as
+     *  primitives move away from where they were built, which GetCost measures.
+     */
+    void Refit(const std::vector<AABB>& InPrimitiveBounds);
+
+    // Expected cost of tracing a ray through the tree by the surface area heuristic, relative to intersecting one primitive
+    float GetCost() const;
+
+    void Clear() {
+        Nodes.clear();
+        PrimitiveOrder.clear();
+    }
+
+    bool IsEmpty() const {
+        return Nodes.empty();
+    }
+
+    AABB GetBounds() const {
+        return Nodes.empty() ? AABB() : Nodes[0].GetBounds();
+    }
+
+    const std::vector<FBVHNode>& GetNodes() const {
+        return Nodes;
+    }
+
+    // For each leaf slot, the index of the primitive in the array that was passed to Build
+    const std::vector<uint32_t>& GetPrimitiveOrder() const {
+        return PrimitiveOrder;
+    }
+
+    /** Walks the hierarchy front-to-back along InRay. InIntersectPrimitive(slot, InOutT_Max) is called for every primitive
+     *  in a reached leaf and returns if it recorded a hit, shrinking InOutT_Max to the new closest distance.
+     *  Subtrees entirely behind the current closest hit are skipped. Returns if any primitive was hit.
+     */
+    template <typename FIntersectFunction>
+    bool Traverse(const FRay& InRay, float InT_Min, float& InOutT_Max, FIntersectFunction InIntersectPrimitive) const;
+
+    /** Any-hit traversal. InIsPrimitiveOccluding(slot) is called for primitives in leaves reached between InT_Min and
+     *  InT_Max, and returns if that primitive blocks the ray. Stops and returns true at the first blocking primitive.
+     */
+    template <typename FOcclusionFunction>
+    bool Occluded(const FRay& InRay, float InT_Min, float InT_Max, FOcclusionFunction InIsPrimitiveOccluding) const;
+
+    static glm::vec3 GetInverseDirection(const glm::vec3& InDirection)
+    {
+        // Avoid infinities for axis-aligned rays, which would produce NaNs in the slab test
+        const float epsilon = 1e-12f;
+        return glm::vec3(1.0f / (std::abs(InDirection.x) > epsilon ? InDirection.x : std::copysign(epsilon, InDirection.x)),
+                         1.0f / (std::abs(InDirection.y) > epsilon ? InDirection.y : std::copysign(epsilon, InDirection.y)),
+                         1.0f / (std::abs(InDirection.z) > epsilon ? InDirection.z : std::copysign(epsilon, InDirection.z)));
+    }
+
+    // Traversal uses a fixed size stack, so builds are limited to this depth
+    static const int kMaxDepth = 64;
+
+private:
+    uint32_t BuildNode(const std::vector<AABB>& InPrimitiveBounds, const std::vector<glm::vec3>& InCentroids, uint32_t InBegin, uint32_t InEnd, int InDepth);
+
+    std::vector<FBVHNode> Nodes;
+    std::vector<uint32_t> PrimitiveOrder;
+    uint32_t MaxLeafSize;
+};
+
+template <typename FIntersectFunction>
+bool BVH::Traverse(const FRay& InRay, float InT_Min, float& InOutT_Max, FIntersectFunction InIntersectPrimitive) const
+{
+    if (Nodes.empty()) {
+        return false;
+    }
+
+    const glm::vec3& origin = InRay.GetOrigin();
+    glm::vec3 inverseDirection = GetInverseDirection(InRay.GetDirection());
+
+    float rootEntry;
+    if (!Nodes[0].GetBounds().IntersectRay(origin, inverseDirection, InT_Min, InOutT_Max, rootEntry)) {
+        return false;
+    }
+
+    struct FStackEntry {
+        uint32_t NodeIndex;
+        float EntryTime;
+    };
+    FStackEntry stack[kMaxDepth];
+    int stackSize = 0;
+
+    bool bHitAnything = false;
+    uint32_t nodeIndex = 0;
+    while (true) {
+        const FBVHNode& node = Nodes[nodeIndex];
+        if (node.IsLeaf()) {
+            uint32_t end = node.RightChildOrFirstPrimitive + node.PrimitiveCount;
+            for (uint32_t slot = node.RightChildOrFirstPrimitive; slot < end; slot++) {
+                bHitAnything |= InIntersectPrimitive(slot, InOutT_Max);
+            }
+        }
+        else {
+            uint32_t nearIndex = nodeIndex + 1;
+            uint32_t farIndex = node.RightChildOrFirstPrimitive;
+            float nearEntry, farEntry;
+            bool bHitNear = Nodes[nearIndex].GetBounds().IntersectRay(origin, inverseDirection, InT_Min, InOutT_Max, nearEntry);
+            bool bHitFar = Nodes[farIndex].GetBounds().IntersectRay(origin, inverseDirection, InT_Min, InOutT_Max, farEntry);
+
+            if (bHitNear && bHitFar) {
+                if (farEntry < nearEntry) {
+                    std::swap(nearIndex, farIndex);
+                    std::swap(nearEntry, farEntry);
+                }
+                stack[stackSize++] = { farIndex, farEntry };
+                nodeIndex = nearIndex;
+                continue;
+            }
+            if (bHitNear || bHitFar) {
+                nodeIndex = bHitNear ? nearIndex : farIndex;
+                continue;
+            }
+        }
+
+        // Pop the next subtree that still lies in front of the closest hit
+        bool bFoundNext = false;
+        while (stackSize > 0) {
+            const FStackEntry& entry = stack[--stackSize];
+            if (entry.EntryTime <= InOutT_Max) {
+                nodeIndex = entry.NodeIndex;
+                bFoundNext = true;
+                break;
+            }
+        }
+        if (!bFoundNext) {
+            break;
+        }
+    }
+
+    return bHitAnything;
+}
+
+template <typename FOcclusionFunction>
+bool BVH::Occluded(const FRay& InRay, float InT_Min, float InT_Max, FOcclusionFunction InIsPrimitiveOccluding) const
+{
+    if (Nodes.empty()) {
+        return false;
+    }
+
+    const glm::vec3& origin = InRay.GetOrigin();
+    glm::vec3 inverseDirection = GetInverseDirection(InRay.GetDirection());
+
+    float rootEntry;
+    if (!Nodes[0].GetBounds().IntersectRay(origin, inverseDirection, InT_Min, InT_Max, rootEntry)) {
+        return false;
+    }
+
+    // The range never shrinks, so pushed subtrees are always visited and need no entry times
+    uint32_t stack[kMaxDepth];
+    int stackSize = 0;
+
+    uint32_t nodeIndex = 0;
+    while (true) {
+        const FBVHNode& node = Nodes[nodeIndex];
+        if (node.IsLeaf()) {
+            uint32_t end = node.RightChildOrFirstPrimitive + node.PrimitiveCount;
+            for (uint32_t slot = node.RightChildOrFirstPrimitive; slot < end; slot++) {
+                if (InIsPrimitiveOccluding(slot)) {
+                    return true;
+                }
+            }
+        }
+        else {
+            uint32_t nearIndex = nodeIndex + 1;
+            uint32_t farIndex = node.RightChildOrFirstPrimitive;
+            float nearEntry, farEntry;
+            bool bHitNear = Nodes[nearIndex].GetBounds().IntersectRay(origin, inverseDirection, InT_Min, InT_Max, nearEntry);
+            bool bHitFar = Nodes[farIndex].GetBounds().IntersectRay(origin, inverseDirection, InT_Min, InT_Max, farEntry);
+
+            if (bHitNear && bHitFar) {
+                stack[stackSize++] = farIndex;
+                nodeIndex = nearIndex;
+                continue;
+            }
+            if (bHitNear || bHitFar) {
+                nodeIndex = bHitNear ? nearIndex : farIndex;
+                continue;
+            }
+        }
+
+        if (stackSize == 0) {
+            break;
+        }
+        nodeIndex = stack[--stackSize];
+    }
+
+    return false;
+}
+
+}
@@ -1,11 +1,10 @@
 #include <cmath>
 #include <glm/gtx/norm.hpp>
 #include "CylinderHittable.h"
-#include "ChiGraphics/Materials/Material.h"
 
 namespace CHISTUDIO {
 
-bool CylinderHittable::Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, Material InMaterial) const
+bool CylinderHittable::Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, const FImage* InAlphaMap) const
 {
     // Works without having to transform the cylinders direction 
 
@@ -54,6 +53,7 @@ bool CylinderHittable::Intersect(const FRay& InRay, float InT_Min, FHitRecord& I
             InRecord.Time = t;
             InRecord.Position = intersectionPoint;
             //InRecord.Normal = glm::normalize(InRecord.Position - Origin);
+            InRecord.UVScale = 0.0f;
             return true;
         }
     }
@@ -66,4 +66,14 @@ float CylinderHittable::Sample(const glm::vec3& InTargetPoint, glm::vec3& OutPoi
     return 0.0f;
 }
 
+AABB CylinderHittable::GetBoundingBox() const
+{
+    // Conservative bounds: both end caps grown by the radius on every axis
+    glm::vec3 end = Origin + glm::normalize(Direction) * Length;
+    AABB bounds(glm::min(Origin, end), glm::max(Origin, end));
+    bounds.Minimum -= glm::vec3(Radius);
+    bounds.Maximum += glm::vec3(Radius);
+    return bounds;
+}
+
 }
\ No newline at end of file
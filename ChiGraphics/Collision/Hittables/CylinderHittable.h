@@ -9,8 +9,9 @@ class CylinderHittable : public IHittableBase
 public:
 	CylinderHittable(float InRadius, glm::vec3 InOrigin, glm::vec3 InDirection, float InLength) : Radius(InRadius), Origin(InOrigin), Direction(InDirection), Length(InLength) {}
 
-	bool Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, class Material InMaterial) const override;
+	bool Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, const class FImage* InAlphaMap) const override;
 	float Sample(const glm::vec3& InTargetPoint, glm::vec3& OutPoint, glm::vec3& OutNormal, RNG& InRNG) const override;
+	AABB GetBoundingBox() const override;
 
 private:
 	float Radius;
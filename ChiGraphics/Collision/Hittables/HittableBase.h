@@ -2,6 +2,7 @@
 
 #include "../FRay.h"
 #include "../FHitRecord.h"
+#include "AABB.h"
 #include "ChiGraphics/RNG.h"
 
 namespace CHISTUDIO {
@@ -15,23 +16,53 @@ class IHittableBase
 {
 public:
     /** Try to intersect the hittable with the given ray. Collisions must occur at least InT_Min on the given ray.
-     *  InRecord is modified with collision info. InMaterial allows alpha sampling to be considered for intersection.
+     *  InRecord is modified with collision info. InAlphaMap, if set, masks out hits where its sampled value is near zero.
      *  It is assumed that ray is in the local coordinates. Returns if an intersection occured.
      */
-    virtual bool Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, class Material InMaterial) const = 0;
+    virtual bool Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, const class FImage* InAlphaMap) const = 0;
 
-    /** Sample the surface of the hittable. Note that solid angle sampling is often best. Ref: https://schuttejoe.github.io/post/arealightsampling/ 
-     *  Returns the probability of the sampled point.
+    /** Any-hit query, used for shadow rays. Returns if the ray is blocked by a hit between InT_Min and InT_Max, honoring
+     *  InAlphaMap like Intersect. No hit info is produced, so implementations may stop at the first blocking hit found.
+     *  It is assumed that ray is in the local coordinates.
+     */
+    virtual bool Occluded(const FRay& InRay, float InT_Min, float InT_Max, const class FImage* InAlphaMap) const {
+        FHitRecord record;
+        record.Time = InT_Max;
+        return Intersect(InRay, InT_Min, record, InAlphaMap);
+    }
+
+    /** Sample a point on the surface of the hittable to light InTargetPoint, for using the hittable as a light. Unlike
+     *  the other queries, points and normals are in world space, using ModelMatrix. OutNormal is the shading normal at
+     *  the sampled point. Returns the pdf of the sample per unit solid angle seen from InTargetPoint, or 0 if no point
+     *  could be sampled. Ref: https://schuttejoe.github.io/post/arealightsampling/
      */
     virtual float Sample(const glm::vec3& InTargetPoint, glm::vec3& OutPoint, glm::vec3& OutNormal, RNG& InRNG) const = 0;
 
+    /** Solid angle pdf of Sample choosing InPoint, a world space point on the surface with shading normal InNormal, to
+     *  light InTargetPoint. Used to weight light found by other sampling strategies, so implementations may approximate
+     *  as long as the same value is used for both strategies.
+     */
+    virtual float GetSamplePDF(const glm::vec3& InTargetPoint, const glm::vec3& InPoint, const glm::vec3& InNormal) const {
+        return 0.0f;
+    }
+
+    /** Precompute what Sample needs, once ModelMatrix is set. Called on hittables that will be sampled as lights. */
+    virtual void PrepareSampling() {}
+
+    /** Bounds of the hittable in its local coordinates. Used to build the scene-level acceleration structure. */
+    virtual AABB GetBoundingBox() const = 0;
+
     virtual ~IHittableBase() {}
 
     glm::mat4 ModelMatrix;
     glm::mat4 InverseModelMatrix;
     glm::mat4 TransposeInverseModelMatrix;
 
-    class Material Material_;
+    // Index of this hittable's material in the ray tracer's material table
+    uint32_t MaterialIndex = 0;
+
+    // Index of this hittable in the ray tracer's render lights, or -1 if it is not sampled as a light
+    int32_t LightIndex = -1;
 };
 
 }
\ No newline at end of file
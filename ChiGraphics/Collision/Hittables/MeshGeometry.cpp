@@ -0,0 +1,89 @@
+#include "MeshGeometry.h"
+#include <cstdint>
+#include <stdexcept>
+
+namespace CHISTUDIO {
+
+namespace {
+
+// FNV-1a over the raw bytes of an array, seeded with the running hash
+template <typename T>
+uint64_t HashArray(const std::vector<T>& InArray, uint64_t InHash)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(InArray.data());
+    size_t byteCount = InArray.size() * sizeof(T);
+    for (size_t i = 0; i < byteCount; i++)
+    {
+        InHash = (InHash ^ bytes[i]) * 1099511628211ull;
+    }
+    // Separate arrays by their length, so data shifting between them changes the hash
+    return (InHash ^ (uint64_t)InArray.size()) * 1099511628211ull;
+}
+
+}
+
+FMeshGeometry::FMeshGeometry(const FPositionArray& InPositions, const FNormalArray& InNormals, const FIndexArray& InIndices, const FTexCoordArray& InUVs, bool InUseBVH)
+{
+    size_t num_vertices = InIndices.size();
+    if (num_vertices % 3 != 0 || InNormals.size() != InPositions.size())
+        throw std::runtime_error("Bad mesh data in Mesh constuctor!");
+
+    // Create compact triangle records for mesh data, with shading attributes stored separately
+    Triangles.reserve(num_vertices / 3);
+    TriangleAttributes.reserve(num_vertices / 3);
+    for (size_t i = 0; i < num_vertices; i += 3) {
+        Triangles.emplace_back(InPositions.at(InIndices.at(i)), InPositions.at(InIndices.at(i + 1)), InPositions.at(InIndices.at(i + 2)));
+
+        FTriangleAttributes attributes;
+        for (size_t vertex = 0; vertex < 3; vertex++) {
+            attributes.Normals[vertex] = InNormals.at(InIndices.at(i + vertex));
+            attributes.UVs[vertex] = InUVs.at(InIndices.at(i + vertex));
+        }
+        TriangleAttributes.push_back(attributes);
+    }
+
+    for (const FTrianglePrimitive& triangle : Triangles) {
+        Bounds.UnionWith(triangle.GetBoundingBox());
+    }
+
+    bUseBVH = InUseBVH;
+
+    // Build BVH and store triangles in leaf order
+    if (bUseBVH && !Triangles.empty())
+    {
+        std::vector<AABB> triangleBounds;
+        triangleBounds.reserve(Triangles.size());
+        for (const FTrianglePrimitive& triangle : Triangles)
+        {
+            triangleBounds.push_back(triangle.GetBoundingBox());
+        }
+        BVH binaryBVH;
+        binaryBVH.Build(triangleBounds);
+
+        std::vector<FTrianglePrimitive> orderedTriangles;
+        std::vector<FTriangleAttributes> orderedAttributes;
+        orderedTriangles.reserve(Triangles.size());
+        orderedAttributes.reserve(Triangles.size());
+        for (uint32_t triangleIndex : binaryBVH.GetPrimitiveOrder())
+        {
+            orderedTriangles.push_back(Triangles[triangleIndex]);
+            orderedAttributes.push_back(TriangleAttributes[triangleIndex]);
+        }
+        Triangles.swap(orderedTriangles);
+        TriangleAttributes.swap(orderedAttributes);
+
+        MeshBVH.Build(binaryBVH, Triangles);
+    }
+}
+
+size_t FMeshGeometry::HashMeshData(const FPositionArray& InPositions, const FNormalArray& InNormals, const FIndexArray& InIndices, const FTexCoordArray& InUVs)
+{
+    uint64_t hash = 14695981039346656037ull;
+    hash = HashArray(InPositions, hash);
+    hash = HashArray(InNormals, hash);
+    hash = HashArray(InIndices, hash);
+    hash = HashArray(InUVs, hash);
+    return (size_t)hash;
+}
+
+}
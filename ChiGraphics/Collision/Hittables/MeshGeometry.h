@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include "ChiGraphics/AliasTypes.h"
+#include "ChiGraphics/Collision/Hittables/AABB.h"
+#include "ChiGraphics/Collision/Hittables/TrianglePrimitive.h"
+#include "ChiGraphics/Collision/Hittables/WideBVH.h"
+
+namespace CHISTUDIO {
+
+/** Triangles of a mesh and their acceleration structure, in the mesh's local coordinates. Immutable once built, so one
+ *  geometry can be shared by every MeshHittable instancing it, each with its own transform and material.
+ */
+class FMeshGeometry
+{
+public:
+    FMeshGeometry(const FPositionArray& InPositions, const FNormalArray& InNormals, const FIndexArray& InIndices, const FTexCoordArray& InUVs, bool InUseBVH = true);
+
+    // Hash of the vertex data a geometry would be built from. Equal data hashes equally, so meshes with identical
+    // contents, such as duplicated nodes, can share one geometry.
+    static size_t HashMeshData(const FPositionArray& InPositions, const FNormalArray& InNormals, const FIndexArray& InIndices, const FTexCoordArray& InUVs);
+
+    const std::vector<FTrianglePrimitive>& GetTriangles() const {
+        return Triangles;
+    }
+
+    const std::vector<FTriangleAttributes>& GetTriangleAttributes() const {
+        return TriangleAttributes;
+    }
+
+    const AABB& GetBounds() const {
+        return Bounds;
+    }
+
+    const WideBVH& GetBVH() const {
+        return MeshBVH;
+    }
+
+    bool UsesBVH() const {
+        return bUseBVH;
+    }
+
+private:
+    // Parallel arrays, ordered to match the BVH leaves when it is used
+    std::vector<FTrianglePrimitive> Triangles;
+    std::vector<FTriangleAttributes> TriangleAttributes;
+    AABB Bounds;
+    WideBVH MeshBVH;
+    bool bUseBVH;
+};
+
+}
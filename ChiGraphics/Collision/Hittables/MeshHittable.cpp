@@ -1,63 +1,131 @@
 #include "MeshHittable.h"
-#include "Octree.h"
+#include "TriangleHittable.h"
 #include "ChiGraphics/Utilities.h"
 #include "ChiGraphics/Meshes/VertexObject.h"
-#include "ChiGraphics/Materials/Material.h"
+#include "ChiGraphics/Textures/FImage.h"
 
 namespace CHISTUDIO {
-    MeshHittable::MeshHittable(const FPositionArray& positions, const FNormalArray& normals, const FIndexArray& indices, const FTexCoordArray& uvs, bool InUseOctree)
+    MeshHittable::MeshHittable(const FPositionArray& positions, const FNormalArray& normals, const FIndexArray& indices, const FTexCoordArray& uvs, bool InUseBVH)
+    : Geometry(std::make_shared<FMeshGeometry>(positions, normals, indices, uvs, InUseBVH))
 {
-    size_t num_vertices = indices.size();
-    if (num_vertices % 3 != 0 || normals.size() != positions.size())
-        throw std::runtime_error("Bad mesh data in Mesh constuctor!");
-
-    // Create triangle hittables for mesh data
-    for (size_t i = 0; i < num_vertices; i += 3) {
-        Triangles.emplace_back(
-            positions.at(indices.at(i)), positions.at(indices.at(i + 1)),
-            positions.at(indices.at(i + 2)), normals.at(indices.at(i)),
-            normals.at(indices.at(i + 1)), normals.at(indices.at(i + 2)), 
-            uvs.at(indices.at(i)),
-            uvs.at(indices.at(i + 1)),
-            uvs.at(indices.at(i + 2)));
-    }
+}
+
+MeshHittable::MeshHittable(std::shared_ptr<const FMeshGeometry> InGeometry)
+    : Geometry(std::move(InGeometry))
+{
+}
+
+bool MeshHittable::Intersect(const FRay& InRay, float Tmin, FHitRecord& InRecord, const FImage* InAlphaMap) const
+{
+    const glm::vec3& origin = InRay.GetOrigin();
+    const glm::vec3& direction = InRay.GetDirection();
+    const std::vector<FTrianglePrimitive>& triangles = Geometry->GetTriangles();
+    const std::vector<FTriangleAttributes>& triangleAttributes = Geometry->GetTriangleAttributes();
+    
+    // Only the closest hit's barycentrics are kept, shading attributes are interpolated once at the end
+    uint32_t closestTriangle = 0;
+    float closestBeta = 0.0f;
+    float closestGamma = 0.0f;
+    auto acceptHit = [&](uint32_t InTriangleIndex, float InT, float InBeta, float InGamma) {
+        // Check alpha mask before considering
+        if (InAlphaMap && InAlphaMap->SampleWithUV(triangleAttributes[InTriangleIndex].GetUV(InBeta, InGamma)).x <= 0.001f) {
+            return false;
+        }
+        closestTriangle = InTriangleIndex;
+        closestBeta = InBeta;
+        closestGamma = InGamma;
+        return true;
+    };
 
-    bUseOctree = InUseOctree;
+    float closestTime = InRecord.Time;
+    bool bTriangleHit = false;
+    if (Geometry->UsesBVH())
+    {
+        bTriangleHit = Geometry->GetBVH().Traverse(InRay, Tmin, closestTime, acceptHit);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < (uint32_t)triangles.size(); i++)
+        {
+            float t, beta, gamma;
+            if (triangles[i].Intersect(origin, direction, Tmin, closestTime, t, beta, gamma) && acceptHit(i, t, beta, gamma))
+            {
+                closestTime = t;
+                bTriangleHit = true;
+            }
+        }
+    }
 
-    // Build Octree.
-    if (bUseOctree)
+    if (bTriangleHit)
     {
-        std::cout << "Building octree" << std::endl;
-        Octree_ = make_unique<Octree>();
-        Octree_->Build(*this);
-        std::cout << "Finished octree" << std::endl;
+        const FTriangleAttributes& attributes = triangleAttributes[closestTriangle];
+        InRecord.Time = closestTime;
+        InRecord.Normal = attributes.GetNormal(closestBeta, closestGamma);
+        InRecord.UV = attributes.GetUV(closestBeta, closestGamma);
+        InRecord.UVScale = attributes.GetUVScale(triangles[closestTriangle]);
     }
+    return bTriangleHit;
 }
 
-bool MeshHittable::Intersect(const FRay& InRay, float Tmin, FHitRecord& InRecord, Material InMaterial) const
+bool MeshHittable::Occluded(const FRay& InRay, float InT_Min, float InT_Max, const FImage* InAlphaMap) const
 {
-    if (bUseOctree)
+    const std::vector<FTriangleAttributes>& triangleAttributes = Geometry->GetTriangleAttributes();
+
+    // Any triangle hit that is not masked out by the alpha map blocks the ray
+    auto isBlockingHit = [&](uint32_t InTriangleIndex, float InT, float InBeta, float InGamma) {
+        return InAlphaMap == nullptr || InAlphaMap->SampleWithUV(triangleAttributes[InTriangleIndex].GetUV(InBeta, InGamma)).x > 0.001f;
+    };
+
+    if (Geometry->UsesBVH())
     {
-        return Octree_->Intersect(InRay, Tmin, InRecord, InMaterial);
+        return Geometry->GetBVH().Occluded(InRay, InT_Min, InT_Max, isBlockingHit);
     }
-    else
+
+    const std::vector<FTrianglePrimitive>& triangles = Geometry->GetTriangles();
+    const glm::vec3& origin = InRay.GetOrigin();
+    const glm::vec3& direction = InRay.GetDirection();
+    for (uint32_t i = 0; i < (uint32_t)triangles.size(); i++)
     {
-        bool bTriangleHit = false;
-        for (TriangleHittable tri : Triangles)
+        float t, beta, gamma;
+        if (triangles[i].Intersect(origin, direction, InT_Min, InT_Max, t, beta, gamma) && isBlockingHit(i, t, beta, gamma))
         {
-            bTriangleHit |= tri.Intersect(InRay, Tmin, InRecord, InMaterial);
+            return true;
         }
-        return bTriangleHit;
     }
+    return false;
 }
 
 float MeshHittable::Sample(const glm::vec3& InTargetPoint, glm::vec3& OutPoint, glm::vec3& OutNormal, RNG& InRNG) const
 {
-    // Sample a random triangle. Account for the number of triangles when calculating probability
-    size_t numberOfTriangles = Triangles.size() - 1;
-    int randomIndex = (int)(InRNG.Float() * numberOfTriangles);
-    float probability = Triangles[randomIndex].Sample(InTargetPoint, OutPoint, OutNormal, InRNG);
-    return probability / numberOfTriangles;
+    if (TriangleDistribution.IsEmpty())
+    {
+        return 0.0f;
+    }
+
+    // Picking a triangle by its share of the area and then a uniform point on it is uniform over the whole mesh
+    float trianglePMF;
+    uint32_t triangleIndex = TriangleDistribution.Sample(InRNG.Float(), trianglePMF);
+    glm::vec3 geometricNormal = TriangleHittable::SampleWorldSurface(*this, Geometry->GetTriangles()[triangleIndex], Geometry->GetTriangleAttributes()[triangleIndex], OutPoint, OutNormal, InRNG);
+    return AreaToSolidAnglePDF(1.0f / WorldArea, InTargetPoint, OutPoint, geometricNormal);
 }
 
-}
\ No newline at end of file
+float MeshHittable::GetSamplePDF(const glm::vec3& InTargetPoint, const glm::vec3& InPoint, const glm::vec3& InNormal) const
+{
+    // The shading normal stands in for the geometric one, which hits do not record
+    return WorldArea > 0.0f ? AreaToSolidAnglePDF(1.0f / WorldArea, InTargetPoint, InPoint, InNormal) : 0.0f;
+}
+
+void MeshHittable::PrepareSampling()
+{
+    std::vector<float> areas;
+    areas.reserve(Geometry->GetTriangles().size());
+    WorldArea = 0.0f;
+    for (const FTrianglePrimitive& triangle : Geometry->GetTriangles())
+    {
+        areas.push_back(TriangleHittable::GetWorldArea(triangle, ModelMatrix));
+        WorldArea += areas.back();
+    }
+    TriangleDistribution = FAliasTable(areas);
+}
+
+}
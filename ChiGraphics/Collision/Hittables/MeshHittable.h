@@ -1,33 +1,53 @@
 #pragma once
 
+#include <memory>
 #include "ChiGraphics/Collision/Hittables/HittableBase.h"
 #include "ChiGraphics/AliasTypes.h"
-#include "ChiGraphics/Collision/Hittables/TriangleHittable.h"
-#include "ChiGraphics/Collision/Hittables/Octree.h"
+#include "ChiGraphics/AliasTable.h"
+#include "ChiGraphics/Collision/Hittables/MeshGeometry.h"
 
 namespace CHISTUDIO {
 
-/** Implements the hittable interface for a mesh of triangles. 
- *  Can construct an octree acceleration structure to speed up multiple
- *  collision checks, or can simply check each triangle for a single intersection.
+/** Implements the hittable interface for an instance of a triangle mesh. The triangles and their BVH live in an
+ *  FMeshGeometry that may be shared with other instances, so an instance only adds its transform, material and, when
+ *  used as a light, its area distribution. Geometry built without a BVH simply checks each triangle, which suits a
+ *  single collision check.
  */
 class MeshHittable: public IHittableBase
 {
 
 public:
-    MeshHittable(const FPositionArray& positions, const FNormalArray& normals, const FIndexArray& indices, const FTexCoordArray& uvs, bool InUseOctree = true);
+    MeshHittable(const FPositionArray& positions, const FNormalArray& normals, const FIndexArray& indices, const FTexCoordArray& uvs, bool InUseBVH = true);
+    explicit MeshHittable(std::shared_ptr<const FMeshGeometry> InGeometry);
 
-    bool Intersect(const FRay& InRay, float Tmin, FHitRecord& InRecord, class Material InMaterial) const override;
+    bool Intersect(const FRay& InRay, float Tmin, FHitRecord& InRecord, const class FImage* InAlphaMap) const override;
+    bool Occluded(const FRay& InRay, float InT_Min, float InT_Max, const class FImage* InAlphaMap) const override;
+    // Picks triangles by world space area. Returns 0 until PrepareSampling has built the distribution.
     float Sample(const glm::vec3& InTargetPoint, glm::vec3& OutPoint, glm::vec3& OutNormal, RNG& InRNG) const override;
+    float GetSamplePDF(const glm::vec3& InTargetPoint, const glm::vec3& InPoint, const glm::vec3& InNormal) const override;
+    void PrepareSampling() override;
+    AABB GetBoundingBox() const override {
+        return Geometry->GetBounds();
+    }
+
+    const std::vector<FTrianglePrimitive>& GetTriangles() const {
+        return Geometry->GetTriangles();
+    }
 
-    const std::vector<TriangleHittable>& GetTriangles() const {
-        return Triangles;
+    const std::vector<FTriangleAttributes>& GetTriangleAttributes() const {
+        return Geometry->GetTriangleAttributes();
+    }
+
+    const std::shared_ptr<const FMeshGeometry>& GetGeometry() const {
+        return Geometry;
     }
 
 private:
-    std::vector<TriangleHittable> Triangles;
-    std::unique_ptr<Octree> Octree_;
-    bool bUseOctree;
+    std::shared_ptr<const FMeshGeometry> Geometry;
+
+    // Triangles weighted by their world space area, for sampling the mesh as a light
+    FAliasTable TriangleDistribution;
+    float WorldArea = 0.0f;
 };
 
 }
@@ -0,0 +1,205 @@
+#include "SIMDKernels.h"
+#include "AABB.h"
+#include "TrianglePrimitive.h"
+#include <iostream>
+
+#ifdef CHI_SIMD_X86
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#endif
+
+namespace CHISTUDIO {
+
+static uint32_t IntersectWideNodeScalar(const FWideBVHNode& InNode, const FWideRay& InRay, float InT_Min, float InT_Max, float* OutEntryTimes)
+{
+    uint32_t hitMask = 0;
+    for (uint32_t i = 0; i < kWideBVHWidth; i++) {
+        AABB bounds(InNode.MinX[i], InNode.MinY[i], InNode.MinZ[i], InNode.MaxX[i], InNode.MaxY[i], InNode.MaxZ[i]);
+        if (bounds.IntersectRay(InRay.Origin, InRay.InverseDirection, InT_Min, InT_Max, OutEntryTimes[i])) {
+            hitMask |= 1u << i;
+        }
+    }
+    return hitMask;
+}
+
+static uint32_t IntersectTrianglePacketScalar(const FTrianglePacket& InPacket, const FWideRay& InRay, float InT_Min, float InT_Max, float* OutTimes, float* OutBetas, float* OutGammas)
+{
+    uint32_t hitMask = 0;
+    for (uint32_t i = 0; i < InPacket.TriangleCount; i++) {
+        FTrianglePrimitive triangle;
+        triangle.Vertex0 = glm::vec3(InPacket.Vertex0X[i], InPacket.Vertex0Y[i], InPacket.Vertex0Z[i]);
+        triangle.Edge1 = glm::vec3(InPacket.Edge1X[i], InPacket.Edge1Y[i], InPacket.Edge1Z[i]);
+        triangle.Edge2 = glm::vec3(InPacket.Edge2X[i], InPacket.Edge2Y[i], InPacket.Edge2Z[i]);
+        if (triangle.Intersect(InRay.Origin, InRay.Direction, InT_Min, InT_Max, OutTimes[i], OutBetas[i], OutGammas[i])) {
+            hitMask |= 1u << i;
+        }
+    }
+    return hitMask;
+}
+
+#ifdef CHI_SIMD_X86
+
+// SSE2 is part of x86-64, so these kernels need no runtime check. Each call processes the eight lanes as two halves.
+
+static uint32_t IntersectWideNodeSSE(const FWideBVHNode& InNode, const FWideRay& InRay, float InT_Min, float InT_Max, float* OutEntryTimes)
+{
+    const __m128 originX = _mm_set1_ps(InRay.Origin.x);
+    const __m128 originY = _mm_set1_ps(InRay.Origin.y);
+    const __m128 originZ = _mm_set1_ps(InRay.Origin.z);
+    const __m128 inverseDirectionX = _mm_set1_ps(InRay.InverseDirection.x);
+    const __m128 inverseDirectionY = _mm_set1_ps(InRay.InverseDirection.y);
+    const __m128 inverseDirectionZ = _mm_set1_ps(InRay.InverseDirection.z);
+    const __m128 tMin = _mm_set1_ps(InT_Min);
+    const __m128 tMax = _mm_set1_ps(InT_Max);
+
+    uint32_t hitMask = 0;
+    for (uint32_t half = 0; half < kWideBVHWidth; half += 4) {
+        __m128 t0X = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(InNode.MinX + half), originX), inverseDirectionX);
+        __m128 t1X = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(InNode.MaxX + half), originX), inverseDirectionX);
+        __m128 t0Y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(InNode.MinY + half), originY), inverseDirectionY);
+        __m128 t1Y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(InNode.MaxY + half), originY), inverseDirectionY);
+        __m128 t0Z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(InNode.MinZ + half), originZ), inverseDirectionZ);
+        __m128 t1Z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(InNode.MaxZ + half), originZ), inverseDirectionZ);
+
+        __m128 entry = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0X, t1X), _mm_min_ps(t0Y, t1Y)), _mm_max_ps(_mm_min_ps(t0Z, t1Z), tMin));
+        __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0X, t1X), _mm_max_ps(t0Y, t1Y)), _mm_min_ps(_mm_max_ps(t0Z, t1Z), tMax));
+
+        _mm_storeu_ps(OutEntryTimes + half, entry);
+        hitMask |= (uint32_t)_mm_movemask_ps(_mm_cmple_ps(entry, exit)) << half;
+    }
+    return hitMask;
+}
+
+static uint32_t IntersectTrianglePacketSSE(const FTrianglePacket& InPacket, const FWideRay& InRay, float InT_Min, float InT_Max, float* OutTimes, float* OutBetas, float* OutGammas)
+{
+    const __m128 originX = _mm_set1_ps(InRay.Origin.x);
+    const __m128 originY = _mm_set1_ps(InRay.Origin.y);
+    const __m128 originZ = _mm_set1_ps(InRay.Origin.z);
+    const __m128 directionX = _mm_set1_ps(InRay.Direction.x);
+    const __m128 directionY = _mm_set1_ps(InRay.Direction.y);
+    const __m128 directionZ = _mm_set1_ps(InRay.Direction.z);
+    const __m128 tMin = _mm_set1_ps(InT_Min);
+    const __m128 tMax = _mm_set1_ps(InT_Max);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    uint32_t hitMask = 0;
+    for (uint32_t half = 0; half < InPacket.TriangleCount; half += 4) {
+        __m128 edge1X = _mm_loadu_ps(InPacket.Edge1X + half);
+        __m128 edge1Y = _mm_loadu_ps(InPacket.Edge1Y + half);
+        __m128 edge1Z = _mm_loadu_ps(InPacket.Edge1Z + half);
+        __m128 edge2X = _mm_loadu_ps(InPacket.Edge2X + half);
+        __m128 edge2Y = _mm_loadu_ps(InPacket.Edge2Y + half);
+        __m128 edge2Z = _mm_loadu_ps(InPacket.Edge2Z + half);
+
+        // p = direction x edge2
+        __m128 pX = _mm_sub_ps(_mm_mul_ps(directionY, edge2Z), _mm_mul_ps(directionZ, edge2Y));
+        __m128 pY = _mm_sub_ps(_mm_mul_ps(directionZ, edge2X), _mm_mul_ps(directionX, edge2Z));
+        __m128 pZ = _mm_sub_ps(_mm_mul_ps(directionX, edge2Y), _mm_mul_ps(directionY, edge2X));
+        __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1X, pX), _mm_mul_ps(edge1Y, pY)), _mm_mul_ps(edge1Z, pZ));
+        __m128 inverseDeterminant = _mm_div_ps(one, determinant);
+
+        __m128 sX = _mm_sub_ps(originX, _mm_loadu_ps(InPacket.Vertex0X + half));
+        __m128 sY = _mm_sub_ps(originY, _mm_loadu_ps(InPacket.Vertex0Y + half));
+        __m128 sZ = _mm_sub_ps(originZ, _mm_loadu_ps(InPacket.Vertex0Z + half));
+        __m128 beta = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sX, pX), _mm_mul_ps(sY, pY)), _mm_mul_ps(sZ, pZ)), inverseDeterminant);
+
+        // q = s x edge1
+        __m128 qX = _mm_sub_ps(_mm_mul_ps(sY, edge1Z), _mm_mul_ps(sZ, edge1Y));
+        __m128 qY = _mm_sub_ps(_mm_mul_ps(sZ, edge1X), _mm_mul_ps(sX, edge1Z));
+        __m128 qZ = _mm_sub_ps(_mm_mul_ps(sX, edge1Y), _mm_mul_ps(sY, edge1X));
+        __m128 gamma = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, qX), _mm_mul_ps(directionY, qY)), _mm_mul_ps(directionZ, qZ)), inverseDeterminant);
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2X, qX), _mm_mul_ps(edge2Y, qY)), _mm_mul_ps(edge2Z, qZ)), inverseDeterminant);
+
+        __m128 valid = _mm_cmpneq_ps(determinant, zero);
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(beta, zero));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(gamma, zero));
+        valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(beta, gamma), one));
+        valid = _mm_and_ps(valid, _mm_cmpge_ps(t, tMin));
+        valid = _mm_and_ps(valid, _mm_cmplt_ps(t, tMax));
+
+        _mm_storeu_ps(OutTimes + half, t);
+        _mm_storeu_ps(OutBetas + half, beta);
+        _mm_storeu_ps(OutGammas + half, gamma);
+        hitMask |= (uint32_t)_mm_movemask_ps(valid) << half;
+    }
+    return hitMask;
+}
+
+static bool IsAVX2Supported()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int highestLeaf = info[0];
+    if (highestLeaf < 7) {
+        return false;
+    }
+
+    __cpuid(info, 1);
+    bool bHasFMA = (info[2] & (1 << 12)) != 0;
+    bool bHasOSXSave = (info[2] & (1 << 27)) != 0;
+    bool bHasAVX = (info[2] & (1 << 28)) != 0;
+    if (!bHasFMA || !bHasOSXSave || !bHasAVX) {
+        return false;
+    }
+
+    // The operating system has to save the upper halves of the YMM registers on context switches
+    if ((_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#endif
+
+ESIMDLevel DetectSIMDLevel()
+{
+#ifdef CHI_SIMD_X86
+    return IsAVX2Supported() ? ESIMDLevel::AVX2 : ESIMDLevel::SSE;
+#else
+    return ESIMDLevel::Scalar;
+#endif
+}
+
+const FSIMDKernels& GetSIMDKernels(ESIMDLevel InLevel)
+{
+    static const FSIMDKernels scalarKernels = { "Scalar", IntersectWideNodeScalar, IntersectTrianglePacketScalar };
+#ifdef CHI_SIMD_X86
+    static const FSIMDKernels sseKernels = { "SSE", IntersectWideNodeSSE, IntersectTrianglePacketSSE };
+    switch (InLevel) {
+    case ESIMDLevel::AVX2:
+        return GetAVX2Kernels();
+    case ESIMDLevel::SSE:
+        return sseKernels;
+    default:
+        return scalarKernels;
+    }
+#else
+    return scalarKernels;
+#endif
+}
+
+static const FSIMDKernels& SelectSIMDKernels()
+{
+    const FSIMDKernels& kernels = GetSIMDKernels(DetectSIMDLevel());
+    std::cout << "Using " << kernels.Name << " ray tracing kernels" << std::endl;
+    return kernels;
+}
+
+const FSIMDKernels& GetSIMDKernels()
+{
+    static const FSIMDKernels& kernels = SelectSIMDKernels();
+    return kernels;
+}
+
+}
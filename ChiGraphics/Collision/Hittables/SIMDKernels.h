@@ -0,0 +1,89 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CHI_SIMD_X86 1
+#endif
+
+namespace CHISTUDIO {
+
+// Number of children per WideBVH node and triangles per packet
+static const uint32_t kWideBVHWidth = 8;
+
+/** Node of a WideBVH. Child bounds are stored as one array per component so a kernel can test every child in one pass.
+ *  Each child is either another node, or a triangle packet when kWideBVHLeafFlag is set.
+ */
+struct FWideBVHNode
+{
+    float MinX[kWideBVHWidth];
+    float MinY[kWideBVHWidth];
+    float MinZ[kWideBVHWidth];
+    float MaxX[kWideBVHWidth];
+    float MaxY[kWideBVHWidth];
+    float MaxZ[kWideBVHWidth];
+    uint32_t Children[kWideBVHWidth];
+};
+
+static const uint32_t kWideBVHLeafFlag = 0x80000000u;
+static const uint32_t kWideBVHEmptyChild = 0xFFFFFFFFu;
+
+/** Up to kWideBVHWidth triangles of a contiguous range, in the same vertex/edge form as FTrianglePrimitive,
+ *  transposed so each component can be loaded straight into a SIMD register.
+ */
+struct FTrianglePacket
+{
+    float Vertex0X[kWideBVHWidth];
+    float Vertex0Y[kWideBVHWidth];
+    float Vertex0Z[kWideBVHWidth];
+    float Edge1X[kWideBVHWidth];
+    float Edge1Y[kWideBVHWidth];
+    float Edge1Z[kWideBVHWidth];
+    float Edge2X[kWideBVHWidth];
+    float Edge2Y[kWideBVHWidth];
+    float Edge2Z[kWideBVHWidth];
+    uint32_t FirstTriangle;
+    uint32_t TriangleCount;
+};
+
+/** Ray data shared by every kernel invocation of one traversal. */
+struct FWideRay
+{
+    glm::vec3 Origin;
+    glm::vec3 Direction;
+    glm::vec3 InverseDirection;
+};
+
+// Tests the ray against every child of InNode. Returns a bitmask of the children entered within [InT_Min, InT_Max]
+// and writes their entry distances. Bits of empty children are unspecified.
+typedef uint32_t (*FIntersectWideNodeKernel)(const FWideBVHNode& InNode, const FWideRay& InRay, float InT_Min, float InT_Max, float* OutEntryTimes);
+
+// Tests the ray against every lane of InPacket. Returns a bitmask of the lanes hit within [InT_Min, InT_Max)
+// and writes their distances and barycentric coordinates. Bits of unused lanes are unspecified.
+typedef uint32_t (*FIntersectTrianglePacketKernel)(const FTrianglePacket& InPacket, const FWideRay& InRay, float InT_Min, float InT_Max, float* OutTimes, float* OutBetas, float* OutGammas);
+
+enum class ESIMDLevel { Scalar, SSE, AVX2 };
+
+/** Set of intersection kernels for one instruction set. */
+struct FSIMDKernels
+{
+    const char* Name;
+    FIntersectWideNodeKernel IntersectNode;
+    FIntersectTrianglePacketKernel IntersectPacket;
+};
+
+// Highest instruction set supported by both the CPU and the operating system
+ESIMDLevel DetectSIMDLevel();
+
+// Kernels for the given level. Levels that are unavailable in this build fall back to the next lower one.
+const FSIMDKernels& GetSIMDKernels(ESIMDLevel InLevel);
+
+// Kernels for the detected level, chosen once on first use
+const FSIMDKernels& GetSIMDKernels();
+
+#ifdef CHI_SIMD_X86
+// Defined in SIMDKernelsAVX2.cpp, which is the only file compiled with AVX2 enabled
+const FSIMDKernels& GetAVX2Kernels();
+#endif
+
+}
@@ -0,0 +1,92 @@
+#include "SIMDKernels.h"
+
+#ifdef CHI_SIMD_X86
+#include <immintrin.h>
+
+// This file is compiled with AVX2 and FMA enabled (see CMakeLists.txt). Nothing here may run before
+// DetectSIMDLevel has confirmed support, so keep every other function out of this translation unit.
+
+namespace CHISTUDIO {
+
+static uint32_t IntersectWideNodeAVX2(const FWideBVHNode& InNode, const FWideRay& InRay, float InT_Min, float InT_Max, float* OutEntryTimes)
+{
+    // Slab distances as (bound - origin) * inverseDirection = bound * inverseDirection - origin * inverseDirection
+    const __m256 inverseDirectionX = _mm256_set1_ps(InRay.InverseDirection.x);
+    const __m256 inverseDirectionY = _mm256_set1_ps(InRay.InverseDirection.y);
+    const __m256 inverseDirectionZ = _mm256_set1_ps(InRay.InverseDirection.z);
+    const __m256 scaledOriginX = _mm256_set1_ps(InRay.Origin.x * InRay.InverseDirection.x);
+    const __m256 scaledOriginY = _mm256_set1_ps(InRay.Origin.y * InRay.InverseDirection.y);
+    const __m256 scaledOriginZ = _mm256_set1_ps(InRay.Origin.z * InRay.InverseDirection.z);
+
+    __m256 t0X = _mm256_fmsub_ps(_mm256_loadu_ps(InNode.MinX), inverseDirectionX, scaledOriginX);
+    __m256 t1X = _mm256_fmsub_ps(_mm256_loadu_ps(InNode.MaxX), inverseDirectionX, scaledOriginX);
+    __m256 t0Y = _mm256_fmsub_ps(_mm256_loadu_ps(InNode.MinY), inverseDirectionY, scaledOriginY);
+    __m256 t1Y = _mm256_fmsub_ps(_mm256_loadu_ps(InNode.MaxY), inverseDirectionY, scaledOriginY);
+    __m256 t0Z = _mm256_fmsub_ps(_mm256_loadu_ps(InNode.MinZ), inverseDirectionZ, scaledOriginZ);
+    __m256 t1Z = _mm256_fmsub_ps(_mm256_loadu_ps(InNode.MaxZ), inverseDirectionZ, scaledOriginZ);
+
+    __m256 entry = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(t0X, t1X), _mm256_min_ps(t0Y, t1Y)),
+                                 _mm256_max_ps(_mm256_min_ps(t0Z, t1Z), _mm256_set1_ps(InT_Min)));
+    __m256 exit = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(t0X, t1X), _mm256_max_ps(t0Y, t1Y)),
+                                _mm256_min_ps(_mm256_max_ps(t0Z, t1Z), _mm256_set1_ps(InT_Max)));
+
+    _mm256_storeu_ps(OutEntryTimes, entry);
+    return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ));
+}
+
+static uint32_t IntersectTrianglePacketAVX2(const FTrianglePacket& InPacket, const FWideRay& InRay, float InT_Min, float InT_Max, float* OutTimes, float* OutBetas, float* OutGammas)
+{
+    const __m256 directionX = _mm256_set1_ps(InRay.Direction.x);
+    const __m256 directionY = _mm256_set1_ps(InRay.Direction.y);
+    const __m256 directionZ = _mm256_set1_ps(InRay.Direction.z);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    __m256 edge1X = _mm256_loadu_ps(InPacket.Edge1X);
+    __m256 edge1Y = _mm256_loadu_ps(InPacket.Edge1Y);
+    __m256 edge1Z = _mm256_loadu_ps(InPacket.Edge1Z);
+    __m256 edge2X = _mm256_loadu_ps(InPacket.Edge2X);
+    __m256 edge2Y = _mm256_loadu_ps(InPacket.Edge2Y);
+    __m256 edge2Z = _mm256_loadu_ps(InPacket.Edge2Z);
+
+    // p = direction x edge2
+    __m256 pX = _mm256_fmsub_ps(directionY, edge2Z, _mm256_mul_ps(directionZ, edge2Y));
+    __m256 pY = _mm256_fmsub_ps(directionZ, edge2X, _mm256_mul_ps(directionX, edge2Z));
+    __m256 pZ = _mm256_fmsub_ps(directionX, edge2Y, _mm256_mul_ps(directionY, edge2X));
+    __m256 determinant = _mm256_fmadd_ps(edge1X, pX, _mm256_fmadd_ps(edge1Y, pY, _mm256_mul_ps(edge1Z, pZ)));
+    __m256 inverseDeterminant = _mm256_div_ps(one, determinant);
+
+    __m256 sX = _mm256_sub_ps(_mm256_set1_ps(InRay.Origin.x), _mm256_loadu_ps(InPacket.Vertex0X));
+    __m256 sY = _mm256_sub_ps(_mm256_set1_ps(InRay.Origin.y), _mm256_loadu_ps(InPacket.Vertex0Y));
+    __m256 sZ = _mm256_sub_ps(_mm256_set1_ps(InRay.Origin.z), _mm256_loadu_ps(InPacket.Vertex0Z));
+    __m256 beta = _mm256_mul_ps(_mm256_fmadd_ps(sX, pX, _mm256_fmadd_ps(sY, pY, _mm256_mul_ps(sZ, pZ))), inverseDeterminant);
+
+    // q = s x edge1
+    __m256 qX = _mm256_fmsub_ps(sY, edge1Z, _mm256_mul_ps(sZ, edge1Y));
+    __m256 qY = _mm256_fmsub_ps(sZ, edge1X, _mm256_mul_ps(sX, edge1Z));
+    __m256 qZ = _mm256_fmsub_ps(sX, edge1Y, _mm256_mul_ps(sY, edge1X));
+    __m256 gamma = _mm256_mul_ps(_mm256_fmadd_ps(directionX, qX, _mm256_fmadd_ps(directionY, qY, _mm256_mul_ps(directionZ, qZ))), inverseDeterminant);
+    __m256 t = _mm256_mul_ps(_mm256_fmadd_ps(edge2X, qX, _mm256_fmadd_ps(edge2Y, qY, _mm256_mul_ps(edge2Z, qZ))), inverseDeterminant);
+
+    __m256 valid = _mm256_cmp_ps(determinant, zero, _CMP_NEQ_OQ);
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(beta, zero, _CMP_GE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(gamma, zero, _CMP_GE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(beta, gamma), one, _CMP_LE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(InT_Min), _CMP_GE_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(InT_Max), _CMP_LT_OQ));
+
+    _mm256_storeu_ps(OutTimes, t);
+    _mm256_storeu_ps(OutBetas, beta);
+    _mm256_storeu_ps(OutGammas, gamma);
+    return (uint32_t)_mm256_movemask_ps(valid);
+}
+
+const FSIMDKernels& GetAVX2Kernels()
+{
+    static const FSIMDKernels avx2Kernels = { "AVX2", IntersectWideNodeAVX2, IntersectTrianglePacketAVX2 };
+    return avx2Kernels;
+}
+
+}
+
+#endif
@@ -1,11 +1,11 @@
 #include "ChiGraphics\Collision\Hittables\SphereHittable.h"
 #include <cmath>
 #include <glm/gtx/norm.hpp>
-#include "ChiGraphics/Materials/Material.h"
+#include "ChiGraphics/Utilities.h"
 
 namespace CHISTUDIO {
 
-bool SphereHittable::Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, Material InMaterial) const
+bool SphereHittable::Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, const FImage* InAlphaMap) const
 {
 	// RAY-SPHERE INTERSECTION (https://viclw17.github.io/2018/07/16/raytracing-ray-sphere-intersection/)
 
@@ -46,6 +46,7 @@ bool SphereHittable::Intersect(const FRay& InRay, float InT_Min, FHitRecord& InR
         InRecord.Time = t;
         InRecord.Position = InRay.At(t);
         InRecord.Normal = glm::normalize(InRecord.Position - Origin);
+        InRecord.UVScale = 0.0f;
         return true;
     }
 
@@ -54,18 +55,69 @@ bool SphereHittable::Intersect(const FRay& InRay, float InT_Min, FHitRecord& InR
 
 float SphereHittable::Sample(const glm::vec3& InTargetPoint, glm::vec3& OutPoint, glm::vec3& OutNormal, RNG& InRNG) const
 {
-    glm::vec2 randomPoint = RandomInUnitDisk(InRNG);
-    float z = glm::sqrt(1.0f - randomPoint.x * randomPoint.x - randomPoint.y * randomPoint.y);
-    glm::vec3 normalizedDirection = glm::normalize(InTargetPoint);
-
-    glm::vec3 n1 = std::isnan(normalizedDirection.x) ? glm::normalize(glm::vec3(0.0f, -normalizedDirection.z, normalizedDirection.y)) 
-                                                        : glm::normalize(glm::vec3(normalizedDirection.y, -normalizedDirection.x, 0.0f));
-    glm::vec3 n2 = glm::cross(n1, normalizedDirection);
-    glm::vec3 point = randomPoint.x * n1 + randomPoint.y * n2 + z * normalizedDirection;
-
-    OutPoint = point;
-    OutNormal = glm::normalize(point);
-    return z / kPi;
+    float u = InRNG.Float();
+    float v = InRNG.Float();
+
+    float worldRadius = GetUniformWorldRadius();
+    if (worldRadius > 0.0f)
+    {
+        glm::vec3 center = glm::vec3(ModelMatrix * glm::vec4(Origin, 1.0f));
+        return SampleSphereSolidAngle(center, worldRadius, InTargetPoint, u, v, OutPoint, OutNormal);
+    }
+
+    // Uniform over the local sphere, with the density changed by how the model matrix stretches area
+    float z = 1.0f - 2.0f * u;
+    float r = glm::sqrt(glm::max(1.0f - z * z, 0.0f));
+    float phi = kPi * 2 * v;
+    glm::vec3 localNormal(r * glm::cos(phi), r * glm::sin(phi), z);
+
+    OutPoint = glm::vec3(ModelMatrix * glm::vec4(Origin + Radius * localNormal, 1.0f));
+    OutNormal = glm::normalize(glm::vec3(TransposeInverseModelMatrix * glm::vec4(localNormal, 0.0f)));
+    return AreaToSolidAnglePDF(1.0f / (4.0f * kPi * Radius * Radius * GetAreaScale(localNormal)), InTargetPoint, OutPoint, OutNormal);
+}
+
+float SphereHittable::GetSamplePDF(const glm::vec3& InTargetPoint, const glm::vec3& InPoint, const glm::vec3& InNormal) const
+{
+    float worldRadius = GetUniformWorldRadius();
+    if (worldRadius > 0.0f)
+    {
+        glm::vec3 center = glm::vec3(ModelMatrix * glm::vec4(Origin, 1.0f));
+        float distanceSquared = glm::length2(center - InTargetPoint);
+        float radiusSquared = worldRadius * worldRadius;
+        if (distanceSquared > radiusSquared)
+        {
+            // Uniform over the subtended cone, matching SampleSphereSolidAngle including its small angle expansion
+            float sin2ThetaMax = radiusSquared / distanceSquared;
+            float oneMinusCosThetaMax = sin2ThetaMax < 0.00068523f ? sin2ThetaMax * 0.5f : 1.0f - glm::sqrt(1.0f - sin2ThetaMax);
+            return 1.0f / (2.0f * kPi * oneMinusCosThetaMax);
+        }
+        return AreaToSolidAnglePDF(1.0f / (4.0f * kPi * radiusSquared), InTargetPoint, InPoint, InNormal);
+    }
+
+    glm::vec3 localNormal = glm::normalize(glm::vec3(InverseModelMatrix * glm::vec4(InPoint, 1.0f)) - Origin);
+    return AreaToSolidAnglePDF(1.0f / (4.0f * kPi * Radius * Radius * GetAreaScale(localNormal)), InTargetPoint, InPoint, InNormal);
+}
+
+float SphereHittable::GetUniformWorldRadius() const
+{
+    glm::vec3 scale(glm::length(glm::vec3(ModelMatrix[0])), glm::length(glm::vec3(ModelMatrix[1])), glm::length(glm::vec3(ModelMatrix[2])));
+    if (glm::abs(scale.x - scale.y) <= 1e-4f * scale.x && glm::abs(scale.x - scale.z) <= 1e-4f * scale.x)
+    {
+        return Radius * scale.x;
+    }
+    return 0.0f;
+}
+
+float SphereHittable::GetAreaScale(const glm::vec3& InLocalNormal) const
+{
+    // A linear map M scales area with normal n by |det M| |M^-T n|
+    glm::vec3 scaledNormal = glm::vec3(TransposeInverseModelMatrix * glm::vec4(InLocalNormal, 0.0f));
+    return glm::abs(glm::determinant(glm::mat3(ModelMatrix))) * glm::length(scaledNormal);
+}
+
+AABB SphereHittable::GetBoundingBox() const
+{
+    return AABB(Origin - glm::vec3(Radius), Origin + glm::vec3(Radius));
 }
 
 }
\ No newline at end of file
@@ -9,14 +9,23 @@ class SphereHittable : public IHittableBase
 public:
 	SphereHittable(float InRadius, glm::vec3 InOrigin) : Radius(InRadius), Origin(InOrigin) {}
 
-	bool Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, class Material InMaterial) const override;
+	bool Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, const class FImage* InAlphaMap) const override;
 
 	/**
-	* Samples for a point on the closest hemisphere to the target point, weighted by the cosine.
-	* Doesn't fully implement solid angle sampling.
+	* Samples the cone of directions the sphere subtends from the target point. Non-uniformly scaled spheres are
+	* ellipsoids in world space, so they fall back to sampling their surface by area.
 	*/
 	float Sample(const glm::vec3& InTargetPoint, glm::vec3& OutPoint, glm::vec3& OutNormal, RNG& InRNG) const override;
+	float GetSamplePDF(const glm::vec3& InTargetPoint, const glm::vec3& InPoint, const glm::vec3& InNormal) const override;
+
+	AABB GetBoundingBox() const override;
 private:
+	// World space radius if the model matrix scales uniformly, otherwise 0
+	float GetUniformWorldRadius() const;
+
+	// Area of the world space surface per unit area of the local sphere, at a point with the given local normal
+	float GetAreaScale(const glm::vec3& InLocalNormal) const;
+
 	float Radius;
 	glm::vec3 Origin;
 };
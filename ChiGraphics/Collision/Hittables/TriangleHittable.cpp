@@ -1,83 +1,101 @@
 #include "TriangleHittable.h"
-#include "ChiGraphics/Materials/Material.h"
+#include "ChiGraphics/Textures/FImage.h"
+#include "ChiGraphics/Utilities.h"
 
 namespace CHISTUDIO
 {
 
 TriangleHittable::TriangleHittable(const glm::vec3& InPos0, const glm::vec3& InPos1, const glm::vec3& InPos2, const glm::vec3& InNorm0, const glm::vec3& InNorm1, const glm::vec3& InNorm2, const glm::vec2& InUV1, const glm::vec2& InUV2, const glm::vec2& InUV3)
+    : Primitive(InPos0, InPos1, InPos2)
 {
-    Positions.push_back(InPos0);
-    Positions.push_back(InPos1);
-    Positions.push_back(InPos2);
-    Normals.push_back(InNorm0);
-    Normals.push_back(InNorm1);
-    Normals.push_back(InNorm2);
-    UVs.push_back(InUV1);
-    UVs.push_back(InUV2);
-    UVs.push_back(InUV3);
+    Attributes.Normals[0] = InNorm0;
+    Attributes.Normals[1] = InNorm1;
+    Attributes.Normals[2] = InNorm2;
+    Attributes.UVs[0] = InUV1;
+    Attributes.UVs[1] = InUV2;
+    Attributes.UVs[2] = InUV3;
 }
 
 TriangleHittable::TriangleHittable(const std::vector<glm::vec3>& InPositions, const std::vector<glm::vec3>& InNormals, const std::vector<glm::vec2>& InUVs)
+    : TriangleHittable(InPositions[0], InPositions[1], InPositions[2], InNormals[0], InNormals[1], InNormals[2], InUVs[0], InUVs[1], InUVs[2])
 {
-    Positions = InPositions;
-    Normals = InNormals;
-    UVs = InUVs;
 }
 
-bool TriangleHittable::Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, Material InMaterial) const
+bool TriangleHittable::Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, const FImage* InAlphaMap) const
 {
-    glm::vec3 a = Positions[0];
-    glm::vec3 b = Positions[1];
-    glm::vec3 c = Positions[2];
-    glm::vec3 rayDirection = InRay.GetDirection();
-    glm::vec3 rayOrigin = InRay.GetOrigin();
-    glm::mat3 M = glm::mat3(a.x - b.x, a.y - b.y, a.z - b.z,
-        a.x - c.x, a.y - c.y, a.z - c.z,
-        rayDirection.x, rayDirection.y, rayDirection.z);
-    glm::vec3 B = glm::vec3(a.x - rayOrigin.x, a.y - rayOrigin.y, a.z - rayOrigin.z);
-
-    glm::vec3 x = glm::inverse(M) * B;
-    float beta = x[0];
-    float gamma = x[1];
-    float t = x[2];
-    float alpha = 1 - beta - gamma;
-
-    if (t >= InT_Min && t < InRecord.Time) {
-        // Check barycentric correctness
-        if (gamma >= 0 && beta >= 0 && (beta + gamma) <= 1) {
-            glm::vec2 uv = alpha * UVs[0] + beta * UVs[1] + gamma * UVs[2];
-            // Check alpha mask before considering
-            float mask = InMaterial.SampleAlpha(uv);
-            if (mask > 0.001f)
-            {
-                InRecord.Time = t;
-                glm::vec3 interp_normal = alpha * Normals[0] + beta * Normals[1] + gamma * Normals[2];
-                InRecord.Normal = glm::normalize(interp_normal);
-                InRecord.UV = uv;
-                return true;
-            }
-        }
+    float t, beta, gamma;
+    if (!Primitive.Intersect(InRay.GetOrigin(), InRay.GetDirection(), InT_Min, InRecord.Time, t, beta, gamma)) {
+        return false;
+    }
+
+    glm::vec2 uv = Attributes.GetUV(beta, gamma);
+    // Check alpha mask before considering
+    if (InAlphaMap == nullptr || InAlphaMap->SampleWithUV(uv).x > 0.001f)
+    {
+        InRecord.Time = t;
+        InRecord.Normal = Attributes.GetNormal(beta, gamma);
+        InRecord.UV = uv;
+        InRecord.UVScale = Attributes.GetUVScale(Primitive);
+        return true;
     }
 
     return false;
 }
 
 float TriangleHittable::Sample(const glm::vec3& InTargetPoint, glm::vec3& OutPoint, glm::vec3& OutNormal, RNG& InRNG) const
+{
+    glm::vec3 geometricNormal = SampleWorldSurface(*this, Primitive, Attributes, OutPoint, OutNormal, InRNG);
+    float area = GetWorldArea(Primitive, ModelMatrix);
+    return area > 0.0f ? AreaToSolidAnglePDF(1.0f / area, InTargetPoint, OutPoint, geometricNormal) : 0.0f;
+}
+
+float TriangleHittable::SampleSurface(const FTrianglePrimitive& InPrimitive, const FTriangleAttributes& InAttributes, glm::vec3& OutPoint, glm::vec3& OutNormal, RNG& InRNG)
 {
     float u = InRNG.Float();
     float v = InRNG.Float();
 
-    while (u + v > 1.0f) {
-        u = InRNG.Float();
-        v = InRNG.Float();
+    // Fold the upper half of the unit square onto the triangle, so exactly two sample dimensions are used
+    if (u + v > 1.0f) {
+        u = 1.0f - u;
+        v = 1.0f - v;
     }
 
     float w = 1.0f - u - v;
 
-    float area = 0.5f * glm::length(glm::cross((Positions[1] - Positions[0]), (Positions[2] - Positions[1])));
-    OutPoint = u * Positions[0] + v * Positions[1] + w * Positions[2];
-    OutNormal = glm::normalize(u * Normals[0] + v * Normals[1] + w * Normals[2]);
-    return 1.0f / area;
+    // u weights the first vertex, so v and w are the barycentric coordinates of the second and third
+    OutPoint = InPrimitive.GetPoint(v, w);
+    OutNormal = InAttributes.GetNormal(v, w);
+    return 1.0f / InPrimitive.GetArea();
+}
+
+float TriangleHittable::GetSamplePDF(const glm::vec3& InTargetPoint, const glm::vec3& InPoint, const glm::vec3& InNormal) const
+{
+    float area = GetWorldArea(Primitive, ModelMatrix);
+    return area > 0.0f ? AreaToSolidAnglePDF(1.0f / area, InTargetPoint, InPoint, InNormal) : 0.0f;
+}
+
+glm::vec3 TriangleHittable::SampleWorldSurface(const IHittableBase& InHittable, const FTrianglePrimitive& InPrimitive, const FTriangleAttributes& InAttributes, glm::vec3& OutPoint, glm::vec3& OutNormal, RNG& InRNG)
+{
+    // Affine maps keep a uniform distribution over a triangle uniform, so only the density changes
+    glm::vec3 localPoint;
+    glm::vec3 localNormal;
+    SampleSurface(InPrimitive, InAttributes, localPoint, localNormal, InRNG);
+    OutPoint = glm::vec3(InHittable.ModelMatrix * glm::vec4(localPoint, 1.0f));
+    OutNormal = glm::normalize(glm::vec3(InHittable.TransposeInverseModelMatrix * glm::vec4(localNormal, 0.0f)));
+
+    glm::mat3 linearMatrix = glm::mat3(InHittable.ModelMatrix);
+    return glm::normalize(glm::cross(linearMatrix * InPrimitive.Edge1, linearMatrix * InPrimitive.Edge2));
+}
+
+float TriangleHittable::GetWorldArea(const FTrianglePrimitive& InPrimitive, const glm::mat4& InModelMatrix)
+{
+    glm::mat3 linearMatrix = glm::mat3(InModelMatrix);
+    return 0.5f * glm::length(glm::cross(linearMatrix * InPrimitive.Edge1, linearMatrix * InPrimitive.Edge2));
+}
+
+AABB TriangleHittable::GetBoundingBox() const
+{
+    return Primitive.GetBoundingBox();
 }
 
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "HittableBase.h"
+#include "TrianglePrimitive.h"
 #include <vector>
 
 namespace CHISTUDIO {
@@ -12,23 +13,41 @@ public:
         const glm::vec3& InNorm0, const glm::vec3& InNorm1, const glm::vec3& InNorm2, const glm::vec2& InUV1, const glm::vec2& InUV2, const glm::vec2& InUV3 );
     TriangleHittable(const std::vector<glm::vec3>& InPositions, const std::vector<glm::vec3>& InNormals, const std::vector<glm::vec2>& InUVs);
 
-	bool Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, class Material InMaterial) const override;
+	bool Intersect(const FRay& InRay, float InT_Min, FHitRecord& InRecord, const class FImage* InAlphaMap) const override;
     float Sample(const glm::vec3& InTargetPoint, glm::vec3& OutPoint, glm::vec3& OutNormal, RNG& InRNG) const override;
+    float GetSamplePDF(const glm::vec3& InTargetPoint, const glm::vec3& InPoint, const glm::vec3& InNormal) const override;
+    AABB GetBoundingBox() const override;
+
+    // Uniformly samples a point on the given triangle. Returns the area probability density.
+    static float SampleSurface(const FTrianglePrimitive& InPrimitive, const FTriangleAttributes& InAttributes, glm::vec3& OutPoint, glm::vec3& OutNormal, RNG& InRNG);
+
+    // Uniformly samples a point on a triangle of InHittable, moved to world space by its matrices. Outputs the world
+    // position and shading normal, and returns the world geometric normal.
+    static glm::vec3 SampleWorldSurface(const IHittableBase& InHittable, const FTrianglePrimitive& InPrimitive, const FTriangleAttributes& InAttributes, glm::vec3& OutPoint, glm::vec3& OutNormal, RNG& InRNG);
+
+    // Area of InPrimitive after the linear part of InModelMatrix
+    static float GetWorldArea(const FTrianglePrimitive& InPrimitive, const glm::mat4& InModelMatrix);
 
     glm::vec3 GetPosition(size_t i) const {
-        return Positions[i];
+        return Primitive.GetPosition(i);
     }
     glm::vec3 GetNormal(size_t i) const {
-        return Normals[i];
+        return Attributes.Normals[i];
     }
     glm::vec2 GetUV(size_t i) const {
-        return UVs[i];
+        return Attributes.UVs[i];
+    }
+
+    const FTrianglePrimitive& GetPrimitive() const {
+        return Primitive;
+    }
+    const FTriangleAttributes& GetAttributes() const {
+        return Attributes;
     }
 
 private:
-	std::vector<glm::vec3> Positions;
-	std::vector<glm::vec3> Normals;
-	std::vector<glm::vec2> UVs;
+	FTrianglePrimitive Primitive;
+	FTriangleAttributes Attributes;
 };
 
 }
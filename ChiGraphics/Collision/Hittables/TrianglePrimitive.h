@@ -0,0 +1,99 @@
+#pragma once
+#include <glm/glm.hpp>
+#include "AABB.h"
+
+namespace CHISTUDIO {
+
+/** Compact, fixed-size triangle record used for ray intersection. Stores the first vertex and the two edges leaving it,
+ *  so the Moller-Trumbore test needs no matrix setup. Barycentric weights beta and gamma belong to vertices 1 and 2.
+ */
+struct FTrianglePrimitive
+{
+    FTrianglePrimitive() {}
+    FTrianglePrimitive(const glm::vec3& InPos0, const glm::vec3& InPos1, const glm::vec3& InPos2)
+        : Vertex0(InPos0), Edge1(InPos1 - InPos0), Edge2(InPos2 - InPos0) {
+    }
+
+    /** Returns if the ray hits the triangle with a distance in [InT_Min, InT_Max), writing the distance and
+     *  barycentric coordinates of the hit.
+     */
+    bool Intersect(const glm::vec3& InOrigin, const glm::vec3& InDirection, float InT_Min, float InT_Max, float& OutT, float& OutBeta, float& OutGamma) const
+    {
+        glm::vec3 p = glm::cross(InDirection, Edge2);
+        float determinant = glm::dot(Edge1, p);
+        if (determinant == 0.0f) {
+            return false;
+        }
+        float inverseDeterminant = 1.0f / determinant;
+
+        glm::vec3 s = InOrigin - Vertex0;
+        float beta = glm::dot(s, p) * inverseDeterminant;
+        if (beta < 0.0f || beta > 1.0f) {
+            return false;
+        }
+
+        glm::vec3 q = glm::cross(s, Edge1);
+        float gamma = glm::dot(InDirection, q) * inverseDeterminant;
+        if (gamma < 0.0f || beta + gamma > 1.0f) {
+            return false;
+        }
+
+        float t = glm::dot(Edge2, q) * inverseDeterminant;
+        if (t < InT_Min || t >= InT_Max) {
+            return false;
+        }
+
+        OutT = t;
+        OutBeta = beta;
+        OutGamma = gamma;
+        return true;
+    }
+
+    glm::vec3 GetPosition(size_t i) const {
+        return i == 0 ? Vertex0 : (i == 1 ? Vertex0 + Edge1 : Vertex0 + Edge2);
+    }
+
+    glm::vec3 GetPoint(float InBeta, float InGamma) const {
+        return Vertex0 + InBeta * Edge1 + InGamma * Edge2;
+    }
+
+    float GetArea() const {
+        return 0.5f * glm::length(glm::cross(Edge1, Edge2));
+    }
+
+    AABB GetBoundingBox() const {
+        glm::vec3 vertex1 = Vertex0 + Edge1;
+        glm::vec3 vertex2 = Vertex0 + Edge2;
+        return AABB(glm::min(Vertex0, glm::min(vertex1, vertex2)), glm::max(Vertex0, glm::max(vertex1, vertex2)));
+    }
+
+    glm::vec3 Vertex0;
+    glm::vec3 Edge1;
+    glm::vec3 Edge2;
+};
+
+/** Per-vertex shading attributes of a triangle. Kept apart from FTrianglePrimitive so traversal only touches positions. */
+struct FTriangleAttributes
+{
+    glm::vec3 GetNormal(float InBeta, float InGamma) const {
+        return glm::normalize((1.0f - InBeta - InGamma) * Normals[0] + InBeta * Normals[1] + InGamma * Normals[2]);
+    }
+
+    glm::vec2 GetUV(float InBeta, float InGamma) const {
+        return (1.0f - InBeta - InGamma) * UVs[0] + InBeta * UVs[1] + InGamma * UVs[2];
+    }
+
+    // Square root of the ratio of the triangle's area in UV space to its area in InTriangle's space
+    float GetUVScale(const FTrianglePrimitive& InTriangle) const {
+        glm::vec2 edge1 = UVs[1] - UVs[0];
+        glm::vec2 edge2 = UVs[2] - UVs[0];
+        float uvArea = 0.5f * glm::abs(edge1.x * edge2.y - edge1.y * edge2.x);
+        float area = InTriangle.GetArea();
+        return area > 0.0f ? glm::sqrt(uvArea / area) : 0.0f;
+    }
+
+    glm::vec3 Normals[3];
+    glm::vec2 UVs[3];
+};
+
+}
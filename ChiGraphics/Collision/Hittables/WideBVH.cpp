@@ -0,0 +1,142 @@
+#include "WideBVH.h"
+
+namespace CHISTUDIO {
+
+void WideBVH::Build(const BVH& InBinaryBVH, const std::vector<FTrianglePrimitive>& InTriangles)
+{
+    Clear();
+    if (InBinaryBVH.IsEmpty()) {
+        return;
+    }
+    Kernels = &GetSIMDKernels();
+
+    // Nodes are stored depth-first with children after their parent, so a reverse pass visits children first
+    FBuildContext context = { InBinaryBVH.GetNodes(), InTriangles, {}, {} };
+    size_t binaryNodeCount = context.BinaryNodes.size();
+    context.SubtreeFirstTriangle.resize(binaryNodeCount);
+    context.SubtreeTriangleCount.resize(binaryNodeCount);
+    for (size_t i = binaryNodeCount; i-- > 0;) {
+        const FBVHNode& node = context.BinaryNodes[i];
+        if (node.IsLeaf()) {
+            context.SubtreeFirstTriangle[i] = node.RightChildOrFirstPrimitive;
+            context.SubtreeTriangleCount[i] = node.PrimitiveCount;
+        }
+        else {
+            context.SubtreeFirstTriangle[i] = context.SubtreeFirstTriangle[i + 1];
+            context.SubtreeTriangleCount[i] = context.SubtreeTriangleCount[i + 1] + context.SubtreeTriangleCount[node.RightChildOrFirstPrimitive];
+        }
+    }
+
+    RootChild = BuildChild(context, 0);
+    Nodes.shrink_to_fit();
+    Packets.shrink_to_fit();
+}
+
+uint32_t WideBVH::BuildChild(const FBuildContext& InContext, uint32_t InBinaryIndex)
+{
+    const FBVHNode& binaryNode = InContext.BinaryNodes[InBinaryIndex];
+    uint32_t triangleCount = InContext.SubtreeTriangleCount[InBinaryIndex];
+
+    // Subtrees of the binary BVH cover a contiguous triangle range, so small ones collapse into one packet
+    if (triangleCount <= kWideBVHWidth || binaryNode.IsLeaf()) {
+        AABB bounds;
+        return BuildLeafRange(InContext.SubtreeFirstTriangle[InBinaryIndex], triangleCount, InContext.Triangles, bounds);
+    }
+
+    // Pull grandchildren up into this node by repeatedly opening the largest child that cannot become a single packet
+    uint32_t children[kWideBVHWidth] = { InBinaryIndex + 1, binaryNode.RightChildOrFirstPrimitive };
+    uint32_t childCount = 2;
+    while (childCount < kWideBVHWidth) {
+        int largestChild = -1;
+        float largestArea = -1.0f;
+        for (uint32_t i = 0; i < childCount; i++) {
+            const FBVHNode& child = InContext.BinaryNodes[children[i]];
+            if (child.IsLeaf() || InContext.SubtreeTriangleCount[children[i]] <= kWideBVHWidth) {
+                continue;
+            }
+            float area = child.GetBounds().GetSurfaceArea();
+            if (area > largestArea) {
+                largestArea = area;
+                largestChild = i;
+            }
+        }
+        if (largestChild < 0) {
+            break;
+        }
+
+        uint32_t openedIndex = children[largestChild];
+        children[largestChild] = openedIndex + 1;
+        children[childCount++] = InContext.BinaryNodes[openedIndex].RightChildOrFirstPrimitive;
+    }
+
+    uint32_t nodeIndex = (uint32_t)Nodes.size();
+    Nodes.emplace_back();
+    for (uint32_t slot = 0; slot < kWideBVHWidth; slot++) {
+        SetChild(nodeIndex, slot, kWideBVHEmptyChild, AABB());
+    }
+    for (uint32_t slot = 0; slot < childCount; slot++) {
+        uint32_t child = BuildChild(InContext, children[slot]);
+        SetChild(nodeIndex, slot, child, InContext.BinaryNodes[children[slot]].GetBounds());
+    }
+    return nodeIndex;
+}
+
+uint32_t WideBVH::BuildLeafRange(uint32_t InFirstTriangle, uint32_t InCount, const std::vector<FTrianglePrimitive>& InTriangles, AABB& OutBounds)
+{
+    OutBounds = AABB();
+    for (uint32_t i = 0; i < InCount; i++) {
+        OutBounds.UnionWith(InTriangles[InFirstTriangle + i].GetBoundingBox());
+    }
+
+    if (InCount <= kWideBVHWidth) {
+        // Unused lanes stay zeroed, which gives degenerate triangles that never report a hit
+        FTrianglePacket packet = {};
+        packet.FirstTriangle = InFirstTriangle;
+        packet.TriangleCount = InCount;
+        for (uint32_t lane = 0; lane < InCount; lane++) {
+            const FTrianglePrimitive& triangle = InTriangles[InFirstTriangle + lane];
+            packet.Vertex0X[lane] = triangle.Vertex0.x;
+            packet.Vertex0Y[lane] = triangle.Vertex0.y;
+            packet.Vertex0Z[lane] = triangle.Vertex0.z;
+            packet.Edge1X[lane] = triangle.Edge1.x;
+            packet.Edge1Y[lane] = triangle.Edge1.y;
+            packet.Edge1Z[lane] = triangle.Edge1.z;
+            packet.Edge2X[lane] = triangle.Edge2.x;
+            packet.Edge2Y[lane] = triangle.Edge2.y;
+            packet.Edge2Z[lane] = triangle.Edge2.z;
+        }
+        Packets.push_back(packet);
+        return ((uint32_t)Packets.size() - 1) | kWideBVHLeafFlag;
+    }
+
+    // Oversized leaves (triangles with identical centroids) are split evenly into a node of smaller ranges
+    uint32_t nodeIndex = (uint32_t)Nodes.size();
+    Nodes.emplace_back();
+    uint32_t rangeSize = (InCount + kWideBVHWidth - 1) / kWideBVHWidth;
+    for (uint32_t slot = 0; slot < kWideBVHWidth; slot++) {
+        uint32_t rangeBegin = std::min(slot * rangeSize, InCount);
+        uint32_t rangeEnd = std::min(rangeBegin + rangeSize, InCount);
+        if (rangeBegin == rangeEnd) {
+            SetChild(nodeIndex, slot, kWideBVHEmptyChild, AABB());
+            continue;
+        }
+        AABB rangeBounds;
+        uint32_t child = BuildLeafRange(InFirstTriangle + rangeBegin, rangeEnd - rangeBegin, InTriangles, rangeBounds);
+        SetChild(nodeIndex, slot, child, rangeBounds);
+    }
+    return nodeIndex;
+}
+
+void WideBVH::SetChild(uint32_t InNodeIndex, uint32_t InSlot, uint32_t InChild, const AABB& InBounds)
+{
+    FWideBVHNode& node = Nodes[InNodeIndex];
+    node.Children[InSlot] = InChild;
+    node.MinX[InSlot] = InBounds.Minimum.x;
+    node.MinY[InSlot] = InBounds.Minimum.y;
+    node.MinZ[InSlot] = InBounds.Minimum.z;
+    node.MaxX[InSlot] = InBounds.Maximum.x;
+    node.MaxY[InSlot] = InBounds.Maximum.y;
+    node.MaxZ[InSlot] = InBounds.Maximum.z;
+}
+
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include <vector>
+#include "BVH.h"
+#include "SIMDKernels.h"
+#include "TrianglePrimitive.h"
+
+namespace CHISTUDIO {
+
+/** Triangle BVH with up to kWideBVHWidth children per node and triangles grouped into packets, so each traversal step
+ *  tests one ray against all children or all triangles of a packet with a single SIMD kernel call.
+ *  Built by collapsing a binary BVH whose primitive order the triangles already follow.
+ */
+class WideBVH
+{
+public:
+    WideBVH() : RootChild(kWideBVHEmptyChild), Kernels(nullptr) {
+    }
+
+    void Build(const BVH& InBinaryBVH, const std::vector<FTrianglePrimitive>& InTriangles);
+
+    void Clear() {
+        Nodes.clear();
+        Packets.clear();
+        RootChild = kWideBVHEmptyChild;
+    }
+
+    bool IsEmpty() const {
+        return RootChild == kWideBVHEmptyChild;
+    }
+
+    /** Walks the hierarchy front-to-back along InRay. InOnTriangleHit(triangleIndex, t, beta, gamma) is called for every
+     *  triangle hit closer than InOutT_Max and returns if the hit is accepted, in which case InOutT_Max shrinks to t.
+     *  Returns if any hit was accepted.
+     */
+    template <typename FTriangleHitFunction>
+    bool Traverse(const FRay& InRay, float InT_Min, float& InOutT_Max, FTriangleHitFunction InOnTriangleHit) const;
+
+    /** Any-hit traversal. InOnTriangleHit(triangleIndex, t, beta, gamma) is called for triangles hit between InT_Min and
+     *  InT_Max and returns if the hit blocks the ray. Children are visited in no particular order, and the traversal
+     *  stops and returns true at the first blocking hit.
+     */
+    template <typename FTriangleHitFunction>
+    bool Occluded(const FRay& InRay, float InT_Min, float InT_Max, FTriangleHitFunction InOnTriangleHit) const;
+
+private:
+    struct FBuildContext {
+        const std::vector<FBVHNode>& BinaryNodes;
+        const std::vector<FTrianglePrimitive>& Triangles;
+        std::vector<uint32_t> SubtreeFirstTriangle;
+        std::vector<uint32_t> SubtreeTriangleCount;
+    };
+
+    uint32_t BuildChild(const FBuildContext& InContext, uint32_t InBinaryIndex);
+    uint32_t BuildLeafRange(uint32_t InFirstTriangle, uint32_t InCount, const std::vector<FTrianglePrimitive>& InTriangles, AABB& OutBounds);
+    void SetChild(uint32_t InNodeIndex, uint32_t InSlot, uint32_t InChild, const AABB& InBounds);
+
+    std::vector<FWideBVHNode> Nodes;
+    std::vector<FTrianglePacket> Packets;
+    uint32_t RootChild;
+    const FSIMDKernels* Kernels;
+};
+
+template <typename FTriangleHitFunction>
+bool WideBVH::Traverse(const FRay& InRay, float InT_Min, float& InOutT_Max, FTriangleHitFunction InOnTriangleHit) const
+{
+    if (IsEmpty()) {
+        return false;
+    }
+
+    FWideRay ray;
+    ray.Origin = InRay.GetOrigin();
+    ray.Direction = InRay.GetDirection();
+    ray.InverseDirection = BVH::GetInverseDirection(ray.Direction);
+
+    struct FStackEntry {
+        uint32_t Child;
+        float EntryTime;
+    };
+    // Every level can leave all but one of its children on the stack. Oversized leaves add a few levels past kMaxDepth.
+    FStackEntry stack[(BVH::kMaxDepth + 16) * kWideBVHWidth];
+    int stackSize = 0;
+    stack[stackSize++] = { RootChild, InT_Min };
+
+    float entryTimes[kWideBVHWidth];
+    float times[kWideBVHWidth];
+    float betas[kWideBVHWidth];
+    float gammas[kWideBVHWidth];
+
+    bool bHitAnything = false;
+    while (stackSize > 0) {
+        FStackEntry entry = stack[--stackSize];
+        if (entry.EntryTime > InOutT_Max) {
+            continue;
+        }
+
+        if (entry.Child & kWideBVHLeafFlag) {
+            const FTrianglePacket& packet = Packets[entry.Child & ~kWideBVHLeafFlag];
+            uint32_t hitMask = Kernels->IntersectPacket(packet, ray, InT_Min, InOutT_Max, times, betas, gammas);
+            hitMask &= (1u << packet.TriangleCount) - 1;
+            for (uint32_t lane = 0; hitMask != 0; lane++, hitMask >>= 1) {
+                if ((hitMask & 1) && times[lane] < InOutT_Max && InOnTriangleHit(packet.FirstTriangle + lane, times[lane], betas[lane], gammas[lane])) {
+                    InOutT_Max = times[lane];
+                    bHitAnything = true;
+                }
+            }
+            continue;
+        }
+
+        const FWideBVHNode& node = Nodes[entry.Child];
+        uint32_t hitMask = Kernels->IntersectNode(node, ray, InT_Min, InOutT_Max, entryTimes);
+
+        // Push hit children sorted so the nearest one is popped first
+        int firstPushed = stackSize;
+        for (uint32_t slot = 0; hitMask != 0; slot++, hitMask >>= 1) {
+            if (!(hitMask & 1) || node.Children[slot] == kWideBVHEmptyChild) {
+                continue;
+            }
+            FStackEntry child = { node.Children[slot], entryTimes[slot] };
+            int insertIndex = stackSize++;
+            while (insertIndex > firstPushed && stack[insertIndex - 1].EntryTime < child.EntryTime) {
+                stack[insertIndex] = stack[insertIndex - 1];
+                insertIndex--;
+            }
+            stack[insertIndex] = child;
+        }
+    }
+
+    return bHitAnything;
+}
+
+template <typename FTriangleHitFunction>
+bool WideBVH::Occluded(const FRay& InRay, float InT_Min, float InT_Max, FTriangleHitFunction InOnTriangleHit) const
+{
+    if (IsEmpty()) {
+        return false;
+    }
+
+    FWideRay ray;
+    ray.Origin = InRay.GetOrigin();
+    ray.Direction = InRay.GetDirection();
+    ray.InverseDirection = BVH::GetInverseDirection(ray.Direction);
+
+    uint32_t stack[(BVH::kMaxDepth + 16) * kWideBVHWidth];
+    int stackSize = 0;
+    stack[stackSize++] = RootChild;
+
+    float entryTimes[kWideBVHWidth];
+    float times[kWideBVHWidth];
+    float betas[kWideBVHWidth];
+    float gammas[kWideBVHWidth];
+
+    while (stackSize > 0) {
+        uint32_t child = stack[--stackSize];
+
+        if (child & kWideBVHLeafFlag) {
+            const FTrianglePacket& packet = Packets[child & ~kWideBVHLeafFlag];
+            uint32_t hitMask = Kernels->IntersectPacket(packet, ray, InT_Min, InT_Max, times, betas, gammas);
+            hitMask &= (1u << packet.TriangleCount) - 1;
+            for (uint32_t lane = 0; hitMask != 0; lane++, hitMask >>= 1) {
+                if ((hitMask & 1) && InOnTriangleHit(packet.FirstTriangle + lane, times[lane], betas[lane], gammas[lane])) {
+                    return true;
+                }
+            }
+            continue;
+        }
+
+        const FWideBVHNode& node = Nodes[child];
+        uint32_t hitMask = Kernels->IntersectNode(node, ray, InT_Min, InT_Max, entryTimes);
+        for (uint32_t slot = 0; hitMask != 0; slot++, hitMask >>= 1) {
+            if ((hitMask & 1) && node.Children[slot] != kWideBVHEmptyChild) {
+                stack[stackSize++] = node.Children[slot];
+            }
+        }
+    }
+
+    return false;
+}
+
+}
@@ -5,8 +5,11 @@
 
 namespace CHISTUDIO {
 
-BindableBuffer::BindableBuffer(GLenum InTarget) :Target(InTarget)
+BindableBuffer::BindableBuffer(GLenum InTarget) :Handle(0), Target(InTarget)
 {
+	if (IsHeadless())
+		return;
+
 	GL_CHECK(glGenBuffers(1, &Handle));
 }
 
@@ -30,7 +33,8 @@ BindableBuffer& BindableBuffer::operator=(BindableBuffer&& Other) noexcept
 
 void BindableBuffer::Reset(GLuint InHandle) 
 {
-	GL_CHECK(glDeleteBuffers(1, &Handle));
+	if (!IsHeadless())
+		GL_CHECK(glDeleteBuffers(1, &Handle));
 	Handle = InHandle;
 }
 
@@ -42,10 +46,14 @@ GLuint BindableBuffer::Release()
 }
 
 void BindableBuffer::Bind() const {
+	if (IsHeadless())
+		return;
 	GL_CHECK(glBindBuffer(Target, Handle));
 }
 
 void BindableBuffer::Unbind() const {
+	if (IsHeadless())
+		return;
 	GL_CHECK(glBindBuffer(Target, 0));
 }
 
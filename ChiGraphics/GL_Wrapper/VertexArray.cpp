@@ -8,6 +8,9 @@ namespace CHISTUDIO{
 VertexArray::VertexArray()
 	: DrawMode(EDrawMode::Triangles), PolygonMode(EPolygonMode::Fill)
 {
+	if (IsHeadless())
+		return;
+
 	GL_CHECK(glGenVertexArrays(1, &Handle)); // Get the handle of this vertex array
 }
 
@@ -51,11 +54,17 @@ VertexArray& VertexArray::operator=(VertexArray&& other) noexcept
 
 void VertexArray::Bind() const 
 {
+	if (IsHeadless())
+		return;
+
 	GL_CHECK(glBindVertexArray(Handle));
 }
 
 void VertexArray::Unbind() const 
 {
+	if (IsHeadless())
+		return;
+
 	GL_CHECK(glBindVertexArray(0));
 }
 
@@ -114,6 +123,9 @@ void VertexArray::UpdateIndices(const FIndexArray& InIndices) const
 
 void VertexArray::LinkPositionBuffer(GLuint InAttrIndex) const
 {
+	if (IsHeadless())
+		return;
+
 	BindGuard VAO_Bg(this);
 	BindGuard Buffer_Bg(PositionBuffer.get());
 	GL_CHECK(glVertexAttribPointer(InAttrIndex, 3, GL_FLOAT, GL_FALSE, 0, 0)); // Attach the vertex buffer to the VAO.
@@ -122,6 +134,9 @@ void VertexArray::LinkPositionBuffer(GLuint InAttrIndex) const
 
 void VertexArray::LinkNormalBuffer(GLuint InAttrIndex) const
 {
+	if (IsHeadless())
+		return;
+
 	BindGuard VAO_Bg(this);
 	BindGuard Buffer_Bg(NormalBuffer.get());
 	GL_CHECK(glVertexAttribPointer(InAttrIndex, 3, GL_FLOAT, GL_FALSE, 0, 0)); // Attach the vertex buffer to the VAO.
@@ -130,6 +145,9 @@ void VertexArray::LinkNormalBuffer(GLuint InAttrIndex) const
 
 void VertexArray::LinkColorBuffer(GLuint InAttrIndex) const
 {
+	if (IsHeadless())
+		return;
+
 	BindGuard VAO_Bg(this);
 	BindGuard Buffer_Bg(ColorBuffer.get());
 	GL_CHECK(glVertexAttribPointer(InAttrIndex, 4, GL_FLOAT, GL_FALSE, 0, 0)); // Attach the vertex buffer to the VAO.
@@ -138,6 +156,9 @@ void VertexArray::LinkColorBuffer(GLuint InAttrIndex) const
 
 void VertexArray::LinkTexCoordBuffer(GLuint InAttrIndex) const
 {
+	if (IsHeadless())
+		return;
+
 	BindGuard VAO_Bg(this);
 	BindGuard Buffer_Bg(TexCoordBuffer.get());
 	GL_CHECK(glVertexAttribPointer(InAttrIndex, 2, GL_FLOAT, GL_FALSE, 0, 0)); // Attach the vertex buffer to the VAO.
@@ -166,6 +187,9 @@ EPolygonMode VertexArray::GetPolygonMode()
 
 void VertexArray::Render(size_t InStartIndex, size_t InNumberOfIndices) const
 {
+	if (IsHeadless())
+		return;
+
 	BindGuard VAO_Bg(this);
 
 	if (PolygonMode == EPolygonMode::Wireframe) 
@@ -34,9 +34,12 @@ VertexBuffer<T, target>::VertexBuffer(GLenum InUsage)
 template<class T, GLenum target>
 void VertexBuffer<T, target>::Update(const std::vector<T>& array)
 {
+	Size = array.size();
+	if (IsHeadless())
+		return;
+
 	BindGuard Bg(this);
 	GL_CHECK(glBufferData(Target, sizeof(T) * array.size(), array.data(), Usage));
-	Size = array.size();
 }
 
 }
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "ChiGraphics/Utilities.h"
+#include "ChiGraphics/RNG.h"
+
+namespace CHISTUDIO {
+
+/** The lobes a material's BSDF is made of. Decided once when a material is snapshot for a render, so the kernels below
+ *  are specialized per class and carry no per-sample branches on material flags.
+ */
+enum class EBSDFClass
+{
+    // Opaque, non-metallic: Lambert diffuse under a Beckmann specular lobe with a grey Fresnel
+    Diffuse,
+    // Opaque with a metallic component: as Diffuse, but the Fresnel reflectance is tinted by the albedo
+    Glossy,
+    // Transparent: Beckmann reflection and transmission, no diffuse lobe
+    Dielectric
+};
+
+/** Material parameters at one shading point, with every texture already sampled and everything derived from them
+ *  precomputed. Resolved once per hit and shared by every BSDF evaluation and sample taken there.
+ */
+struct FBSDFParameters
+{
+    glm::vec3 Albedo = glm::vec3(1.0f);
+    float RoughnessSquared = 1.0f;
+    float IndexOfRefraction = 1.5f;
+
+    // Reflectance at normal incidence, tinted by the albedo as the material gets more metallic
+    glm::vec3 F0 = glm::vec3(0.04f);
+
+    // Probability of sampling the specular lobe, estimated from the Fresnel reflectance
+    float SpecularWeight = 0.2f;
+};
+
+namespace BSDFKernels {
+
+// D = exp(((n dot h)^2 - 1) / (m^2 (n dot h)^2)) / (pi m^2 (n dot h)^4)
+inline float BeckmannDistribution(float InNormalDotHalfway, float InRoughnessSquared)
+{
+    float NH2 = InNormalDotHalfway * InNormalDotHalfway;
+    return glm::exp((NH2 - 1.0f) / (InRoughnessSquared * NH2)) / (kPi * InRoughnessSquared * NH2 * NH2);
+}
+
+// Density of sampling a halfway vector: p = 1 / (pi m^2 cos^3 theta) * e^(-tan^2(theta) / m^2)
+inline float BeckmannPDF(const glm::vec3& InHalfway, const glm::vec3& InNormal, float InRoughnessSquared)
+{
+    float cosT = glm::min(glm::abs(glm::dot(InHalfway, InNormal)), 1.0f);
+    float tan2T = (1.0f - cosT * cosT) / (cosT * cosT);
+    return glm::exp(-tan2T / InRoughnessSquared) / (kPi * InRoughnessSquared * cosT * cosT * cosT);
+}
+
+// Probability integral transform for the Beckmann distribution: theta = arctan sqrt(-m^2 ln U), azimuth uniform
+inline glm::vec3 SampleBeckmannHalfway(const glm::vec3& InNormal, float InRoughnessSquared, RNG& InRNG)
+{
+    float tan2T = -InRoughnessSquared * glm::log(InRNG.Float());
+    float cosT = 1.0f / glm::sqrt(1.0f + tan2T);
+    float sinT = glm::sqrt(glm::max(1.0f - cosT * cosT, 0.0f));
+    float phi = 2.0f * kPi * InRNG.Float();
+
+    glm::vec3 tangent, bitangent;
+    MakeOrthonormals(InNormal, tangent, bitangent);
+    return tangent * (glm::cos(phi) * sinT) + bitangent * (glm::sin(phi) * sinT) + InNormal * cosT;
+}
+
+// G = min(1, 2(n dot h)(n dot wo)/(wo dot h), 2(n dot h)(n dot wi)/(wo dot h))
+inline float MaskingShadowing(float InNormalDotIncident, float InNormalDotViewer, float InNormalDotHalfway, float InViewerDotHalfway)
+{
+    float g = glm::min(InNormalDotIncident * InNormalDotHalfway, InNormalDotViewer * InNormalDotHalfway);
+    return glm::min(1.0f, 2.0f * g / InViewerDotHalfway);
+}
+
+// Schlick's approximation, F = F0 + (1 - F0)(1 - wo dot h)^5, for a grey or a tinted F0
+template <typename TReflectance>
+inline TReflectance SchlickFresnel(const TReflectance& InF0, float InViewerDotHalfway)
+{
+    float m = 1.0f - InViewerDotHalfway;
+    float m2 = m * m;
+    return InF0 + (TReflectance(1.0f) - InF0) * (m2 * m2 * m);
+}
+
+// Cook-Torrance specular plus Lambert diffuse weighted by the light the Fresnel term did not reflect
+template <typename TReflectance>
+inline glm::vec3 EvaluateOpaque(const FBSDFParameters& InParameters, const TReflectance& InF0, const glm::vec3& InNormal, const glm::vec3& InTowardViewer, const glm::vec3& InTowardIncident)
+{
+    float NormalDotViewer = glm::dot(InNormal, InTowardViewer);
+    float NormalDotIncident = glm::dot(InNormal, InTowardIncident);
+    if (NormalDotViewer <= 0.0f || NormalDotIncident <= 0.0f)
+    {
+        return glm::vec3(0.0f);
+    }
+
+    glm::vec3 halfway = glm::normalize(InTowardIncident + InTowardViewer);
+    float ViewerDotHalfway = glm::dot(InTowardViewer, halfway);
+    float NormalDotHalfway = glm::dot(InNormal, halfway);
+
+    float distribution = BeckmannDistribution(NormalDotHalfway, InParameters.RoughnessSquared);
+    TReflectance fresnel = SchlickFresnel(InF0, ViewerDotHalfway);
+    float geometry = MaskingShadowing(NormalDotIncident, NormalDotViewer, NormalDotHalfway, ViewerDotHalfway);
+
+    float specularScale = distribution * geometry / (4.0f * NormalDotViewer * NormalDotIncident);
+    return glm::vec3(fresnel * specularScale) + glm::vec3(TReflectance(1.0f) - fresnel) * InParameters.Albedo / kPi;
+}
+
+inline float GetOpaquePDF(const FBSDFParameters& InParameters, const glm::vec3& InNormal, const glm::vec3& InTowardViewer, const glm::vec3& InTowardIncident)
+{
+    glm::vec3 halfway = glm::normalize(InTowardIncident + InTowardViewer);
+    float specular = InParameters.SpecularWeight * BeckmannPDF(halfway, InNormal, InParameters.RoughnessSquared) / (4.0f * glm::abs(glm::dot(halfway, InTowardViewer)));
+    float diffuse = (1.0f - InParameters.SpecularWeight) * glm::max(glm::dot(InTowardIncident, InNormal), 0.0f) / kPi;
+    return specular + diffuse;
+}
+
+inline bool SampleOpaque(const FBSDFParameters& InParameters, const glm::vec3& InNormal, const glm::vec3& InTowardViewer, RNG& InRNG, glm::vec3& OutDirection, float& OutPDF)
+{
+    if (InRNG.Float() <= InParameters.SpecularWeight)
+    {
+        glm::vec3 halfway = SampleBeckmannHalfway(InNormal, InParameters.RoughnessSquared, InRNG);
+        OutDirection = -glm::reflect(InTowardViewer, halfway);
+    }
+    else
+    {
+        // Cosine-weighted hemisphere through Malley's method
+        glm::vec2 point = RandomInUnitDisk(InRNG);
+        float z = glm::sqrt(glm::max(1.0f - point.x * point.x - point.y * point.y, 0.0f));
+        glm::vec3 tangent, bitangent;
+        MakeOrthonormals(InNormal, tangent, bitangent);
+        OutDirection = tangent * point.x + bitangent * point.y + InNormal * z;
+    }
+    OutPDF = GetOpaquePDF(InParameters, InNormal, InTowardViewer, OutDirection);
+    return true;
+}
+
+}
+
+/** BSDF evaluation, sampling and sampling density for one material class, in single precision.
+ *
+ *  Parameter 'InTowardViewer' corresponds to w_o and 'InTowardIncident' to w_i in the rendering equation. Microfacets
+ *  follow the Beckmann distribution (https://www.pbr-book.org/3ed-2018/Reflection_Models/Microfacet_Models), the
+ *  specular lobe is Cook-Torrance, the diffuse lobe Lambert and transmission follows Walter et al.'s microfacet BTDF
+ *  (https://www.cs.cornell.edu/~srm/publications/EGSR07-btdf.pdf).
+ */
+template <EBSDFClass Class>
+struct TBSDFKernel;
+
+template <>
+struct TBSDFKernel<EBSDFClass::Diffuse>
+{
+    // Without a metallic component F0 is the same in every channel, so Fresnel is evaluated once
+    static glm::vec3 Evaluate(const FBSDFParameters& InParameters, const glm::vec3& InNormal, const glm::vec3& InTowardViewer, const glm::vec3& InTowardIncident)
+    {
+        return BSDFKernels::EvaluateOpaque(InParameters, InParameters.F0.x, InNormal, InTowardViewer, InTowardIncident);
+    }
+
+    static bool Sample(const FBSDFParameters& InParameters, const glm::vec3& InNormal, const glm::vec3& InTowardViewer, RNG& InRNG, glm::vec3& OutDirection, float& OutPDF)
+    {
+        return BSDFKernels::SampleOpaque(InParameters, InNormal, InTowardViewer, InRNG, OutDirection, OutPDF);
+    }
+
+    static float GetPDF(const FBSDFParameters& InParameters, const glm::vec3& InNormal, const glm::vec3& InTowardViewer, const glm::vec3& InTowardIncident)
+    {
+        return BSDFKernels::GetOpaquePDF(InParameters, InNormal, InTowardViewer, InTowardIncident);
+    }
+};
+
+template <>
+struct TBSDFKernel<EBSDFClass::Glossy>
+{
+    static glm::vec3 Evaluate(const FBSDFParameters& InParameters, const glm::vec3& InNormal, const glm::vec3& InTowardViewer, const glm::vec3& InTowardIncident)
+    {
+        return BSDFKernels::EvaluateOpaque(InParameters, InParameters.F0, InNormal, InTowardViewer, InTowardIncident);
+    }
+
+    static bool Sample(const FBSDFParameters& InParameters, const glm::vec3& InNormal, const glm::vec3& InTowardViewer, RNG& InRNG, glm::vec3& OutDirection, float& OutPDF)
+    {
+        return BSDFKernels::SampleOpaque(InParameters, InNormal, InTowardViewer, InRNG, OutDirection, OutPDF);
+    }
+
+    static float GetPDF(const FBSDFParameters& InParameters, const glm::vec3& InNormal, const glm::vec3& InTowardViewer, const glm::vec3& InTowardIncident)
+    {
+        return BSDFKernels::GetOpaquePDF(InParameters, InNormal, InTowardViewer, InTowardIncident);
+    }
+};
+
+template <>
+struct TBSDFKernel<EBSDFClass::Dielectric>
+{
+    static glm::vec3 Evaluate(const FBSDFParameters& InParameters, const glm::vec3& InNormal, const glm::vec3& InTowardViewer, const glm::vec3& InTowardIncident)
+    {
+        float NormalDotViewer = glm::dot(InNormal, InTowardViewer);
+        float NormalDotIncident = glm::dot(InNormal, InTowardIncident);
+        bool bIsViewerOutside = NormalDotViewer > 0.0f;
+        bool bIsIncidentOutside = NormalDotIncident > 0.0f;
+
+        if (bIsViewerOutside == bIsIncidentOutside)
+        {
+            // Reflection, from either side of the surface
+            glm::vec3 halfway = glm::normalize(InTowardIncident + InTowardViewer);
+            float ViewerDotHalfway = glm::dot(InTowardViewer, halfway);
+            float NormalDotHalfway = glm::dot(InNormal, halfway);
+
+            float distribution = BSDFKernels::BeckmannDistribution(NormalDotHalfway, InParameters.RoughnessSquared);
+            glm::vec3 fresnel = glm::vec3(1.0f); // Total internal reflection
+            if (bIsIncidentOutside || glm::sqrt(1.0f - ViewerDotHalfway * ViewerDotHalfway) * InParameters.IndexOfRefraction <= 1.0f)
+            {
+                fresnel = BSDFKernels::SchlickFresnel(InParameters.F0, ViewerDotHalfway);
+            }
+            float geometry = BSDFKernels::MaskingShadowing(NormalDotIncident, NormalDotViewer, NormalDotHalfway, ViewerDotHalfway);
+            return fresnel * (distribution * geometry / (4.0f * NormalDotViewer * NormalDotIncident));
+        }
+
+        // Transmission. etaT is the ratio of refractive indices across the surface.
+        float etaT = bIsViewerOutside ? InParameters.IndexOfRefraction : 1.0f / InParameters.IndexOfRefraction;
+        glm::vec3 halfway = glm::normalize(InTowardIncident * etaT + InTowardViewer);
+        float ViewerDotHalfway = glm::dot(InTowardViewer, halfway);
+        float IncidentDotHalfway = glm::dot(InTowardIncident, halfway);
+        float NormalDotHalfway = glm::dot(InNormal, halfway);
+
+        float distribution = BSDFKernels::BeckmannDistribution(NormalDotHalfway, InParameters.RoughnessSquared);
+        glm::vec3 fresnel = BSDFKernels::SchlickFresnel(InParameters.F0, glm::abs(ViewerDotHalfway));
+        float geometry = glm::min(1.0f, 2.0f * glm::min(glm::abs(NormalDotIncident * NormalDotHalfway), glm::abs(NormalDotViewer * NormalDotHalfway)) / glm::abs(ViewerDotHalfway));
+
+        // |h dot wi|/|n dot wi| * |h dot wo|/|n dot wo| * (1 - F)DG / (etaT (h dot wi) + (h dot wo))^2
+        float denominator = etaT * IncidentDotHalfway + ViewerDotHalfway;
+        float scale = glm::abs(IncidentDotHalfway * ViewerDotHalfway / (NormalDotIncident * NormalDotViewer)) * distribution * geometry / (denominator * denominator);
+        return (glm::vec3(1.0f) - fresnel) * InParameters.Albedo * scale;
+    }
+
+    static bool Sample(const FBSDFParameters& InParameters, const glm::vec3& InNormal, const glm::vec3& InTowardViewer, RNG& InRNG, glm::vec3& OutDirection, float& OutPDF)
+    {
+        bool bIsReflected = InRNG.Float() <= InParameters.SpecularWeight;
+        glm::vec3 halfway = BSDFKernels::SampleBeckmannHalfway(InNormal, InParameters.RoughnessSquared, InRNG);
+        if (bIsReflected)
+        {
+            OutDirection = -glm::reflect(InTowardViewer, halfway);
+        }
+        else
+        {
+            float etaT = glm::dot(InTowardViewer, InNormal) > 0.0f ? InParameters.IndexOfRefraction : 1.0f / InParameters.IndexOfRefraction;
+            float cosViewer = glm::dot(halfway, InTowardViewer);
+            glm::vec3 incidentPerpendicular = -(InTowardViewer - halfway * cosViewer) / etaT;
+            float sin2Incident = glm::dot(incidentPerpendicular, incidentPerpendicular);
+            if (sin2Incident > 1.0f)
+            {
+                // Total internal reflection, no light is transmitted toward the viewer along this halfway vector
+                return false;
+            }
+            OutDirection = -glm::sign(cosViewer) * glm::sqrt(1.0f - sin2Incident) * halfway + incidentPerpendicular;
+        }
+        OutPDF = GetPDF(InParameters, InNormal, InTowardViewer, OutDirection);
+        return true;
+    }
+
+    static float GetPDF(const FBSDFParameters& InParameters, const glm::vec3& InNormal, const glm::vec3& InTowardViewer, const glm::vec3& InTowardIncident)
+    {
+        glm::vec3 reflectedHalfway = glm::normalize(InTowardIncident + InTowardViewer);
+        float probability = InParameters.SpecularWeight * BSDFKernels::BeckmannPDF(reflectedHalfway, InNormal, InParameters.RoughnessSquared)
+            / (4.0f * glm::abs(glm::dot(reflectedHalfway, InTowardViewer)));
+
+        float NormalDotViewer = glm::dot(InTowardViewer, InNormal);
+        if ((NormalDotViewer >= 0.0f) != (glm::dot(InTowardIncident, InNormal) >= 0.0f))
+        {
+            float etaT = NormalDotViewer > 0.0f ? InParameters.IndexOfRefraction : 1.0f / InParameters.IndexOfRefraction;
+            glm::vec3 halfway = glm::normalize(InTowardIncident * etaT + InTowardViewer);
+            float HDotViewer = glm::dot(halfway, InTowardViewer);
+            float denominator = etaT * glm::dot(halfway, InTowardIncident) + HDotViewer;
+            probability += (1.0f - InParameters.SpecularWeight) * BSDFKernels::BeckmannPDF(halfway, InNormal, InParameters.RoughnessSquared) * glm::abs(HDotViewer) / (denominator * denominator);
+        }
+        return probability;
+    }
+};
+
+}
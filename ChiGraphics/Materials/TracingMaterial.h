@@ -0,0 +1,232 @@
+#pragma once
+#define NOMINMAX
+
+#include <glm/glm.hpp>
+#include <glm/gtx/compatibility.hpp>
+#include <glm/gtx/norm.hpp>
+#include "ChiGraphics/Utilities.h"
+#include "ChiGraphics/Textures/FImage.h"
+#include "ChiGraphics/Textures/TextureCache.h"
+#include "ChiGraphics/RNG.h"
+#include "Material.h"
+#include "BSDF.h"
+
+namespace CHISTUDIO {
+
+/** Render-time snapshot of a Material. Holds only the values and texture pointers the tracer reads, so it is cheap to
+ *  copy and store in a flat table. Hit records refer to entries of that table by index.
+ */
+struct FTracingMaterial
+{
+    FTracingMaterial()
+        : Albedo(glm::dvec3(1.0, 0., 0.)),
+        AlbedoMap(nullptr),
+        Roughness(1.0f),
+        RoughnessMap(nullptr),
+        bRoughnessMapIsSpecular(false),
+        Metallic(0.0f),
+        MetallicMap(nullptr),
+        Emittance(0.0f),
+        EmittanceMap(nullptr),
+        IndexOfRefraction(1.5f),
+        bIsTransparent(false),
+        BumpMap(nullptr),
+        AlphaMap(nullptr),
+        TextureCache(nullptr)
+    {
+        BSDFClass = GetBSDFClass();
+    }
+
+    // With a texture cache, the albedo, roughness, metallic and emittance maps are registered with it and sampled through
+    // it, filtered to the footprint passed to the Sample functions. Without one they are sampled from the images directly.
+    explicit FTracingMaterial(const Material& InMaterial, FTextureCache* InTextureCache = nullptr)
+        : Albedo(InMaterial.GetAlbedo()),
+        AlbedoMap(InMaterial.GetAlbedoMap()),
+        Roughness(InMaterial.GetRoughness()),
+        RoughnessMap(InMaterial.GetRoughnessMap()),
+        bRoughnessMapIsSpecular(InMaterial.IsRoughnessMapSpecular()),
+        Metallic(InMaterial.GetMetallic()),
+        MetallicMap(InMaterial.GetMetallicMap()),
+        Emittance(InMaterial.GetEmittance()),
+        EmittanceMap(InMaterial.GetEmittanceMap()),
+        IndexOfRefraction(InMaterial.GetIndexOfRefraction()),
+        bIsTransparent(InMaterial.IsTransparent()),
+        BumpMap(InMaterial.GetBumpMap()),
+        AlphaMap(InMaterial.GetAlphaMap()),
+        TextureCache(InTextureCache)
+    {
+        BSDFClass = GetBSDFClass();
+        if (TextureCache)
+        {
+            AlbedoTexture = AlbedoMap ? InTextureCache->AddTexture(*AlbedoMap) : 0;
+            RoughnessTexture = RoughnessMap ? InTextureCache->AddTexture(*RoughnessMap) : 0;
+            MetallicTexture = MetallicMap ? InTextureCache->AddTexture(*MetallicMap) : 0;
+            EmittanceTexture = EmittanceMap ? InTextureCache->AddTexture(*EmittanceMap) : 0;
+        }
+    }
+
+    /*
+    * Sample every texture the BSDF reads at 'InUVs' and derive the values its kernels share. The result is meant to be
+    * computed once per shading point and passed to every EvaluateBSDF, SampleHemisphere and EvaluatePDF call there.
+    * 'InFootprint' is the width in UV units of the area to filter textures over.
+    */
+    FBSDFParameters ResolveBSDF(const glm::vec2& InUVs, float InFootprint = 0.0f) const
+    {
+        FBSDFParameters parameters;
+        parameters.Albedo = glm::vec3(SampleAlbedo(InUVs, InFootprint));
+        float roughness = SampleRoughness(InUVs, InFootprint);
+        parameters.RoughnessSquared = roughness * roughness;
+        parameters.IndexOfRefraction = IndexOfRefraction;
+
+        float metallic = SampleMetallic(InUVs, InFootprint);
+        float f0 = (IndexOfRefraction - 1.0f) / (IndexOfRefraction + 1.0f);
+        f0 *= f0;
+        parameters.F0 = glm::mix(glm::vec3(f0), parameters.Albedo, metallic);
+
+        // Using the Fresnel term, estimate specular contribution
+        float f = (1.0f - metallic) * f0 + metallic * ((parameters.Albedo.x + parameters.Albedo.y + parameters.Albedo.z) / 3.0f);
+        parameters.SpecularWeight = glm::mix(f, 1.0f, 0.2f);
+        return parameters;
+    }
+
+    /*
+    * Evaluate the Bidirectional Scattering Distribution Function for this material's properties.
+    *
+    * Parameters 'InTowardViewer' and 'InTowardIncident' correspond to w_o and w_i in the rendering equation.
+    * See TBSDFKernel for the models and references.
+    */
+    glm::vec3 EvaluateBSDF(const FBSDFParameters& InParameters, const glm::vec3& InSurfaceNormal, const glm::vec3& InTowardViewer, const glm::vec3& InTowardIncident) const
+    {
+        switch (BSDFClass)
+        {
+        case EBSDFClass::Diffuse:
+            return TBSDFKernel<EBSDFClass::Diffuse>::Evaluate(InParameters, InSurfaceNormal, InTowardViewer, InTowardIncident);
+        case EBSDFClass::Glossy:
+            return TBSDFKernel<EBSDFClass::Glossy>::Evaluate(InParameters, InSurfaceNormal, InTowardViewer, InTowardIncident);
+        default:
+            return TBSDFKernel<EBSDFClass::Dielectric>::Evaluate(InParameters, InSurfaceNormal, InTowardViewer, InTowardIncident);
+        }
+    }
+
+    /*
+    * Sample hemisphere around a surface normal for an out direction and a 
+    * corresponding probability density function. Uses the Beckmann distribution
+    * function.
+    * 
+    * Parameter 'InTowardViewer' corresponds to w_o in the rendering equation.
+    * PDF : Probability Density Function
+    * 
+    * Returns false if ray shouldn't be used
+    */
+    bool SampleHemisphere(glm::vec3& OutDirection, float& OutPDF, const FBSDFParameters& InParameters, const glm::vec3& InSurfaceNormal, const glm::vec3& InTowardViewer, RNG& InRNG) const
+    {
+        // https://agraphicsguy.wordpress.com/2015/11/01/sampling-microfacet-brdf/
+        switch (BSDFClass)
+        {
+        case EBSDFClass::Diffuse:
+            return TBSDFKernel<EBSDFClass::Diffuse>::Sample(InParameters, InSurfaceNormal, InTowardViewer, InRNG, OutDirection, OutPDF);
+        case EBSDFClass::Glossy:
+            return TBSDFKernel<EBSDFClass::Glossy>::Sample(InParameters, InSurfaceNormal, InTowardViewer, InRNG, OutDirection, OutPDF);
+        default:
+            return TBSDFKernel<EBSDFClass::Dielectric>::Sample(InParameters, InSurfaceNormal, InTowardViewer, InRNG, OutDirection, OutPDF);
+        }
+    }
+
+    /*
+    * Probability density of SampleHemisphere choosing 'InTowardIncident', in solid angle. Used to weight directions found
+    * by sampling lights against BSDF sampling.
+    */
+    float EvaluatePDF(const FBSDFParameters& InParameters, const glm::vec3& InSurfaceNormal, const glm::vec3& InTowardViewer, const glm::vec3& InTowardIncident) const
+    {
+        switch (BSDFClass)
+        {
+        case EBSDFClass::Diffuse:
+            return TBSDFKernel<EBSDFClass::Diffuse>::GetPDF(InParameters, InSurfaceNormal, InTowardViewer, InTowardIncident);
+        case EBSDFClass::Glossy:
+            return TBSDFKernel<EBSDFClass::Glossy>::GetPDF(InParameters, InSurfaceNormal, InTowardViewer, InTowardIncident);
+        default:
+            return TBSDFKernel<EBSDFClass::Dielectric>::GetPDF(InParameters, InSurfaceNormal, InTowardViewer, InTowardIncident);
+        }
+    }
+
+    glm::dvec3 SampleAlbedo(const glm::vec2& InUVs, float InFootprint = 0.0f) const
+    {
+        return AlbedoMap ? glm::dvec3(SampleMap(AlbedoMap, AlbedoTexture, InUVs, InFootprint)) : Albedo;
+    }
+
+    float SampleRoughness(const glm::vec2& InUVs, float InFootprint = 0.0f) const
+    {
+        if (!RoughnessMap)
+        {
+            return Roughness;
+        }
+        float sampledRoughness = SampleMap(RoughnessMap, RoughnessTexture, InUVs, InFootprint).x;
+        return bRoughnessMapIsSpecular ? glm::max(1.0f - sampledRoughness, 0.01f) : sampledRoughness;
+    }
+
+    float SampleMetallic(const glm::vec2& InUVs, float InFootprint = 0.0f) const
+    {
+        return MetallicMap ? SampleMap(MetallicMap, MetallicTexture, InUVs, InFootprint).x : Metallic;
+    }
+
+    float SampleEmittance(const glm::vec2& InUVs, float InFootprint = 0.0f) const
+    {
+        return EmittanceMap ? SampleMap(EmittanceMap, EmittanceTexture, InUVs, InFootprint).x : Emittance;
+    }
+
+    float SampleBump(const glm::vec2& InUVs) const
+    {
+        return BumpMap ? BumpMap->SampleWithUV(InUVs).x : 0.0f;
+    }
+
+    float SampleAlpha(const glm::vec2& InUVs) const
+    {
+        return AlphaMap ? AlphaMap->SampleWithUV(InUVs).x : 1.0f;
+    }
+
+    glm::dvec3 Albedo;
+    const FImage* AlbedoMap;
+
+    float Roughness;
+    const FImage* RoughnessMap;
+    bool bRoughnessMapIsSpecular;
+
+    float Metallic;
+    const FImage* MetallicMap;
+
+    float Emittance;
+    const FImage* EmittanceMap;
+
+    float IndexOfRefraction;
+    bool bIsTransparent;
+
+    const FImage* BumpMap;
+    const FImage* AlphaMap;
+
+    // Lobes of the BSDF, picking the kernels EvaluateBSDF, SampleHemisphere and EvaluatePDF run
+    EBSDFClass BSDFClass;
+
+    // Ids of the maps in TextureCache, when there is one
+    const FTextureCache* TextureCache;
+    uint32_t AlbedoTexture = 0;
+    uint32_t RoughnessTexture = 0;
+    uint32_t MetallicTexture = 0;
+    uint32_t EmittanceTexture = 0;
+
+private:
+    glm::vec3 SampleMap(const FImage* InMap, uint32_t InTexture, const glm::vec2& InUVs, float InFootprint) const
+    {
+        return TextureCache ? TextureCache->Sample(InTexture, InUVs, InFootprint) : InMap->SampleWithUV(InUVs);
+    }
+
+    EBSDFClass GetBSDFClass() const
+    {
+        if (bIsTransparent)
+        {
+            return EBSDFClass::Dielectric;
+        }
+        return Metallic > 0.0f || MetallicMap ? EBSDFClass::Glossy : EBSDFClass::Diffuse;
+    }
+};
+
+}
@@ -14,9 +14,16 @@
 #include <functional>
 #include "ChiGraphics/Application.h"
 #include <unordered_set>
+#include <atomic>
 
 namespace CHISTUDIO {
 
+	uint64_t VertexObject::MakeRevision()
+	{
+		static std::atomic<uint64_t> nextRevision(1);
+		return nextRevision++;
+	}
+
 	void VertexObject::UpdatePositions(std::unique_ptr<FPositionArray> InPositions)
 	{
 		if (Positions == nullptr) {
@@ -24,6 +31,7 @@ namespace CHISTUDIO {
 		}
 		Positions = std::move(InPositions);
 		VertexArray_->UpdatePositions(*Positions);
+		Revision = MakeRevision();
 	}
 
 	void VertexObject::UpdateNormals(std::unique_ptr<FNormalArray> InNormals)
@@ -33,6 +41,7 @@ namespace CHISTUDIO {
 		}
 		Normals = std::move(InNormals);
 		VertexArray_->UpdateNormals(*Normals);
+		Revision = MakeRevision();
 	}
 
 	void VertexObject::UpdateColors(std::unique_ptr<FColorArray> InColors)
@@ -51,6 +60,7 @@ namespace CHISTUDIO {
 		}
 		TexCoords = std::move(InTexCoords);
 		VertexArray_->UpdateTexCoords(*TexCoords);
+		Revision = MakeRevision();
 	}
 
 	void VertexObject::UpdateIndices(std::unique_ptr<FIndexArray> InIndices)
@@ -60,6 +70,7 @@ namespace CHISTUDIO {
 		}
 		Indices = std::move(InIndices);
 		VertexArray_->UpdateIndices(*Indices);
+		Revision = MakeRevision();
 	}
 
 	void VertexObject::CopyVertexObject(VertexObject* InVertexObject)
@@ -1826,11 +1837,10 @@ namespace CHISTUDIO {
 		FHitRecord hitRecord = FHitRecord();
 		bool bWasAnyVertexFound = false;
 		FVertex* hitVertex = nullptr;
-		Material defaultMat;
 		for (size_t i = 0; i < Vertices.size(); i++)
 		{
 			SphereHittable vertexCollision = SphereHittable(.05f, Vertices[i]->GetPosition());
-			bool hitRecorded = vertexCollision.Intersect(InSceneRay, 0.0001f, hitRecord, defaultMat);
+			bool hitRecorded = vertexCollision.Intersect(InSceneRay, 0.0001f, hitRecord, nullptr);
 			bWasAnyVertexFound |= hitRecorded;
 			if (hitRecorded) hitVertex = Vertices[i].get();
 		}
@@ -1850,14 +1860,13 @@ namespace CHISTUDIO {
 		FHitRecord hitRecord = FHitRecord();
 		bool bWasAnyEdgeFound = false;
 		FEdge* hitEdge = nullptr;
-		Material defaultMat;
 		for (size_t i = 0; i < Edges.size(); i++)
 		{
 			glm::vec3 firstVertexPos = Edges[i]->GetFirstHalfEdge()->GetNextVertex()->GetPosition();
 			glm::vec3 secondVertexPos = Edges[i]->GetSecondHalfEdge()->GetNextVertex()->GetPosition();
 
 			CylinderHittable edgeCollision = CylinderHittable(.05f, firstVertexPos, glm::normalize(secondVertexPos - firstVertexPos), glm::length(secondVertexPos - firstVertexPos));
-			bool hitRecorded = edgeCollision.Intersect(InSceneRay, 0.0001f, hitRecord, defaultMat);
+			bool hitRecorded = edgeCollision.Intersect(InSceneRay, 0.0001f, hitRecord, nullptr);
 			bWasAnyEdgeFound |= hitRecorded;
 			if (hitRecorded) hitEdge = Edges[i].get();
 		}
@@ -1877,12 +1886,11 @@ namespace CHISTUDIO {
 		FHitRecord hitRecord = FHitRecord();
 		bool bWasAnyFaceFound = false;
 		FFace* hitFace = nullptr;
-		Material defaultMat;
 		for (size_t i = 0; i < Faces.size(); i++)
 		{
 			for (TriangleHittable triangle : Faces[i]->GetTrianglesOnFace())
 			{
-				bool hitRecorded = triangle.Intersect(InSceneRay, 0.0001f, hitRecord, defaultMat);
+				bool hitRecorded = triangle.Intersect(InSceneRay, 0.0001f, hitRecord, nullptr);
 				bWasAnyFaceFound |= hitRecorded;
 				if (hitRecorded) hitFace = Faces[i].get();
 			}
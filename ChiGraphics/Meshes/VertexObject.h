@@ -121,7 +121,8 @@ namespace CHISTUDIO {
             bUseImportedNormals(false),
             bUseImportedUVs(false),
             ObjectName(InObjectName),
-            ImportedMaterialName(InImportedMaterialName)
+            ImportedMaterialName(InImportedMaterialName),
+            Revision(MakeRevision())
         {
             ShadingType = EShadingType::Flat;
 
@@ -160,7 +161,7 @@ namespace CHISTUDIO {
             }
         }
 
-        // Vertex buffers are created in a lazy manner in the following Update*.
+        // Vertex buffers are created in a lazy manner in the following Update*. Each update bumps the revision.
         void UpdatePositions(std::unique_ptr<FPositionArray> InPositions);
         void UpdateNormals(std::unique_ptr<FNormalArray> InNormals);
         void UpdateColors(std::unique_ptr<FColorArray> InColors);
@@ -427,6 +428,13 @@ namespace CHISTUDIO {
         void MarkDirty()
         {
             CreateVertexArrayFromHalfEdgeStructure();
+            Revision = MakeRevision();
+        }
+
+        // Changes whenever the vertex data changes. Revisions are unique across every vertex object, so a revision
+        // identifies one state of one object, even after the object is destroyed and another takes its address.
+        uint64_t GetRevision() const {
+            return Revision;
         }
 
         void ExtrudeSelectedFaces(EFaceExtrudeType InType);
@@ -506,6 +514,10 @@ namespace CHISTUDIO {
         EShadingType ShadingType;
 
         bool bUseImportedNormals;
+
+        // Next value from a counter shared by every vertex object
+        static uint64_t MakeRevision();
+        uint64_t Revision;
     };
 
 }
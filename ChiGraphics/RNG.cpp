@@ -1,27 +1,39 @@
 #include "RNG.h"
-#include <iostream>
+#include "ChiGraphics/RayTracing/Sampler.h"
 
 namespace CHISTUDIO {
 
 RNG::RNG(int InSeed)
-	:
-	Seed(InSeed),
-	Generator(std::mt19937(InSeed)),
-	FloatDistribution(std::uniform_real_distribution<float>(0, 1))
+	: RNG((uint64_t)(uint32_t)InSeed, 0)
 {
-	//std::cout << "Generating with seed: " << InSeed << std::endl;
 }
 
-RNG::~RNG()
-{		
-	//std::cout << "Destructing seed: " << Seed << std::endl;
+RNG::RNG(uint64_t InSeed, uint64_t InStream)
+	: State(0),
+	Increment((InStream << 1u) | 1u),
+	Sampler(nullptr)
+{
+	UInt32();
+	State += InSeed;
+	UInt32();
 }
 
 float RNG::Float()
 {
-	float result = FloatDistribution(Generator);
-		
-	return result;
+	if (Sampler)
+	{
+		return Sampler->Next1D();
+	}
+	return UInt32ToUnitFloat(UInt32());
 }
 
-}
\ No newline at end of file
+uint32_t RNG::UInt32()
+{
+	uint64_t oldState = State;
+	State = oldState * 6364136223846793005ULL + Increment;
+	uint32_t xorShifted = (uint32_t)(((oldState >> 18u) ^ oldState) >> 27u);
+	uint32_t rotation = (uint32_t)(oldState >> 59u);
+	return (xorShifted >> rotation) | (xorShifted << ((~rotation + 1u) & 31));
+}
+
+}
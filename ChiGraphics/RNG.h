@@ -1,25 +1,53 @@
 #pragma once
 
-#include <random>
+#include <cstdint>
 
 namespace CHISTUDIO {
 
-/* Wrapper around the <random> library. 
- * Instantiate with a seed, then call Float() to get the next random number 
+/* Maps 32 random bits to a float in [0,1) using the top 24 bits, so the result can never round up to 1 */
+inline float UInt32ToUnitFloat(uint32_t InBits)
+{
+	return (InBits >> 8) * (1.0f / 16777216.0f);
+}
+
+/* PCG32 random number generator (https://www.pcg-random.org), 16 bytes of state.
+ * Instantiate with a seed and optionally a stream, then call Float() to get the next random number.
+ * When a sampler is attached, Float() instead returns its next sample dimension.
  */
 class RNG
 {
 public:
 	RNG(int InSeed);
-	~RNG();
+	RNG(uint64_t InSeed, uint64_t InStream);
 
 	/* Returns random float [0,1) */
 	float Float();
 
+	/* Returns uniformly distributed 32 bit integer, always from the generator */
+	uint32_t UInt32();
+
+	/* Position in the stream, so a generator can be saved and later continue where it left off. The stream itself is
+	 * not included and must be recreated from the same stream index. */
+	uint64_t GetState() const
+	{
+		return State;
+	}
+
+	void SetState(uint64_t InState)
+	{
+		State = InState;
+	}
+
+	/* Attach a sampler to draw Float() values from, or nullptr to return to independent random numbers */
+	void SetSampler(class ISampler* InSampler)
+	{
+		Sampler = InSampler;
+	}
+
 private:
-	int Seed;
-	std::mt19937 Generator;
-	std::uniform_real_distribution<float> FloatDistribution;
+	uint64_t State;
+	uint64_t Increment;
+	class ISampler* Sampler;
 };
 
 }
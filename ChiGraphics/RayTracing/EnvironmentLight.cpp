@@ -0,0 +1,157 @@
+#include "EnvironmentLight.h"
+#include <algorithm>
+#include "ChiGraphics/Textures/FImage.h"
+#include "ChiGraphics/Utilities.h"
+
+namespace CHISTUDIO {
+
+namespace {
+
+float GetLuminance(const glm::vec3& InColor)
+{
+    return 0.2126f * InColor.x + 0.7152f * InColor.y + 0.0722f * InColor.z;
+}
+
+}
+
+FEnvironmentLight::FEnvironmentLight(const FImage& InImage, float InStrength)
+    : Width((int)InImage.GetWidth()), Height((int)InImage.GetHeight()), TotalWeight(0.0f)
+{
+    Radiance.reserve(InImage.GetData().size());
+    for (const glm::vec3& pixel : InImage.GetData())
+    {
+        Radiance.push_back(pixel * InStrength);
+    }
+
+    // Each cell of a Width x Height grid over the image's [0, 1]^2 coordinates is weighted by the luminance at its center
+    // and by sin(theta), since rows near the poles cover less solid angle
+    ConditionalCDF.resize((size_t)Height * (Width + 1));
+    RowWeights.resize(Height);
+    for (int row = 0; row < Height; row++)
+    {
+        float v = (row + 0.5f) / Height;
+        float sinTheta = glm::sin(v * kPi);
+        float* rowCDF = &ConditionalCDF[(size_t)row * (Width + 1)];
+
+        rowCDF[0] = 0.0f;
+        for (int column = 0; column < Width; column++)
+        {
+            float u = (column + 0.5f) / Width;
+            float weight = GetLuminance(BilinearSample(u * (Width - 1), v * (Height - 1))) * sinTheta;
+            rowCDF[column + 1] = rowCDF[column] + glm::max(weight, 0.0f);
+        }
+
+        RowWeights[row] = rowCDF[Width];
+        for (int column = 1; column <= Width; column++)
+        {
+            rowCDF[column] = RowWeights[row] > 0.0f ? rowCDF[column] / RowWeights[row] : (float)column / Width;
+        }
+        TotalWeight += RowWeights[row];
+    }
+
+    MarginalCDF.resize(Height + 1);
+    MarginalCDF[0] = 0.0f;
+    for (int row = 0; row < Height; row++)
+    {
+        MarginalCDF[row + 1] = MarginalCDF[row] + RowWeights[row];
+    }
+    for (int row = 1; row <= Height; row++)
+    {
+        MarginalCDF[row] = TotalWeight > 0.0f ? MarginalCDF[row] / TotalWeight : (float)row / Height;
+    }
+}
+
+glm::vec3 FEnvironmentLight::Evaluate(const glm::vec3& InDirection) const
+{
+    glm::vec2 uv = DirectionToUV(InDirection);
+    return BilinearSample(uv.x * (Width - 1), uv.y * (Height - 1));
+}
+
+float FEnvironmentLight::Sample(float InU, float InV, glm::vec3& OutDirection) const
+{
+    if (TotalWeight <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    // Pick a row from the marginal CDF, then a column from that row's conditional CDF, keeping the offset within the cell
+    size_t row = FindInterval(MarginalCDF.data(), Height, InV);
+    float rowMass = MarginalCDF[row + 1] - MarginalCDF[row];
+    float rowOffset = rowMass > 0.0f ? (InV - MarginalCDF[row]) / rowMass : 0.5f;
+
+    const float* rowCDF = &ConditionalCDF[row * (Width + 1)];
+    size_t column = FindInterval(rowCDF, Width, InU);
+    float columnMass = rowCDF[column + 1] - rowCDF[column];
+    float columnOffset = columnMass > 0.0f ? (InU - rowCDF[column]) / columnMass : 0.5f;
+
+    float u = (column + glm::clamp(columnOffset, 0.0f, 1.0f)) / Width;
+    float v = (row + glm::clamp(rowOffset, 0.0f, 1.0f)) / Height;
+
+    float theta = v * kPi;
+    float phi = u * 2.0f * kPi - kPi;
+    float sinTheta = glm::sin(theta);
+    if (sinTheta <= 0.0f)
+    {
+        return 0.0f;
+    }
+    OutDirection = glm::vec3(sinTheta * glm::cos(phi), glm::cos(theta), sinTheta * glm::sin(phi));
+
+    // Density over [0, 1]^2 is the cell's share of the weight times the cell count. Map it to solid angle with the
+    // Jacobian of the equirectangular projection, 2 pi^2 sin(theta).
+    float cellWeight = RowWeights[row] * columnMass;
+    float uvPDF = cellWeight / TotalWeight * (float)Width * (float)Height;
+    return uvPDF / (2.0f * kPi * kPi * sinTheta);
+}
+
+float FEnvironmentLight::GetPDF(const glm::vec3& InDirection) const
+{
+    if (TotalWeight <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    float sinTheta = glm::sqrt(glm::max(1.0f - InDirection.y * InDirection.y, 0.0f));
+    if (sinTheta <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    glm::vec2 uv = DirectionToUV(InDirection);
+    int column = glm::min((int)(uv.x * Width), Width - 1);
+    int row = glm::min((int)(uv.y * Height), Height - 1);
+    const float* rowCDF = &ConditionalCDF[(size_t)row * (Width + 1)];
+    float cellWeight = RowWeights[row] * (rowCDF[column + 1] - rowCDF[column]);
+    float uvPDF = cellWeight / TotalWeight * (float)Width * (float)Height;
+    return uvPDF / (2.0f * kPi * kPi * sinTheta);
+}
+
+glm::vec2 FEnvironmentLight::DirectionToUV(const glm::vec3& InDirection)
+{
+    float azimuth = std::atan2(InDirection.z, InDirection.x) + kPi;
+    float polar = std::acos(glm::clamp(InDirection.y, -1.0f, 1.0f));
+    return glm::vec2(azimuth / (kPi * 2.0f), polar / kPi);
+}
+
+size_t FEnvironmentLight::FindInterval(const float* InCDF, size_t InCount, float InValue)
+{
+    // Last CDF entry not above InValue. Zero-width intervals share their start with the next one, so they are skipped.
+    size_t index = std::upper_bound(InCDF, InCDF + InCount + 1, InValue) - InCDF;
+    return glm::clamp(index, (size_t)1, InCount) - 1;
+}
+
+glm::vec3 FEnvironmentLight::BilinearSample(float InX, float InY) const
+{
+    // Coordinates are never negative, so truncation floors them. Columns wrap around, rows are clamped at the poles.
+    int x0 = glm::min((int)InX, Width - 1);
+    int y0 = glm::min((int)InY, Height - 1);
+    int x1 = x0 + 1 < Width ? x0 + 1 : 0;
+    int y1 = glm::min(y0 + 1, Height - 1);
+    float ax = InX - x0;
+    float ay = InY - y0;
+
+    const glm::vec3* row0 = &Radiance[(size_t)y0 * Width];
+    const glm::vec3* row1 = &Radiance[(size_t)y1 * Width];
+    return glm::mix(glm::mix(row0[x0], row0[x1], ax), glm::mix(row1[x0], row1[x1], ax), ay);
+}
+
+}
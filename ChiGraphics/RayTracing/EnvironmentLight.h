@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+namespace CHISTUDIO {
+
+class FImage;
+
+/** HDRI environment prepared for ray tracing. The image is copied once per render with its strength applied, and a
+ *  luminance weighted 2D distribution (a marginal CDF over rows and a conditional CDF per row) is built over it, so
+ *  directions can be importance sampled for next event estimation. Uses the same equirectangular mapping as
+ *  FImage::SampleHDRI.
+ */
+class FEnvironmentLight
+{
+public:
+    FEnvironmentLight(const FImage& InImage, float InStrength);
+
+    // Radiance arriving along InDirection, which must be normalized
+    glm::vec3 Evaluate(const glm::vec3& InDirection) const;
+
+    // Sample a direction toward the environment from two uniform values. Returns the solid angle pdf, 0 if unusable.
+    float Sample(float InU, float InV, glm::vec3& OutDirection) const;
+
+    // Solid angle pdf of Sample producing InDirection, which must be normalized
+    float GetPDF(const glm::vec3& InDirection) const;
+
+private:
+    // Equirectangular coordinates in [0, 1] of a normalized direction
+    static glm::vec2 DirectionToUV(const glm::vec3& InDirection);
+
+    // Index of the CDF interval containing InValue, for a CDF of InCount intervals stored at InCDF
+    static size_t FindInterval(const float* InCDF, size_t InCount, float InValue);
+
+    glm::vec3 BilinearSample(float InX, float InY) const;
+
+    // Radiance with strength applied, row-major
+    std::vector<glm::vec3> Radiance;
+    int Width;
+    int Height;
+
+    // Per row, Width + 1 normalized CDF values over its columns
+    std::vector<float> ConditionalCDF;
+
+    // Sum of each row's weights, before normalizing its conditional CDF
+    std::vector<float> RowWeights;
+
+    // Height + 1 normalized CDF values over rows
+    std::vector<float> MarginalCDF;
+
+    // Sum of every cell weight. Zero if the environment is black, in which case it is never sampled.
+    float TotalWeight;
+};
+
+}
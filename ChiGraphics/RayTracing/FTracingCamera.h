@@ -49,6 +49,12 @@ public:
         return FRay(origin, newDirection);
     }
 
+    // Angle between the rays through neighboring pixels of an image InImageHeight pixels tall, used as the spread of
+    // the ray cones that pick texture filter widths
+    float GetPixelSpreadAngle(int InImageHeight) const {
+        return atanf(2.0f * tanf(FOV_Radian / 2.0f) / glm::max(InImageHeight - 1, 1));
+    }
+
     float GetTMin() const {
         return 0.0f;
     }
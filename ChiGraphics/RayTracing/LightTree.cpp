@@ -0,0 +1,384 @@
+#include "LightTree.h"
+#include <algorithm>
+#include <limits>
+#include <glm/gtx/rotate_vector.hpp>
+#include "ChiGraphics/Collision/Hittables/MeshHittable.h"
+#include "ChiGraphics/Utilities.h"
+
+namespace CHISTUDIO {
+
+namespace {
+
+float GetLuminance(const glm::vec3& InColor)
+{
+    return 0.2126f * InColor.x + 0.7152f * InColor.y + 0.0722f * InColor.z;
+}
+
+float SafeSqrt(float InValue)
+{
+    return glm::sqrt(glm::max(InValue, 0.0f));
+}
+
+// cos(max(0, a - b)) from the sines and cosines of angles a and b in [0, pi]
+float CosSubClamped(float InSinA, float InCosA, float InSinB, float InCosB)
+{
+    if (InCosA > InCosB)
+    {
+        return 1.0f;
+    }
+    return InCosA * InCosB + InSinA * InSinB;
+}
+
+// sin(max(0, a - b)) from the sines and cosines of angles a and b in [0, pi]
+float SinSubClamped(float InSinA, float InCosA, float InSinB, float InCosB)
+{
+    if (InCosA > InCosB)
+    {
+        return 0.0f;
+    }
+    return InSinA * InCosB - InCosA * InSinB;
+}
+
+// Largest uniform values still below 1, so remapped sample values never select past the end of an interval
+const float kOneMinusEpsilon = 1.0f - std::numeric_limits<float>::epsilon() * 0.5f;
+
+}
+
+FLightBounds FLightBounds::Union(const FLightBounds& InA, const FLightBounds& InB)
+{
+    if (InA.Power <= 0.0f)
+    {
+        return InB;
+    }
+    if (InB.Power <= 0.0f)
+    {
+        return InA;
+    }
+
+    FLightBounds result;
+    result.Bounds = InA.Bounds;
+    result.Bounds.UnionWith(InB.Bounds);
+    result.Power = InA.Power + InB.Power;
+    result.CosThetaE = glm::min(InA.CosThetaE, InB.CosThetaE);
+
+    // Smallest cone around both normal cones. Either may already contain the other.
+    float thetaA = glm::acos(glm::clamp(InA.CosThetaO, -1.0f, 1.0f));
+    float thetaB = glm::acos(glm::clamp(InB.CosThetaO, -1.0f, 1.0f));
+    float thetaD = glm::acos(glm::clamp(glm::dot(InA.Axis, InB.Axis), -1.0f, 1.0f));
+    if (glm::min(thetaD + thetaB, kPi) <= thetaA)
+    {
+        result.Axis = InA.Axis;
+        result.CosThetaO = InA.CosThetaO;
+        return result;
+    }
+    if (glm::min(thetaD + thetaA, kPi) <= thetaB)
+    {
+        result.Axis = InB.Axis;
+        result.CosThetaO = InB.CosThetaO;
+        return result;
+    }
+
+    float thetaO = (thetaA + thetaD + thetaB) * 0.5f;
+    glm::vec3 rotationAxis = glm::cross(InA.Axis, InB.Axis);
+    if (thetaO >= kPi || glm::dot(rotationAxis, rotationAxis) <= 0.0f)
+    {
+        result.Axis = InA.Axis;
+        result.CosThetaO = -1.0f;
+        return result;
+    }
+
+    // Rotate A's axis toward B's until the cone's edge reaches A's far edge
+    result.Axis = glm::rotate(InA.Axis, thetaO - thetaA, glm::normalize(rotationAxis));
+    result.CosThetaO = glm::cos(thetaO);
+    return result;
+}
+
+float FLightBounds::Importance(const glm::vec3& InPoint, const glm::vec3& InNormal) const
+{
+    glm::vec3 toPoint = InPoint - Bounds.GetCenter();
+    float distanceSquared = glm::dot(toPoint, toPoint);
+    glm::vec3 directionToPoint = distanceSquared > 0.0f ? toPoint / glm::sqrt(distanceSquared) : Axis;
+
+    // Angle subtended by the bounding sphere of the bounds, seen from the point. Points inside see every direction.
+    float boundingRadius = glm::length(Bounds.GetExtent()) * 0.5f;
+    float cosThetaB = -1.0f;
+    if (distanceSquared > boundingRadius * boundingRadius)
+    {
+        cosThetaB = SafeSqrt(1.0f - boundingRadius * boundingRadius / distanceSquared);
+    }
+    float sinThetaB = SafeSqrt(1.0f - cosThetaB * cosThetaB);
+
+    // Points close to or inside the bounds are not favored beyond the bounds' own size
+    distanceSquared = glm::max(distanceSquared, boundingRadius);
+    if (distanceSquared <= 0.0f)
+    {
+        return Power;
+    }
+
+    // Smallest angle between the direction to the point and any normal in the cone, widened by the subtended angle
+    float cosThetaW = glm::dot(Axis, directionToPoint);
+    float sinThetaW = SafeSqrt(1.0f - cosThetaW * cosThetaW);
+    float sinThetaO = SafeSqrt(1.0f - CosThetaO * CosThetaO);
+    float cosThetaX = CosSubClamped(sinThetaW, cosThetaW, sinThetaO, CosThetaO);
+    float sinThetaX = SinSubClamped(sinThetaW, cosThetaW, sinThetaO, CosThetaO);
+    float cosThetaP = CosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= CosThetaE)
+    {
+        return 0.0f;
+    }
+
+    float importance = Power * cosThetaP / distanceSquared;
+
+    // Foreshortening at the receiving surface, for the most favorable direction toward the bounds. Surfaces may
+    // transmit, so both sides count.
+    if (InNormal != glm::vec3(0.0f))
+    {
+        float cosThetaI = glm::abs(glm::dot(directionToPoint, InNormal));
+        float sinThetaI = SafeSqrt(1.0f - cosThetaI * cosThetaI);
+        importance *= CosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+    }
+    return glm::max(importance, 0.0f);
+}
+
+void FLightTree::Build(const std::vector<FRenderLight>& InLights)
+{
+    Nodes.clear();
+    InfiniteLights.clear();
+    BitTrails.assign(InLights.size(), 0);
+    IsInTree.assign(InLights.size(), false);
+
+    std::vector<std::pair<uint32_t, FLightBounds>> boundedLights;
+    for (uint32_t i = 0; i < (uint32_t)InLights.size(); i++)
+    {
+        if (InLights[i].IsInfinite())
+        {
+            InfiniteLights.push_back(i);
+            continue;
+        }
+
+        // Lights that emit nothing are never picked
+        FLightBounds bounds = GetLightBounds(InLights[i]);
+        if (bounds.Power > 0.0f)
+        {
+            boundedLights.emplace_back(i, bounds);
+            IsInTree[i] = true;
+        }
+    }
+
+    if (boundedLights.size() > 0)
+    {
+        Nodes.reserve(boundedLights.size() * 2 - 1);
+        BuildNode(boundedLights, 0, boundedLights.size(), 0, 0);
+    }
+}
+
+uint32_t FLightTree::BuildNode(std::vector<std::pair<uint32_t, FLightBounds>>& InLights, size_t InBegin, size_t InEnd, uint64_t InBitTrail, int InDepth)
+{
+    uint32_t nodeIndex = (uint32_t)Nodes.size();
+    Nodes.push_back(FNode());
+
+    if (InEnd - InBegin == 1)
+    {
+        Nodes[nodeIndex].Bounds = InLights[InBegin].second;
+        Nodes[nodeIndex].Index = InLights[InBegin].first;
+        Nodes[nodeIndex].bIsLeaf = true;
+        BitTrails[InLights[InBegin].first] = InBitTrail;
+        return nodeIndex;
+    }
+
+    // Median split along the longest axis of the light centers. Halving keeps the depth within the 64 bit trail.
+    AABB centerBounds;
+    for (size_t i = InBegin; i < InEnd; i++)
+    {
+        centerBounds.UnionWith(InLights[i].second.Bounds.GetCenter());
+    }
+    int axis = centerBounds.GetLongestAxis();
+    size_t middle = (InBegin + InEnd) / 2;
+    std::nth_element(InLights.begin() + InBegin, InLights.begin() + middle, InLights.begin() + InEnd,
+        [axis](const std::pair<uint32_t, FLightBounds>& InA, const std::pair<uint32_t, FLightBounds>& InB)
+        {
+            return InA.second.Bounds.GetCenter()[axis] < InB.second.Bounds.GetCenter()[axis];
+        });
+
+    BuildNode(InLights, InBegin, middle, InBitTrail, InDepth + 1);
+    uint32_t secondChild = BuildNode(InLights, middle, InEnd, InBitTrail | (1ull << InDepth), InDepth + 1);
+
+    Nodes[nodeIndex].Bounds = FLightBounds::Union(Nodes[nodeIndex + 1].Bounds, Nodes[secondChild].Bounds);
+    Nodes[nodeIndex].Index = secondChild;
+    Nodes[nodeIndex].bIsLeaf = false;
+    return nodeIndex;
+}
+
+bool FLightTree::Sample(const glm::vec3& InPoint, const glm::vec3& InNormal, float InU, uint32_t& OutLightIndex, float& OutPMF) const
+{
+    if (IsEmpty())
+    {
+        return false;
+    }
+
+    float treeProbability = GetTreeProbability();
+    float infiniteProbability = 1.0f - treeProbability;
+    if (InU < infiniteProbability)
+    {
+        size_t infiniteIndex = glm::min((size_t)(InU / infiniteProbability * InfiniteLights.size()), InfiniteLights.size() - 1);
+        OutLightIndex = InfiniteLights[infiniteIndex];
+        OutPMF = infiniteProbability / InfiniteLights.size();
+        return true;
+    }
+
+    // Reuse what is left of the sample value at every level
+    float u = glm::min((InU - infiniteProbability) / treeProbability, kOneMinusEpsilon);
+    float pmf = treeProbability;
+    uint32_t nodeIndex = 0;
+    while (!Nodes[nodeIndex].bIsLeaf)
+    {
+        uint32_t secondChild = Nodes[nodeIndex].Index;
+        float firstImportance = Nodes[nodeIndex + 1].Bounds.Importance(InPoint, InNormal);
+        float secondImportance = Nodes[secondChild].Bounds.Importance(InPoint, InNormal);
+        if (firstImportance <= 0.0f && secondImportance <= 0.0f)
+        {
+            return false;
+        }
+
+        float firstProbability = firstImportance / (firstImportance + secondImportance);
+        if (u < firstProbability)
+        {
+            nodeIndex = nodeIndex + 1;
+            u = glm::min(u / firstProbability, kOneMinusEpsilon);
+            pmf *= firstProbability;
+        }
+        else
+        {
+            nodeIndex = secondChild;
+            u = glm::min((u - firstProbability) / (1.0f - firstProbability), kOneMinusEpsilon);
+            pmf *= 1.0f - firstProbability;
+        }
+    }
+
+    if (Nodes[nodeIndex].Bounds.Importance(InPoint, InNormal) <= 0.0f)
+    {
+        return false;
+    }
+    OutLightIndex = Nodes[nodeIndex].Index;
+    OutPMF = pmf;
+    return true;
+}
+
+float FLightTree::GetPMF(const glm::vec3& InPoint, const glm::vec3& InNormal, uint32_t InLightIndex) const
+{
+    if (InLightIndex >= IsInTree.size())
+    {
+        return 0.0f;
+    }
+
+    float treeProbability = GetTreeProbability();
+    if (!IsInTree[InLightIndex])
+    {
+        bool bIsInfinite = std::find(InfiniteLights.begin(), InfiniteLights.end(), InLightIndex) != InfiniteLights.end();
+        return bIsInfinite ? (1.0f - treeProbability) / InfiniteLights.size() : 0.0f;
+    }
+
+    // Follow the light's trail from the root, taking the same probabilities Sample would
+    uint64_t bitTrail = BitTrails[InLightIndex];
+    float pmf = treeProbability;
+    uint32_t nodeIndex = 0;
+    while (!Nodes[nodeIndex].bIsLeaf)
+    {
+        uint32_t secondChild = Nodes[nodeIndex].Index;
+        float firstImportance = Nodes[nodeIndex + 1].Bounds.Importance(InPoint, InNormal);
+        float secondImportance = Nodes[secondChild].Bounds.Importance(InPoint, InNormal);
+        if (firstImportance <= 0.0f && secondImportance <= 0.0f)
+        {
+            return 0.0f;
+        }
+
+        bool bTakeSecond = (bitTrail & 1) != 0;
+        pmf *= (bTakeSecond ? secondImportance : firstImportance) / (firstImportance + secondImportance);
+        nodeIndex = bTakeSecond ? secondChild : nodeIndex + 1;
+        bitTrail >>= 1;
+    }
+
+    return Nodes[nodeIndex].Bounds.Importance(InPoint, InNormal) > 0.0f ? pmf : 0.0f;
+}
+
+FLightBounds FLightTree::GetLightBounds(const FRenderLight& InLight)
+{
+    FLightBounds bounds;
+    if (InLight.Type == ELightType::Point)
+    {
+        // Point lights emit Color / (4 pi) in every direction, so their total power is the luminance of Color
+        bounds.Bounds = AABB(InLight.Position - glm::vec3(InLight.Radius), InLight.Position + glm::vec3(InLight.Radius));
+        bounds.Power = glm::max(GetLuminance(InLight.Color), 0.0f);
+        return bounds;
+    }
+
+    if (InLight.Type != ELightType::Hittable || InLight.Hittable == nullptr)
+    {
+        return bounds;
+    }
+
+    const IHittableBase& hittable = *InLight.Hittable;
+    bounds.Bounds = hittable.GetBoundingBox().Transformed(hittable.ModelMatrix);
+
+    // Diffuse emitters leave pi * radiance * area. Meshes measure their world space area and bound their normals, which
+    // lets lights facing away from a point be skipped. Other shapes estimate their area from their bounds, exact for a
+    // sphere, and may face any direction.
+    float area = bounds.Bounds.GetSurfaceArea() * kPi / 6.0f;
+    if (const MeshHittable* mesh = dynamic_cast<const MeshHittable*>(&hittable))
+    {
+        const std::vector<FTrianglePrimitive>& triangles = mesh->GetTriangles();
+        const std::vector<FTriangleAttributes>& attributes = mesh->GetTriangleAttributes();
+        glm::mat3 normalMatrix = glm::mat3(hittable.TransposeInverseModelMatrix);
+        glm::mat3 linearMatrix = glm::mat3(hittable.ModelMatrix);
+
+        // Sampled points use interpolated vertex normals, so those are what the cone must contain
+        std::vector<glm::vec3> normals;
+        normals.reserve(triangles.size() * 3);
+        area = 0.0f;
+        glm::vec3 normalSum(0.0f);
+        for (size_t i = 0; i < triangles.size(); i++)
+        {
+            float triangleArea = 0.5f * glm::length(glm::cross(linearMatrix * triangles[i].Edge1, linearMatrix * triangles[i].Edge2));
+            area += triangleArea;
+            for (int vertex = 0; vertex < 3; vertex++)
+            {
+                glm::vec3 normal = normalMatrix * attributes[i].Normals[vertex];
+                if (glm::dot(normal, normal) > 0.0f)
+                {
+                    normals.push_back(glm::normalize(normal));
+                    normalSum += normals.back() * triangleArea;
+                }
+            }
+        }
+
+        if (glm::dot(normalSum, normalSum) > 0.0f)
+        {
+            bounds.Axis = glm::normalize(normalSum);
+            bounds.CosThetaO = 1.0f;
+            for (const glm::vec3& normal : normals)
+            {
+                bounds.CosThetaO = glm::min(bounds.CosThetaO, glm::dot(bounds.Axis, normal));
+            }
+
+            // Interpolated normals only stay inside cones narrower than a hemisphere
+            if (bounds.CosThetaO <= 0.0f)
+            {
+                bounds.CosThetaO = -1.0f;
+            }
+        }
+    }
+
+    bounds.Power = glm::max(kPi * GetLuminance(InLight.Color) * area, 0.0f);
+    return bounds;
+}
+
+float FLightTree::GetTreeProbability() const
+{
+    if (Nodes.empty())
+    {
+        return 0.0f;
+    }
+    return 1.0f / (InfiniteLights.size() + 1);
+}
+
+}
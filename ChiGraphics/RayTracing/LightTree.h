@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "glm/glm.hpp"
+#include "ChiGraphics/Collision/Hittables/AABB.h"
+#include "ChiGraphics/Lights/LightBase.h"
+
+namespace CHISTUDIO {
+
+class IHittableBase;
+
+/** A light flattened for one render, with everything the tracer needs already in world space. Ambient lights are
+ *  summed separately and never become render lights.
+ */
+struct FRenderLight
+{
+    ELightType Type = ELightType::Point;
+
+    // Diffuse color times intensity for point and directional lights. Albedo times emittance for hittables.
+    glm::vec3 Color = glm::vec3(0.0f);
+
+    // World position of a point light
+    glm::vec3 Position = glm::vec3(0.0f);
+
+    // Radius of a point light, 0 for a true point
+    float Radius = 0.0f;
+
+    // Normalized world direction from a lit point toward a directional light
+    glm::vec3 DirectionToLight = glm::vec3(0.0f, 1.0f, 0.0f);
+
+    // Emitting hittable, owned by the ray tracer for the duration of the render
+    const IHittableBase* Hittable = nullptr;
+
+    // Directional lights are infinitely far away and are picked apart from the tree
+    bool IsInfinite() const {
+        return Type == ELightType::Directional;
+    }
+};
+
+/** Conservative bounds of the light emitted by a set of lights: where it comes from, how much there is, and a cone
+ *  around the surface normals (axis and cosine of its spread) it leaves along. Emission itself may spread up to
+ *  acos(CosThetaE) beyond those normals. Follows the light bounds of Conty and Kulla's many-light sampling.
+ */
+struct FLightBounds
+{
+    AABB Bounds;
+    float Power = 0.0f;
+    glm::vec3 Axis = glm::vec3(0.0f, 0.0f, 1.0f);
+    float CosThetaO = -1.0f;
+    float CosThetaE = 0.0f;
+
+    // Bounds of both sets of lights
+    static FLightBounds Union(const FLightBounds& InA, const FLightBounds& InB);
+
+    // Estimate of how much of the bounded light reaches InPoint, on a surface facing InNormal. Never underestimates
+    // to zero for a light that can reach the point, so sampling by importance stays unbiased.
+    float Importance(const glm::vec3& InPoint, const glm::vec3& InNormal) const;
+};
+
+/** Stochastically picks one light for a shading point, in time logarithmic in the number of lights. Lights with a
+ *  position are stored in a binary tree of FLightBounds and picked by descending toward the child with more importance
+ *  at the shading point. Infinite lights cannot be bounded, so they are picked uniformly, sharing the probability with
+ *  the tree as if it were one more infinite light.
+ */
+class FLightTree
+{
+public:
+    // Build over InLights. Light indices given to and returned by the tree refer to InLights.
+    void Build(const std::vector<FRenderLight>& InLights);
+
+    // Pick a light for the shading point from a uniform value. Returns false if no light can reach the point.
+    bool Sample(const glm::vec3& InPoint, const glm::vec3& InNormal, float InU, uint32_t& OutLightIndex, float& OutPMF) const;
+
+    // Probability of Sample picking InLightIndex for the shading point
+    float GetPMF(const glm::vec3& InPoint, const glm::vec3& InNormal, uint32_t InLightIndex) const;
+
+    bool IsEmpty() const {
+        return Nodes.empty() && InfiniteLights.empty();
+    }
+
+private:
+    struct FNode
+    {
+        FLightBounds Bounds;
+        // Light index for leaves. For interior nodes, index of the second child; the first child directly follows.
+        uint32_t Index;
+        bool bIsLeaf;
+    };
+
+    // Build the subtree over InLights[InBegin, InEnd), returning the index of its root node
+    uint32_t BuildNode(std::vector<std::pair<uint32_t, FLightBounds>>& InLights, size_t InBegin, size_t InEnd, uint64_t InBitTrail, int InDepth);
+
+    static FLightBounds GetLightBounds(const FRenderLight& InLight);
+
+    // Probability of picking the tree over one of the infinite lights
+    float GetTreeProbability() const;
+
+    std::vector<FNode> Nodes;
+    std::vector<uint32_t> InfiniteLights;
+
+    // Per light in the tree, the child taken at each depth on the way from the root (bit set for the second child)
+    std::vector<uint64_t> BitTrails;
+
+    // Whether each light is in the tree, indexed like BitTrails
+    std::vector<bool> IsInTree;
+};
+
+}
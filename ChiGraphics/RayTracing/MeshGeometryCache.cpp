@@ -0,0 +1,86 @@
+#include "MeshGeometryCache.h"
+#include "ChiGraphics/Meshes/VertexObject.h"
+
+namespace CHISTUDIO {
+
+void FMeshGeometryCache::BeginBuild()
+{
+    UsedByHash.clear();
+    BuiltCount = 0;
+    ReusedCount = 0;
+    for (auto& entry : Entries)
+    {
+        entry.second.bUsed = false;
+    }
+}
+
+std::shared_ptr<const FMeshGeometry> FMeshGeometryCache::GetGeometry(const VertexObject& InVertexObject)
+{
+    auto existing = Entries.find(&InVertexObject);
+    if (existing != Entries.end() && existing->second.Revision == InVertexObject.GetRevision())
+    {
+        if (!existing->second.bUsed)
+        {
+            ReusedCount++;
+            MarkUsed(InVertexObject, existing->second);
+        }
+        return existing->second.Geometry;
+    }
+
+    FEntry entry;
+    entry.Revision = InVertexObject.GetRevision();
+    entry.Hash = FMeshGeometry::HashMeshData(InVertexObject.GetPositions(), InVertexObject.GetNormals(), InVertexObject.GetIndices(), InVertexObject.GetTexCoords());
+    entry.bUsed = false;
+
+    // Share the geometry of an identical copy, such as a duplicated node, confirming the hash by comparing the data
+    auto candidates = UsedByHash.equal_range(entry.Hash);
+    for (auto candidate = candidates.first; candidate != candidates.second; ++candidate)
+    {
+        const VertexObject& other = *candidate->second;
+        if (other.GetPositions() == InVertexObject.GetPositions() && other.GetNormals() == InVertexObject.GetNormals()
+            && other.GetIndices() == InVertexObject.GetIndices() && other.GetTexCoords() == InVertexObject.GetTexCoords())
+        {
+            entry.Geometry = Entries[&other].Geometry;
+            break;
+        }
+    }
+
+    if (entry.Geometry)
+    {
+        ReusedCount++;
+    }
+    else
+    {
+        entry.Geometry = std::make_shared<FMeshGeometry>(InVertexObject.GetPositions(), InVertexObject.GetNormals(), InVertexObject.GetIndices(), InVertexObject.GetTexCoords());
+        BuiltCount++;
+    }
+
+    FEntry& stored = Entries[&InVertexObject];
+    stored = entry;
+    MarkUsed(InVertexObject, stored);
+    return stored.Geometry;
+}
+
+void FMeshGeometryCache::EndBuild()
+{
+    for (auto entry = Entries.begin(); entry != Entries.end();)
+    {
+        if (entry->second.bUsed)
+        {
+            ++entry;
+        }
+        else
+        {
+            entry = Entries.erase(entry);
+        }
+    }
+    UsedByHash.clear();
+}
+
+void FMeshGeometryCache::MarkUsed(const VertexObject& InVertexObject, FEntry& InEntry)
+{
+    InEntry.bUsed = true;
+    UsedByHash.insert(std::make_pair(InEntry.Hash, &InVertexObject));
+}
+
+}
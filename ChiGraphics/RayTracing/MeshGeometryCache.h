@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include "ChiGraphics/Collision/Hittables/MeshGeometry.h"
+
+namespace CHISTUDIO {
+
+class VertexObject;
+
+/** Mesh geometry kept across renders. Geometry is looked up by vertex object and reused for as long as the object's
+ *  revision is unchanged, so renders that only change materials, lights or transforms skip rebuilding triangles and
+ *  BVHs. Within a build, vertex objects holding identical data share one geometry.
+ *
+ *  Lookups happen between BeginBuild and EndBuild, once per render. Geometry no longer used by the scene is released
+ *  at EndBuild. Not thread safe.
+ */
+class FMeshGeometryCache
+{
+public:
+    void BeginBuild();
+
+    // Geometry for the current data of InVertexObject, built on a miss
+    std::shared_ptr<const FMeshGeometry> GetGeometry(const VertexObject& InVertexObject);
+
+    // Drop the geometry of vertex objects not looked up since BeginBuild, as they may no longer exist
+    void EndBuild();
+
+    // Statistics of the current or last build
+    size_t GetBuiltCount() const {
+        return BuiltCount;
+    }
+
+    size_t GetReusedCount() const {
+        return ReusedCount;
+    }
+
+private:
+    struct FEntry
+    {
+        uint64_t Revision;
+        size_t Hash;
+        std::shared_ptr<const FMeshGeometry> Geometry;
+        bool bUsed;
+    };
+
+    // Remember InVertexObject as looked up in this build, so later vertex objects with the same data can share its geometry
+    void MarkUsed(const VertexObject& InVertexObject, FEntry& InEntry);
+
+    std::unordered_map<const VertexObject*, FEntry> Entries;
+
+    // Vertex objects looked up in the current build by the hash of their data. Only these are known to still exist, so
+    // only their data is compared against.
+    std::unordered_multimap<size_t, const VertexObject*> UsedByHash;
+
+    size_t BuiltCount = 0;
+    size_t ReusedCount = 0;
+};
+
+}
@@ -7,6 +7,7 @@
 #include "ChiGraphics/Components/MaterialComponent.h"
 #include "ChiGraphics/Components/TracingComponent.h"
 #include "ChiGraphics/RayTracing/FTracingCamera.h"
+#include "ChiGraphics/RayTracing/ShadingPoint.h"
 #include "ChiGraphics/Cameras/TracingCameraNode.h"
 #include "ChiGraphics/GL_Wrapper/FTexture.h"
 #include "ChiGraphics/Utilities.h"
@@ -17,257 +18,772 @@
 #include "core.h"
 #include <chrono>
 #include "ChiGraphics/Textures/ImageManager.h"
+#include "ChiGraphics/Textures/PNGStreamWriter.h"
 #include "ChiCore/ChiStudioApplication.h"
 #include "external/src/oidn/include/OpenImageDenoise/oidn.hpp"
 #include <glm/gtx/matrix_decompose.hpp>
 #include "ChiGraphics/RNG.h"
 #include <ctime>
+#include <unordered_map>
+#include <limits>
 
 namespace CHISTUDIO {
 
-const float FIREFLY_CLAMP = 10.0f;
+// AOVs of every film the ray tracer renders, in this order. Denoised renders add the denoised beauty after them.
+static const int kBeautyAOV = 0;
+static const int kAlbedoAOV = 1;
+static const int kNormalAOV = 2;
+static const int kDepthAOV = 3;
+static const int kSampleCountAOV = 4;
+static const int kDenoisedAOV = 5;
 
-FRayTracer::FRayTracer(FRayTraceSettings InSettings)
-	: Settings(InSettings)
+static std::vector<FRenderAOV> GetRenderAOVs(bool InIsDenoised)
 {
+	std::vector<FRenderAOV> aovs = { { "Beauty", 3 }, { "Albedo", 3 }, { "Normal", 3 }, { "Depth", 1 }, { "SampleCount", 1 } };
+	if (InIsDenoised)
+	{
+		aovs.push_back({ "Denoised", 3 });
+	}
+	return aovs;
 }
 
-static std::mutex RowsCompleteMutex;
+// With a checkpoint, renders take their samples in this many passes, saving the checkpoint between passes when due
+static const int kCheckpointPassCount = 16;
+
+// A refit scene BVH whose cost grows past this multiple of its cost when built is rebuilt instead
+static const float kMaxSceneBVHRefitCostGrowth = 1.5f;
 
-void FRayTracer::RenderRow(size_t InY, std::vector<LightComponent*>* InLights, FTracingCamera* InTracingCamera, FImage* InOutputImage, FImage* InAlbedoImage, FImage* InNormalImage, int InRNGSeed)
+FRayTracer::FRayTracer(FRayTraceSettings InSettings, std::shared_ptr<FMeshGeometryCache> InGeometryCache, std::shared_ptr<FTextureCache> InTextureCache)
+	: Settings(InSettings), GeometryCache(InGeometryCache), TextureCache(InTextureCache)
 {
-	RNG rng = RNG(InRNGSeed);
+	ThreadPool = make_unique<FRenderThreadPool>(Settings.NumThreads);
+	if (Settings.MaxQueuedOutputs > 0)
+	{
+		OutputQueue = make_unique<FRenderOutputQueue>((size_t)Settings.MaxQueuedOutputs);
+	}
+	if (GeometryCache == nullptr)
+	{
+		GeometryCache = std::make_shared<FMeshGeometryCache>();
+	}
+	if (TextureCache == nullptr)
+	{
+		TextureCache = std::make_shared<FTextureCache>((size_t)glm::max(Settings.TextureCacheMegabytes, 1) * 1024 * 1024);
+	}
+}
 
-	for (size_t x = 0; x < Settings.ImageSize.x; x++) {
-		glm::vec3 pixelColor(0.f);
-		glm::vec3 albedo(0.f);
-		glm::vec3 normal(0.f);
-		for (size_t sampleNumber = 0; sampleNumber < Settings.SamplesPerPixel; sampleNumber++)
+std::vector<FRenderTile> FRayTracer::MakeRenderTiles(int InMinRow, int InMaxRow) const
+{
+	int tileSize = std::max(Settings.TileSize, 1);
+	std::vector<FRenderTile> tiles;
+	for (int tileY = InMinRow; tileY < InMaxRow; tileY += tileSize)
+	{
+		for (int tileX = 0; tileX < Settings.ImageSize.x; tileX += tileSize)
 		{
-			double jitterX = Settings.SamplesPerPixel > 1 ? rng.Float() : 0.0;
-			double jitterY = Settings.SamplesPerPixel > 1 ? rng.Float() : 0.0;
+			FRenderTile tile;
+			tile.Min = glm::ivec2(tileX, tileY);
+			tile.Max = glm::min(tile.Min + glm::ivec2(tileSize), glm::ivec2(Settings.ImageSize.x, InMaxRow));
+			tiles.push_back(tile);
+		}
+	}
+	return tiles;
+}
 
-			// Set coords from [ -1, 1 ] for both x and y.
-			float cameraX = ((float(x) + (float)jitterX) / (Settings.ImageSize.x - 1)) * 2 - 1;
-			float cameraY = ((float(InY) + (float)jitterY) / (Settings.ImageSize.y - 1)) * 2 - 1;
+void FRayTracer::RenderTile(const FRenderTile& InTile, FTracingCamera* InTracingCamera, const FRenderTarget& InTarget, uint32_t InSeed, int InSampleLimit)
+{
+	std::unique_ptr<ISampler> sampler = MakeSampler(Settings.SamplerType, InSeed);
+
+	for (int y = InTile.Min.y; y < InTile.Max.y; y++) {
+		for (int x = InTile.Min.x; x < InTile.Max.x; x++) {
+			uint64_t pixelIndex = (uint64_t)y * Settings.ImageSize.x + x;
+			RNG rng = RNG(InSeed, pixelIndex);
+			rng.SetSampler(sampler.get());
+
+			// Without a checkpoint every pixel is finished in one call, so it accumulates on the stack
+			FPixelAccumulator localPixel;
+			FPixelAccumulator& pixel = Checkpoint ? Checkpoint->Pixels[pixelIndex] : localPixel;
+			if (pixel.SampleCount > 0)
+			{
+				rng.SetState(pixel.RNGState);
+			}
 
-			// Use camera coords to generate a ray into the scene
-			FRay cameraToSceneRay = InTracingCamera->GenerateRay(glm::vec2(cameraX, cameraY), rng);
-			glm::vec3 outAlbedo(-1.0f);
-			glm::vec3 outNormal(0.0f);
-			pixelColor += TraceRay(cameraToSceneRay, 0, *InLights, outAlbedo, outNormal, rng);
-			albedo += outAlbedo;
-			normal += outNormal;
-		}
-		float superSamplingScale = 1.0f / Settings.SamplesPerPixel;
-		pixelColor *= superSamplingScale;
-		albedo *= superSamplingScale;
-		if (glm::length(normal) > 0.0000f)
-		{
-			normal = glm::normalize(normal);
+			// A pixel continued from an earlier pass may already have converged
+			bool bIsConverged = Settings.bUseAdaptiveSampling && pixel.SampleCount > 0 && IsPixelConverged(pixel.SampleCount, pixel.LuminanceMean, pixel.LuminanceSquaredDeviationSum);
+			while (!bIsConverged && pixel.SampleCount < InSampleLimit)
+			{
+				if (sampler)
+				{
+					sampler->StartPixelSample(glm::ivec2(x, y), pixel.SampleCount);
+				}
+
+				double jitterX = Settings.SamplesPerPixel > 1 ? rng.Float() : 0.0;
+				double jitterY = Settings.SamplesPerPixel > 1 ? rng.Float() : 0.0;
+
+				// Set coords from [ -1, 1 ] for both x and y.
+				float cameraX = ((float(x) + (float)jitterX) / (Settings.ImageSize.x - 1)) * 2 - 1;
+				float cameraY = ((float(y) + (float)jitterY) / (Settings.ImageSize.y - 1)) * 2 - 1;
+
+				// Use camera coords to generate a ray into the scene
+				FRay cameraToSceneRay = InTracingCamera->GenerateRay(glm::vec2(cameraX, cameraY), rng);
+				glm::vec3 outAlbedo(-1.0f);
+				glm::vec3 outNormal(0.0f);
+				float outDepth = std::numeric_limits<float>::infinity();
+				glm::vec3 sampleColor = TraceRay(cameraToSceneRay, outAlbedo, outNormal, outDepth, rng);
+				pixel.ColorSum += sampleColor;
+				pixel.AlbedoSum += outAlbedo;
+				pixel.NormalSum += outNormal;
+				pixel.MinDepth = std::min(pixel.MinDepth, outDepth);
+				pixel.SampleCount++;
+
+				if (Settings.bUseAdaptiveSampling)
+				{
+					double luminance = 0.2126 * sampleColor.r + 0.7152 * sampleColor.g + 0.0722 * sampleColor.b;
+					double delta = luminance - pixel.LuminanceMean;
+					pixel.LuminanceMean += delta / pixel.SampleCount;
+					pixel.LuminanceSquaredDeviationSum += delta * (luminance - pixel.LuminanceMean);
+					bIsConverged = IsPixelConverged(pixel.SampleCount, pixel.LuminanceMean, pixel.LuminanceSquaredDeviationSum);
+				}
+			}
+			pixel.RNGState = rng.GetState();
+
+			float superSamplingScale = 1.0f / glm::max(pixel.SampleCount, 1);
+			glm::vec3 normal = pixel.NormalSum;
+			if (glm::length(normal) > 0.0000f)
+			{
+				normal = glm::normalize(normal);
+			}
+
+			FRenderFilm& film = *InTarget.Film;
+			int filmY = y - InTarget.FirstRow;
+			film.SetPixel(kBeautyAOV, x, filmY, pixel.ColorSum * superSamplingScale);
+			film.SetPixel(kAlbedoAOV, x, filmY, pixel.AlbedoSum * superSamplingScale);
+			film.SetPixel(kNormalAOV, x, filmY, normal);
+			film.SetPixel(kDepthAOV, x, filmY, pixel.MinDepth);
+			film.SetPixel(kSampleCountAOV, x, filmY, (float)pixel.SampleCount);
 		}
+	}
+}
 
-		InOutputImage->SetPixel(x, InY, pixelColor);
-		InAlbedoImage->SetPixel(x, InY, albedo);
-		InNormalImage->SetPixel(x, InY, normal);
+void FRayTracer::SaveCheckpoint() const
+{
+	// A failed save should not lose the render itself
+	try
+	{
+		Checkpoint->Save(Settings.CheckpointFile);
+	}
+	catch (const std::runtime_error& e)
+	{
+		std::cout << std::endl << e.what() << std::endl;
 	}
-	RowsCompleteMutex.lock();
-	RowsComplete++;
-	std::cout << fmt::format("\rRendered: {:.2f}%", (float)RowsComplete / Settings.ImageSize.y * 100);// << std::endl;
-	RowsCompleteMutex.unlock();
+}
+
+bool FRayTracer::IsPixelConverged(int InSampleCount, double InMean, double InSquaredDeviationSum) const
+{
+	// A variance estimate needs at least two samples
+	if (InSampleCount < std::max(Settings.MinSamplesPerPixel, 2))
+	{
+		return false;
+	}
+
+	if (Settings.TimeBudgetSeconds > 0.0f && std::chrono::steady_clock::now() > RenderDeadline)
+	{
+		return true;
+	}
+
+	// Standard error of the mean, relative to the pixel's brightness. Dark pixels use a floor so they can converge at all.
+	double variance = InSquaredDeviationSum / (InSampleCount - 1);
+	double standardError = glm::sqrt(variance / InSampleCount);
+	return standardError <= Settings.AdaptiveNoiseThreshold * glm::max(InMean, 0.1);
 }
 
 std::unique_ptr<FTexture> FRayTracer::Render(const Scene& InScene, const std::string& InOutputFile)
 {
-	RowsComplete = 0;
 	auto OutputTexture = make_unique<FTexture>();
 	OutputTexture->Reserve(GL_RGB, Settings.ImageSize.x, Settings.ImageSize.y, GL_RGBA, GL_UNSIGNED_BYTE);
 
+	std::unique_ptr<FImage> outputImage = RenderImage(InScene, InOutputFile);
+	if (outputImage == nullptr)
+	{
+		return OutputTexture;
+	}
+
+	// Send pixel data to output texture for viewing
+	OutputTexture->UpdateImage(*outputImage);
+	ImageManager::GetInstance().SetRenderResult(std::move(outputImage));
+
+	return OutputTexture;
+}
+
+std::unique_ptr<FTracingCamera> FRayTracer::PrepareRender(const Scene& InScene)
+{
 	std::unique_ptr<FTracingCamera> tracingCamera = GetFirstTracingCamera(InScene);
 	if (tracingCamera == nullptr)
 	{
 		std::cout << "No tracing camera" << std::endl;
-		return OutputTexture;
+		return nullptr;
 	}
 
-	auto lightComponents = GetLightComponents(InScene);
-	BuildHittableData(InScene, lightComponents);
-	auto outputImage = make_unique<FImage>(Settings.ImageSize.x, Settings.ImageSize.y);
-	auto albedoImage = make_unique<FImage>(Settings.ImageSize.x, Settings.ImageSize.y);
-	auto normalImage = make_unique<FImage>(Settings.ImageSize.x, Settings.ImageSize.y);
+	BuildHittableData(InScene);
+	BuildRenderLights(InScene);
+	PixelSpreadAngle = tracingCamera->GetPixelSpreadAngle(Settings.ImageSize.y);
+	EnvironmentLight = Settings.HDRI != nullptr && Settings.UseHDRI ? make_unique<FEnvironmentLight>(*Settings.HDRI, Settings.HDRIStrength) : nullptr;
+	return tracingCamera;
+}
 
-	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+void FRayTracer::PrintRenderStatistics(std::chrono::steady_clock::duration InRenderTime, double InTotalSamples) const
+{
+	std::cout << std::endl;
+	if (TextureCache->GetTextureCount() > 0)
+	{
+		std::cout << fmt::format("Texture cache: {} tiles loaded, {} evicted, {:.1f} MB peak", TextureCache->GetTileLoadCount(), TextureCache->GetTileEvictionCount(),
+			TextureCache->GetPeakResidentBytes() / (1024.0 * 1024.0)) << std::endl;
+	}
+	std::cout << "Render Time = " << std::chrono::duration_cast<std::chrono::milliseconds>(InRenderTime).count() << "[ms], " 
+		<< std::chrono::duration_cast<std::chrono::seconds>(InRenderTime).count() << "[s]" << std::endl;
 
-	std::cout << "Initializing render threads" << std::endl;
-	for (size_t y = 0; y < Settings.ImageSize.y; y++) 
+	if (Settings.bUseAdaptiveSampling)
 	{
-		Futures.push_back(std::async(std::launch::async, &FRayTracer::RenderRow, this, y, &lightComponents, tracingCamera.get(), outputImage.get(), albedoImage.get(), normalImage.get(), time(NULL) + y * 10000));
+		std::cout << fmt::format("Average samples per pixel = {:.2f}", InTotalSamples / ((double)Settings.ImageSize.x * Settings.ImageSize.y)) << std::endl;
 	}
+}
 
-	for (auto& future : Futures) {
-		future.wait();
+std::unique_ptr<FImage> FRayTracer::RenderImage(const Scene& InScene, const std::string& InOutputFile)
+{
+	std::unique_ptr<FTracingCamera> tracingCamera = PrepareRender(InScene);
+	if (tracingCamera == nullptr)
+	{
+		return nullptr;
 	}
 
-	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+	bool bIsDenoised = Settings.UseIntelDenoise && !InOutputFile.empty();
+	Film = std::make_shared<FRenderFilm>(Settings.ImageSize.x, Settings.ImageSize.y, GetRenderAOVs(bIsDenoised));
 
-	std::cout << std::endl;
-	std::cout << "Render Time = " << std::chrono::duration_cast<std::chrono::milliseconds>(endTime - beginTime).count() << "[ms], " 
-		<< std::chrono::duration_cast<std::chrono::seconds>(endTime - beginTime).count() << "[s]" << std::endl;
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+	RenderDeadline = beginTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(Settings.TimeBudgetSeconds));
 
-	if (InOutputFile.size())
+	std::vector<FRenderTile> tiles = MakeRenderTiles(0, Settings.ImageSize.y);
+	std::cout << fmt::format("Rendering {} tiles on {} threads", tiles.size(), ThreadPool->GetNumThreads()) << std::endl;
+	uint32_t seed = Settings.bUseFixedSeed ? (uint32_t)Settings.Seed : (uint32_t)time(NULL);
+
+	// With a checkpoint, pixels are sampled in passes. Between passes every pixel's state is complete and can be saved.
+	int samplesPerPass = Settings.SamplesPerPixel;
+	Checkpoint = nullptr;
+	if (!Settings.CheckpointFile.empty())
 	{
-		albedoImage->SavePNG(fmt::format("{}_albedo.png", InOutputFile));
+		Checkpoint = make_unique<FRenderCheckpoint>();
+		bool bIsLoaded = Checkpoint->Load(Settings.CheckpointFile);
+		if (bIsLoaded && Checkpoint->ImageSize == Settings.ImageSize && Checkpoint->SamplerType == Settings.SamplerType)
+		{
+			// Pixels continue their RNG streams and sample sequences, which depend on the seed
+			seed = Checkpoint->Seed;
+			std::cout << "Resuming from checkpoint " << Settings.CheckpointFile << std::endl;
+		}
+		else
+		{
+			if (bIsLoaded)
+			{
+				std::cout << "Checkpoint " << Settings.CheckpointFile << " does not match the image size or sampler, starting over" << std::endl;
+			}
+			Checkpoint->ImageSize = Settings.ImageSize;
+			Checkpoint->Seed = seed;
+			Checkpoint->SamplerType = Settings.SamplerType;
+			Checkpoint->Pixels.assign((size_t)Settings.ImageSize.x * Settings.ImageSize.y, FPixelAccumulator());
+		}
+		samplesPerPass = std::max((Settings.SamplesPerPixel + kCheckpointPassCount - 1) / kCheckpointPassCount, 1);
+	}
 
-		// Remap [-1, 1] normals in place to [0, 1]
-		normalImage->RemapNormalData();
-		normalImage->SavePNG(fmt::format("{}_normal.png", InOutputFile));
+	FRenderTarget target;
+	target.Film = Film.get();
 
-		if (Settings.UseIntelDenoise)
+	int passCount = (Settings.SamplesPerPixel + samplesPerPass - 1) / samplesPerPass;
+	std::chrono::steady_clock::time_point lastCheckpointTime = beginTime;
+	for (int pass = 0; pass < passCount; pass++)
+	{
+		int sampleLimit = std::min((pass + 1) * samplesPerPass, Settings.SamplesPerPixel);
+		ThreadPool->Run(tiles.size(),
+			[&](size_t InTileIndex) {
+				RenderTile(tiles[InTileIndex], tracingCamera.get(), target, seed, sampleLimit);
+			},
+			[&](size_t InTilesComplete, size_t InTileCount) {
+				std::cout << fmt::format("\rRendered: {:.2f}%", (pass + (float)InTilesComplete / InTileCount) / passCount * 100);
+			});
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		bool bIsLastPass = pass == passCount - 1;
+		if (Checkpoint && (bIsLastPass || std::chrono::duration<float>(now - lastCheckpointTime).count() >= Settings.CheckpointIntervalSeconds))
 		{
-			std::cout << "Denoising" << std::endl;
-			oidn::DeviceRef device = oidn::newDevice();
-			device.commit();
-			// Create a filter for denoising a beauty (color) image using optional auxiliary images too
-			oidn::FilterRef filter = device.newFilter("RT"); // generic ray tracing filter
-			std::vector<float> dataBuffer = outputImage->ToFloatData();
-			std::vector<float> albedoBuffer = albedoImage->ToFloatData();
-			std::vector<float> normalBuffer = normalImage->ToFloatData();
-			filter.setImage("color", dataBuffer.data(), oidn::Format::Float3, Settings.ImageSize.x, Settings.ImageSize.y); // beauty
-			filter.setImage("albedo", albedoBuffer.data(), oidn::Format::Float3, Settings.ImageSize.x, Settings.ImageSize.y); // auxiliary - albedo map
-			filter.setImage("normal", normalBuffer.data(), oidn::Format::Float3, Settings.ImageSize.x, Settings.ImageSize.y); // auxiliary - normal map
-			filter.setImage("output", dataBuffer.data(), oidn::Format::Float3, Settings.ImageSize.x, Settings.ImageSize.y); // In-place on the beauty image
-			filter.set("hdr", true); // beauty image is HDR
-			filter.commit();
+			SaveCheckpoint();
+			lastCheckpointTime = now;
+		}
+	}
 
-			// Filter the image
-			filter.execute();
+	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
 
-			// Check for errors
-			const char* errorMessage;
-			if (device.getError(errorMessage) != oidn::Error::None)
-				std::cout << "Error: " << errorMessage << std::endl;
+	double totalSamples = 0.0;
+	for (int y = 0; y < Settings.ImageSize.y; y++)
+	{
+		for (int x = 0; x < Settings.ImageSize.x; x++)
+		{
+			totalSamples += *Film->GetPixel(kSampleCountAOV, x, y);
+		}
+	}
+	PrintRenderStatistics(endTime - beginTime, totalSamples);
+
+	if (InOutputFile.empty())
+	{
+		return Film->ToImage(kBeautyAOV);
+	}
+
+	// The output shares the film, so it can finish on the output queue while the next frame traces into a new one
+	std::shared_ptr<FRenderOutput> output = std::make_shared<FRenderOutput>();
+	output->Settings = Settings;
+	output->File = InOutputFile;
+	output->Film = Film;
+	output->Compositor = Settings.UseCompositingNodes ? static_cast<ChiStudioApplication*>(InScene.GetAppRef())->GetImageCompositingWidgetPtr() : nullptr;
+	if (OutputQueue)
+	{
+		// The queued output denoises into its own AOV, so the beauty as traced can be read while it runs
+		std::unique_ptr<FImage> beautyImage = Film->ToImage(kBeautyAOV);
+		OutputQueue->Submit([this, output]() { TryWriteOutput(*output); });
+		return beautyImage;
+	}
+
+	return Film->ToImage(TryWriteOutput(*output));
+}
+
+bool FRayTracer::RenderImageStreamed(const Scene& InScene, const std::string& InOutputFile, int InBandRows)
+{
+	std::unique_ptr<FTracingCamera> tracingCamera = PrepareRender(InScene);
+	if (tracingCamera == nullptr)
+	{
+		return false;
+	}
 
-			outputImage->SetFloatData(dataBuffer, true);
+	if (Settings.UseIntelDenoise || Settings.UseCompositingNodes || Settings.bSaveEXR || !Settings.CheckpointFile.empty())
+	{
+		std::cout << "Denoising, compositing, EXR output and checkpoints need the whole image and are skipped when streaming" << std::endl;
+	}
+	Checkpoint = nullptr;
+	Film = nullptr;
+
+	int width = Settings.ImageSize.x;
+	int height = Settings.ImageSize.y;
+	int bandRows = glm::clamp(InBandRows, 1, height);
+	FRenderFilm bandFilm(width, bandRows, GetRenderAOVs(false));
+	FRenderTarget target;
+	target.Film = &bandFilm;
+
+	// Row y = 0 is the bottom of the image and PNG rows start at the top, so bands are rendered from the top down
+	std::unique_ptr<FPNGStreamWriter> beautyWriter;
+	std::unique_ptr<FPNGStreamWriter> albedoWriter;
+	std::unique_ptr<FPNGStreamWriter> normalWriter;
+	std::unique_ptr<FPNGStreamWriter> sampleCountWriter;
+	try
+	{
+		beautyWriter = make_unique<FPNGStreamWriter>(fmt::format("{}.png", InOutputFile), width, height);
+		albedoWriter = make_unique<FPNGStreamWriter>(fmt::format("{}_albedo.png", InOutputFile), width, height);
+		normalWriter = make_unique<FPNGStreamWriter>(fmt::format("{}_normal.png", InOutputFile), width, height);
+		if (Settings.bUseAdaptiveSampling)
+		{
+			sampleCountWriter = make_unique<FPNGStreamWriter>(fmt::format("{}_samples.png", InOutputFile), width, height);
 		}
+	}
+	catch (const std::runtime_error& e)
+	{
+		std::cout << e.what() << std::endl;
+		return false;
+	}
+	std::vector<uint8_t> rowBytes((size_t)width * 3);
 
-		if (Settings.UseCompositingNodes)
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+	RenderDeadline = beginTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(Settings.TimeBudgetSeconds));
+
+	int bandCount = (height + bandRows - 1) / bandRows;
+	std::cout << fmt::format("Rendering {} bands of {} rows on {} threads", bandCount, bandRows, ThreadPool->GetNumThreads()) << std::endl;
+	uint32_t seed = Settings.bUseFixedSeed ? (uint32_t)Settings.Seed : (uint32_t)time(NULL);
+	double totalSamples = 0.0;
+	try
+	{
+		for (int band = 0; band < bandCount; band++)
 		{
-			auto modifiedImagePtr = FImage::MakeImageCopy(outputImage.get());
-			ChiStudioApplication* chiStudioApp = static_cast<ChiStudioApplication*>(InScene.GetAppRef());
-			WImageCompositor* imageCompositingWidget = chiStudioApp->GetImageCompositingWidgetPtr();
-			imageCompositingWidget->ApplyModifiersToImage(modifiedImagePtr.get());
-			modifiedImagePtr->SavePNG(fmt::format("{}.png", InOutputFile));
+			int maxRow = height - band * bandRows;
+			int minRow = std::max(maxRow - bandRows, 0);
+			target.FirstRow = minRow;
+
+			std::vector<FRenderTile> tiles = MakeRenderTiles(minRow, maxRow);
+			ThreadPool->Run(tiles.size(),
+				[&](size_t InTileIndex) {
+					RenderTile(tiles[InTileIndex], tracingCamera.get(), target, seed, Settings.SamplesPerPixel);
+				},
+				[&](size_t InTilesComplete, size_t InTileCount) {
+					std::cout << fmt::format("\rRendered: {:.2f}%", (band + (float)InTilesComplete / InTileCount) / bandCount * 100);
+				});
+
+			// Normals are remapped from [-1, 1] to [0, 1], and sample counts to [0, 1] of the maximum sample count for viewing
+			for (int y = maxRow - minRow - 1; y >= 0; y--)
+			{
+				bandFilm.GetRowBytes(kBeautyAOV, y, 1.0f, 0.0f, rowBytes.data());
+				beautyWriter->WriteRow(rowBytes.data());
+				bandFilm.GetRowBytes(kAlbedoAOV, y, 1.0f, 0.0f, rowBytes.data());
+				albedoWriter->WriteRow(rowBytes.data());
+				bandFilm.GetRowBytes(kNormalAOV, y, 0.5f, 0.5f, rowBytes.data());
+				normalWriter->WriteRow(rowBytes.data());
+				if (sampleCountWriter)
+				{
+					for (int x = 0; x < width; x++)
+					{
+						totalSamples += *bandFilm.GetPixel(kSampleCountAOV, x, y);
+					}
+					bandFilm.GetRowBytes(kSampleCountAOV, y, 1.0f / Settings.SamplesPerPixel, 0.0f, rowBytes.data());
+					sampleCountWriter->WriteRow(rowBytes.data());
+				}
+			}
 		}
-		else
+
+		beautyWriter->Finish();
+		albedoWriter->Finish();
+		normalWriter->Finish();
+		if (sampleCountWriter)
 		{
-			outputImage->SavePNG(fmt::format("{}.png", InOutputFile));
+			sampleCountWriter->Finish();
 		}
 	}
+	catch (const std::runtime_error& e)
+	{
+		std::cout << std::endl << e.what() << std::endl;
+		return false;
+	}
 
-	// Send pixel data to output texture for viewing
-	OutputTexture->UpdateImage(*outputImage);
-	ImageManager::GetInstance().SetRenderResult(std::move(outputImage));
+	PrintRenderStatistics(std::chrono::steady_clock::now() - beginTime, totalSamples);
+	std::cout << "Saved " << InOutputFile << ".png" << std::endl;
+	return true;
+}
 
-	return OutputTexture;
+int FRayTracer::WriteOutput(FRenderOutput& InOutput)
+{
+	const FRayTraceSettings& settings = InOutput.Settings;
+	const std::string& outputFile = InOutput.File;
+	FRenderFilm& film = *InOutput.Film;
+	if (settings.bUseAdaptiveSampling)
+	{
+		// Scale counts to [0, 1] of the maximum sample count for viewing
+		film.SavePNG(fmt::format("{}_samples.png", outputFile), kSampleCountAOV, 1.0f / settings.SamplesPerPixel);
+	}
+
+	film.SavePNG(fmt::format("{}_albedo.png", outputFile), kAlbedoAOV);
+
+	// Remap [-1, 1] normals to [0, 1]
+	film.SavePNG(fmt::format("{}_normal.png", outputFile), kNormalAOV, 0.5f, 0.5f);
+
+	int finalAOV = kBeautyAOV;
+	if (settings.UseIntelDenoise)
+	{
+		std::cout << "Denoising" << std::endl;
+		oidn::DeviceRef device = oidn::newDevice();
+		device.commit();
+		// Create a filter for denoising a beauty (color) image using optional auxiliary images too. Every image is a view of
+		// its AOV in the film, so nothing is copied.
+		oidn::FilterRef filter = device.newFilter("RT"); // generic ray tracing filter
+		size_t width = (size_t)film.GetWidth();
+		size_t height = (size_t)film.GetHeight();
+		filter.setImage("color", film.GetData(), oidn::Format::Float3, width, height, film.GetAOVByteOffset(kBeautyAOV), film.GetPixelByteStride(), film.GetRowByteStride()); // beauty
+		filter.setImage("albedo", film.GetData(), oidn::Format::Float3, width, height, film.GetAOVByteOffset(kAlbedoAOV), film.GetPixelByteStride(), film.GetRowByteStride()); // auxiliary - albedo map
+		filter.setImage("normal", film.GetData(), oidn::Format::Float3, width, height, film.GetAOVByteOffset(kNormalAOV), film.GetPixelByteStride(), film.GetRowByteStride()); // auxiliary - normal map
+		filter.setImage("output", film.GetData(), oidn::Format::Float3, width, height, film.GetAOVByteOffset(kDenoisedAOV), film.GetPixelByteStride(), film.GetRowByteStride()); // Keeps the beauty as traced
+		filter.set("hdr", true); // beauty image is HDR
+		filter.commit();
+
+		// Filter the image
+		filter.execute();
+
+		// Check for errors
+		const char* errorMessage;
+		if (device.getError(errorMessage) != oidn::Error::None)
+			std::cout << "Error: " << errorMessage << std::endl;
+		else
+			finalAOV = kDenoisedAOV;
+	}
+
+	if (settings.bSaveEXR)
+	{
+		film.SaveEXR(fmt::format("{}.exr", outputFile));
+		std::cout << "Saved " << outputFile << ".exr" << std::endl;
+	}
+
+	if (InOutput.Compositor)
+	{
+		auto modifiedImagePtr = film.ToImage(finalAOV);
+		InOutput.Compositor->ApplyModifiersToImage(modifiedImagePtr.get());
+		modifiedImagePtr->SavePNG(fmt::format("{}.png", outputFile));
+	}
+	else
+	{
+		film.SavePNG(fmt::format("{}.png", outputFile), finalAOV);
+	}
+	std::cout << "Saved " << outputFile << ".png" << std::endl;
+	return finalAOV;
 }
 
-std::vector<LightComponent*> FRayTracer::GetLightComponents(const Scene& InScene)
+int FRayTracer::TryWriteOutput(FRenderOutput& InOutput)
 {
-	auto& root = InScene.GetRootNode();
-	std::vector<LightComponent*> lightComps;
-	for (LightComponent* lightComp : root.GetComponentPtrsInChildren<LightComponent>())
+	// A file that cannot be written should not lose the render itself
+	try
 	{
-		if (lightComp->GetLightType() != ELightType::Hittable)
-		{
-			// Hittable lights are added in the BuildHittableData function
-			lightComps.push_back(lightComp);
-		}
+		return WriteOutput(InOutput);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << std::endl << "Failed to write render output: " << e.what() << std::endl;
+		FailedOutputCount++;
+		return kBeautyAOV;
 	}
-	return lightComps;
 }
 
-void FRayTracer::BuildHittableData(const Scene& InScene, std::vector<LightComponent*>& InLights)
+void FRayTracer::WaitForOutputs()
 {
-	Hittables.clear();
+	if (OutputQueue)
+	{
+		OutputQueue->WaitForAll();
+	}
+}
+
+void FRayTracer::BuildHittableData(const Scene& InScene)
+{
+	Materials.clear();
+	RenderLights.clear();
 	std::cout << "Building hittable data" << std::endl;
 
+	// Textures of images unchanged since the last render are reused. Images edited since then have a new revision, so
+	// they are converted again and their old textures are released at EndBuild.
+	TextureCache->SetMemoryBudget((size_t)glm::max(Settings.TextureCacheMegabytes, 1) * 1024 * 1024);
+	TextureCache->BeginBuild();
+
+	// Materials shared by several nodes only get one entry in the table
+	Materials.push_back(FTracingMaterial(Material()));
+	std::unordered_map<const Material*, uint32_t> materialIndices;
+	auto getMaterialIndex = [&](const SceneNode& InNode) -> uint32_t
+	{
+		MaterialComponent* materialComp = InNode.GetComponentPtr<MaterialComponent>();
+		if (materialComp == nullptr)
+		{
+			return 0;
+		}
+
+		const Material* material = &materialComp->GetMaterial();
+		auto existing = materialIndices.find(material);
+		if (existing != materialIndices.end())
+		{
+			return existing->second;
+		}
+
+		uint32_t index = (uint32_t)Materials.size();
+		Materials.push_back(FTracingMaterial(*material, TextureCache.get()));
+		materialIndices[material] = index;
+		return index;
+	};
+
+	// Emissive hittables with an enabled hittable light are sampled as lights
+	auto addHittableLight = [&](const SceneNode& InNode, const std::shared_ptr<IHittableBase>& InHittable)
+	{
+		InHittable->LightIndex = -1;
+		LightComponent* light = InNode.GetComponentPtr<LightComponent>();
+		if (light == nullptr || light->GetLightType() != ELightType::Hittable || !light->GetLightPtr()->IsLightEnabled())
+		{
+			return;
+		}
+
+		const FTracingMaterial& material = Materials[InHittable->MaterialIndex];
+		if (material.Emittance > 0.0f)
+		{
+			static_cast<HittableLight*>(light->GetLightPtr())->SetHittable(InHittable);
+			InHittable->PrepareSampling();
+			InHittable->LightIndex = (int32_t)RenderLights.size();
+
+			FRenderLight renderLight;
+			renderLight.Type = ELightType::Hittable;
+			renderLight.Color = glm::vec3(material.Albedo) * material.Emittance;
+			renderLight.Hittable = InHittable.get();
+			RenderLights.push_back(renderLight);
+		}
+	};
+
 	auto& root = InScene.GetRootNode();
 	std::vector<RenderingComponent*> renderingComps = root.GetComponentPtrsInChildren<RenderingComponent>();
 	std::vector<TracingComponent*> tracingComps = root.GetComponentPtrsInChildren<TracingComponent>();
 
+	// Hittables are made in this order, which is also the order SceneBVH is built from
+	std::vector<FHittableSource> sources;
 	for (RenderingComponent* renderingComp : renderingComps)
 	{
 		if (!renderingComp->bIsDebugRender)
 		{
 			VertexObject* vertexObject = renderingComp->GetVertexObjectPtr();
 			if (vertexObject->GetPositions().size() == 0) continue;
-			std::cout << "Building hittable for " << renderingComp->GetNodePtr()->GetNodeName() << std::endl;
-			std::shared_ptr<MeshHittable> hittable = std::make_shared<MeshHittable>(vertexObject->GetPositions(), vertexObject->GetNormals(), vertexObject->GetIndices(), vertexObject->GetTexCoords());
-
-			hittable->ModelMatrix = renderingComp->GetNodePtr()->GetTransform().GetLocalToWorldMatrix();
-			hittable->InverseModelMatrix = glm::inverse(hittable->ModelMatrix);
-			hittable->TransposeInverseModelMatrix = glm::transpose(hittable->InverseModelMatrix);
-
-			if (auto materialComp = renderingComp->GetNodePtr()->GetComponentPtr<MaterialComponent>())
-			{
-				hittable->Material_ = materialComp->GetMaterial();
-			}
-			else
-			{
-				hittable->Material_ = Material();
-			}
-
-			if (auto light = renderingComp->GetNodePtr()->GetComponentPtr<LightComponent>())
-			{
-				if (light->GetLightType() == ELightType::Hittable)
-				{
-					if (light->GetLightPtr()->IsLightEnabled() && hittable->Material_.GetEmittance() > 0.0f)
-					{
-						auto hittableLight = static_cast<HittableLight*>(light->GetLightPtr());
-						hittableLight->SetHittable(hittable);
-						InLights.emplace_back(light);
-					}
-				}
-			}
+			sources.push_back(FHittableSource{ renderingComp->GetNodePtr(), vertexObject, vertexObject->GetRevision() });
+		}
+	}
+	for (TracingComponent* tracingComp : tracingComps)
+	{
+		sources.push_back(FHittableSource{ tracingComp->GetNodePtr(), tracingComp->Hittable.get(), 0 });
+	}
 
-			Hittables.emplace_back(hittable);
-			//std::cout << "Added" << std::endl;
+	// When the same nodes render the same shapes as last render, as between the frames of an animation that keys
+	// transforms and materials, the hittables are kept and only their transforms, materials and lights are updated
+	std::vector<std::shared_ptr<IHittableBase>> hittables(sources.size());
+	bool bIsUpdate = !sources.empty() && sources == HittableSources;
+	if (bIsUpdate)
+	{
+		// Hittables is in leaf order, undo it to line up with the sources
+		const std::vector<uint32_t>& primitiveOrder = SceneBVH.GetPrimitiveOrder();
+		for (size_t slot = 0; slot < Hittables.size(); slot++)
+		{
+			hittables[primitiveOrder[slot]] = Hittables[slot];
+		}
+		std::cout << fmt::format("Updating {} hittables", hittables.size()) << std::endl;
+	}
+	else
+	{
+		// Mesh geometry is built once and instanced by every node that renders the same, or identical, vertex data.
+		// Geometry of vertex objects unchanged since the last render is reused.
+		GeometryCache->BeginBuild();
+		size_t meshInstanceCount = sources.size() - tracingComps.size();
+		for (size_t i = 0; i < meshInstanceCount; i++)
+		{
+			std::cout << "Building hittable for " << sources[i].Node->GetNodeName() << std::endl;
+			hittables[i] = std::make_shared<MeshHittable>(GeometryCache->GetGeometry(*static_cast<const VertexObject*>(sources[i].Shape)));
 		}
+		GeometryCache->EndBuild();
 
+		for (size_t i = meshInstanceCount; i < sources.size(); i++)
+		{
+			hittables[i] = tracingComps[i - meshInstanceCount]->Hittable;
+		}
+		if (meshInstanceCount > 0)
+		{
+			std::cout << fmt::format("Built {} meshes and reused {} for {} mesh instances", GeometryCache->GetBuiltCount(), GeometryCache->GetReusedCount(), meshInstanceCount) << std::endl;
+		}
 	}
 
-	for (TracingComponent* tracingComp : tracingComps)
+	for (size_t i = 0; i < sources.size(); i++)
 	{
-		std::shared_ptr<IHittableBase> hittable = tracingComp->Hittable;
+		const std::shared_ptr<IHittableBase>& hittable = hittables[i];
+		const SceneNode& node = *sources[i].Node;
 
-		hittable->ModelMatrix = tracingComp->GetNodePtr()->GetTransform().GetLocalToWorldMatrix();
+		hittable->ModelMatrix = node.GetTransform().GetLocalToWorldMatrix();
 		hittable->InverseModelMatrix = glm::inverse(hittable->ModelMatrix);
 		hittable->TransposeInverseModelMatrix = glm::transpose(hittable->InverseModelMatrix);
 
-		if (auto materialComp = tracingComp->GetNodePtr()->GetComponentPtr<MaterialComponent>())
+		hittable->MaterialIndex = getMaterialIndex(node);
+		addHittableLight(node, hittable);
+	}
+
+	TextureCache->EndBuild();
+	if (TextureCache->GetTextureCount() > 0)
+	{
+		std::cout << fmt::format("Built {} textures and reused {}", TextureCache->GetBuiltCount(), TextureCache->GetReusedCount()) << std::endl;
+	}
+
+	HittableSources = std::move(sources);
+	if (bIsUpdate)
+	{
+		RefitSceneBVH(std::move(hittables));
+	}
+	else
+	{
+		BuildSceneBVH(std::move(hittables));
+	}
+}
+
+void FRayTracer::BuildRenderLights(const Scene& InScene)
+{
+	AmbientColor = glm::vec3(0.0f);
+	for (LightComponent* lightComp : InScene.GetRootNode().GetComponentPtrsInChildren<LightComponent>())
+	{
+		LightBase* light = lightComp->GetLightPtr();
+		if (!light->IsLightEnabled())
 		{
-			hittable->Material_ = materialComp->GetMaterial();
+			continue;
 		}
-		else
+
+		FRenderLight renderLight;
+		renderLight.Type = light->GetType();
+		renderLight.Color = light->GetDiffuseColor() * light->GetIntensity();
+		if (renderLight.Type == ELightType::Ambient)
 		{
-			hittable->Material_ = Material();
+			// Ambient light is unshadowed and the same everywhere, so it is never sampled
+			AmbientColor += light->GetDiffuseColor();
+			continue;
 		}
-
-		if (auto light = tracingComp->GetNodePtr()->GetComponentPtr<LightComponent>())
+		else if (renderLight.Type == ELightType::Point)
 		{
-			if (light->GetLightType() == ELightType::Hittable)
-			{
-				if (light->GetLightPtr()->IsLightEnabled() && hittable->Material_.GetEmittance() > 0.0f)
-				{
-					auto hittableLight = static_cast<HittableLight*>(light->GetLightPtr());
-					hittableLight->SetHittable(hittable);
-					InLights.emplace_back(light);
-				}
-			}
+			renderLight.Position = lightComp->GetNodePtr()->GetTransform().GetWorldPosition();
+			renderLight.Radius = static_cast<PointLight*>(light)->GetRadius();
+		}
+		else if (renderLight.Type == ELightType::Directional)
+		{
+			glm::vec3 direction = glm::mat4_cast(lightComp->GetNodePtr()->GetTransform().GetRotation()) * glm::vec4(static_cast<DirectionalLight*>(light)->BaseDirection, 0.0f);
+			renderLight.DirectionToLight = -glm::normalize(direction);
 		}
+		else
+		{
+			// Hittable lights were added by BuildHittableData
+			continue;
+		}
+		RenderLights.push_back(renderLight);
+	}
+
+	LightTree.Build(RenderLights);
+	std::cout << fmt::format("Built light tree over {} lights", RenderLights.size()) << std::endl;
+}
 
-		Hittables.emplace_back(hittable);
+void FRayTracer::BuildSceneBVH(std::vector<std::shared_ptr<IHittableBase>> InHittables)
+{
+	std::vector<AABB> worldBounds;
+	worldBounds.reserve(InHittables.size());
+	for (const std::shared_ptr<IHittableBase>& hittable : InHittables)
+	{
+		worldBounds.push_back(hittable->GetBoundingBox().Transformed(hittable->ModelMatrix));
 	}
+
+	SceneBVH.Build(worldBounds);
+
+	// Store hittables in leaf order so the BVH leaves can index them directly
+	Hittables.clear();
+	Hittables.reserve(InHittables.size());
+	for (uint32_t index : SceneBVH.GetPrimitiveOrder())
+	{
+		Hittables.push_back(InHittables[index]);
+	}
+	SceneBVHBuildCost = SceneBVH.GetCost();
+	std::cout << fmt::format("Built scene BVH over {} hittables ({} nodes)", Hittables.size(), SceneBVH.GetNodes().size()) << std::endl;
+}
+
+void FRayTracer::RefitSceneBVH(std::vector<std::shared_ptr<IHittableBase>> InHittables)
+{
+	// Bounds are indexed like the array the BVH was built from, which is the order InHittables is in
+	std::vector<AABB> worldBounds;
+	worldBounds.reserve(InHittables.size());
+	for (const std::shared_ptr<IHittableBase>& hittable : InHittables)
+	{
+		worldBounds.push_back(hittable->GetBoundingBox().Transformed(hittable->ModelMatrix));
+	}
+	SceneBVH.Refit(worldBounds);
+
+	// Objects that moved far from where the tree was built leave it with large, overlapping nodes
+	float cost = SceneBVH.GetCost();
+	if (cost > SceneBVHBuildCost * kMaxSceneBVHRefitCostGrowth)
+	{
+		std::cout << fmt::format("Refit scene BVH cost grew from {:.1f} to {:.1f}, rebuilding", SceneBVHBuildCost, cost) << std::endl;
+		BuildSceneBVH(std::move(InHittables));
+		return;
+	}
+
+	// The refit tree keeps its leaves, so Hittables goes back to the order they were built in
+	const std::vector<uint32_t>& primitiveOrder = SceneBVH.GetPrimitiveOrder();
+	for (size_t slot = 0; slot < Hittables.size(); slot++)
+	{
+		Hittables[slot] = InHittables[primitiveOrder[slot]];
+	}
+	std::cout << fmt::format("Refit scene BVH over {} hittables", Hittables.size()) << std::endl;
 }
 
 std::unique_ptr<FTracingCamera> FRayTracer::GetFirstTracingCamera(const Scene& InScene)
@@ -288,17 +804,49 @@ std::unique_ptr<FTracingCamera> FRayTracer::GetFirstTracingCamera(const Scene& I
 	return nullptr;
 }
 
-glm::dvec3 FRayTracer::TraceRay(const FRay& InRay, size_t InBounces, std::vector<LightComponent*> InLights, glm::vec3& OutAlbedo, glm::vec3& OutNormal, RNG& InRNG)
+glm::dvec3 FRayTracer::TraceRay(const FRay& InRay, glm::vec3& OutAlbedo, glm::vec3& OutNormal, float& OutDepth, RNG& InRNG)
 {
-	FHitRecord record;
-    bool objectHit = GetClosestObjectHit(InRay, record, nullptr);
-
-	if (objectHit) 
+	glm::dvec3 radiance(0.0);
+	glm::dvec3 throughput(1.0);
+	FRay ray = InRay;
+	double lastBSDFPDF = 0.0; // Pdf of the BSDF sample that produced the current ray, for weighting light it hits
+	float coneWidth = 0.0f; // Width of the ray cone around the path, which spreads by PixelSpreadAngle per unit distance
+	glm::vec3 previousPosition(0.0f);
+	glm::vec3 previousNormal(0.0f);
+
+	for (size_t bounce = 0; ; bounce++)
 	{
+		FHitRecord record;
+		if (!GetClosestObjectHit(ray, record, nullptr))
+		{
+			glm::vec3 backgroundColor = GetBackgroundColor(ray.GetDirection());
+			// Record albedo of first hit
+			if (OutAlbedo.x < 0.0f)
+			{
+				OutAlbedo = backgroundColor;
+			}
+			// Paths that bounced could also have reached the environment through next event estimation
+			double misWeight = 1.0;
+			if (EnvironmentLight && bounce > 0)
+			{
+				misWeight = PowerHeuristic(lastBSDFPDF, EnvironmentLight->GetPDF(ray.GetDirection()));
+			}
+			radiance += ClampIndirect(throughput * glm::dvec3(backgroundColor) * misWeight, bounce);
+			break;
+		}
+
+		// Every texture the material uses is sampled once here, for all shading at this vertex. Textures are filtered over
+		// the cone's footprint, stretched by the surface's tilt. Bounces treat surfaces as flat, keeping the cone's spread.
+		glm::dvec3 hitPosition = ray.At(record.Time);
+		glm::vec3 towardViewer = -glm::normalize(ray.GetDirection());
+		coneWidth += PixelSpreadAngle * record.Time;
+		float footprint = record.UVScale * coneWidth / glm::max(glm::abs(glm::dot(towardViewer, record.Normal)), 0.1f);
+		FShadingPoint shadingPoint(Materials[record.MaterialIndex], record, hitPosition, towardViewer, footprint);
+
 		// Record albedo of first hit. Initial value is set to negative
 		if (OutAlbedo.x < 0.0f)
 		{
-			OutAlbedo = record.Material_.SampleAlbedo(record.UV);
+			OutAlbedo = shadingPoint.BSDF.Albedo;
 		}
 
 		// Record normal of first hit. Initial value is set to length = 0.0f
@@ -307,169 +855,219 @@ glm::dvec3 FRayTracer::TraceRay(const FRay& InRay, size_t InBounces, std::vector
 			OutNormal = record.Normal;
 		}
 
-		// Get rays
-		glm::dvec3 hitPosition = InRay.At(record.Time);
-		glm::dvec3 eyeRay = glm::normalize(glm::dvec3(InRay.GetOrigin()) - hitPosition);
+		// Camera rays are normalized, so the hit time is the distance to the first hit
+		if (bounce == 0)
+		{
+			OutDepth = record.Time;
+		}
 
-		// Initialize color from emission first
-		glm::dvec3 overallIntensity = (double)record.Material_.SampleEmittance(record.UV) * record.Material_.SampleAlbedo(record.UV);
+		// Emission and direct lighting at this vertex, weighted by everything the path has passed through so far
+		glm::dvec3 emission = glm::dvec3(shadingPoint.Emission);
+		if (bounce > 0 && emission != glm::dvec3(0.0))
+		{
+			emission *= GetEmissionMISWeight(record, hitPosition, glm::dvec3(ray.GetDirection()), previousPosition, previousNormal, lastBSDFPDF);
+		}
+		glm::dvec3 directLighting = GetDirectLighting(shadingPoint, bounce < Settings.MaxBounces, InRNG);
+		if (EnvironmentLight)
+		{
+			directLighting += GetEnvironmentLighting(shadingPoint, bounce < Settings.MaxBounces, InRNG);
+		}
+		radiance += ClampIndirect(throughput * (emission + directLighting), bounce);
 
-		for (LightComponent* lightComp : InLights) {
+		if (bounce >= Settings.MaxBounces)
+		{
+			break;
+		}
 
-			if (!lightComp->GetLightPtr()->IsLightEnabled()) continue;
+		// Let's trace!
+		glm::vec3 sampledRayDirection;
+		float rayProbability;
+		if (!shadingPoint.SampleBSDF(sampledRayDirection, rayProbability, InRNG))
+		{
+			break;
+		}
 
-			// Set up light variables and check for ambient light strength/Color
-			if (lightComp->GetLightPtr()->GetType() == ELightType::Ambient) {
-				overallIntensity += glm::dvec3(lightComp->GetLightPtr()->GetDiffuseColor()) * record.Material_.SampleAlbedo(record.UV);
-			}
-			else
+		glm::vec3 bsdf = shadingPoint.EvaluateBSDF(sampledRayDirection);
+		glm::dvec3 pathWeight = glm::dvec3(bsdf * glm::abs(glm::dot(sampledRayDirection, record.Normal)) / rayProbability);
+		if (glm::any(glm::isnan(pathWeight)))
+		{
+			break;
+		}
+		throughput *= pathWeight;
+		lastBSDFPDF = rayProbability;
+		previousPosition = glm::vec3(hitPosition);
+		previousNormal = record.Normal;
+
+		// Russian roulette: after the minimum depth, continue with probability proportional to the throughput and
+		// reweight surviving paths so the estimate stays unbiased
+		if (bounce + 1 >= Settings.RussianRouletteStartBounce)
+		{
+			double survivalProbability = glm::min(glm::max(throughput.x, glm::max(throughput.y, throughput.z)), 0.95);
+			if (survivalProbability <= 0.0 || InRNG.Float() >= survivalProbability)
 			{
-				glm::dvec3 directionToLight;
-				glm::dvec3 lightIntensity;
-				double distanceToLight;
-				GetIllumination(*lightComp, hitPosition, directionToLight, lightIntensity, distanceToLight, InRNG);
+				break;
+			}
+			throughput /= survivalProbability;
+		}
 
-				FHitRecord shadowRecord;
-				FRay shadowRay = FRay(hitPosition, directionToLight);
+		ray = FRay(hitPosition, sampledRayDirection);
+	}
 
-				// When using hittable lights, we pass it in as a mask to ignore
-				std::shared_ptr<IHittableBase> toIgnore = nullptr;
-				if (lightComp->GetLightType() == ELightType::Hittable) 
-				{
-					HittableLight* hittableLight = static_cast<HittableLight*>(lightComp->GetLightPtr());
-					toIgnore = hittableLight->GetHittable();
-				}
+	return radiance;
+}
 
-				bool wasShadowObjectHit = GetClosestObjectHit(shadowRay, shadowRecord, toIgnore);
-				double distanceToHit = glm::length((double)shadowRecord.Time * directionToLight);
-				if (!wasShadowObjectHit || distanceToHit > distanceToLight)
-				{
-					// No object casting a shadow
-					glm::dvec3 illumination = record.Material_.EvaluateBSDF(record.Normal, eyeRay, directionToLight, record.UV, InRNG);
-					overallIntensity += illumination * lightIntensity * glm::dot(directionToLight, glm::dvec3(record.Normal));
-				}
-				else
-				{
-					//std::cout << "In Shadow" << std::endl;
-				}
-			}
+glm::dvec3 FRayTracer::GetDirectLighting(const FShadingPoint& InShadingPoint, bool InWillSampleBSDF, RNG& InRNG)
+{
+	glm::dvec3 directLighting = glm::dvec3(AmbientColor * InShadingPoint.BSDF.Albedo);
+	if (LightTree.IsEmpty())
+	{
+		return directLighting;
+	}
+
+	// Each light sample picks one light, weighted by the probability the tree gave it, and averages with the others
+	int lightSampleCount = glm::max(Settings.LightSamplesPerHit, 1);
+	glm::dvec3 sampledLighting(0.0);
+	for (int lightSample = 0; lightSample < lightSampleCount; lightSample++)
+	{
+		uint32_t lightIndex;
+		float lightPMF;
+		if (!LightTree.Sample(glm::vec3(InShadingPoint.Position), InShadingPoint.Normal, InRNG.Float(), lightIndex, lightPMF))
+		{
+			continue;
+		}
+		const FRenderLight& light = RenderLights[lightIndex];
+
+		glm::dvec3 directionToLight;
+		glm::dvec3 lightIntensity;
+		double distanceToLight;
+		float lightPDF;
+		GetIllumination(light, InShadingPoint.Position, directionToLight, lightIntensity, distanceToLight, lightPDF, InRNG);
+		if (lightIntensity == glm::dvec3(0.0))
+		{
+			continue;
 		}
 
-		if (InBounces < Settings.MaxBounces)
+		// The shadow ray direction is normalized, so hit times are distances. A hittable light must not shadow itself.
+		FRay shadowRay = FRay(InShadingPoint.Position, directionToLight);
+		if (!IsOccluded(shadowRay, (float)distanceToLight, light.Hittable))
 		{
-			// Let's trace!
-			glm::dvec3 sampledRayDirection;
-			double rayProbability;
+			glm::vec3 incident = glm::vec3(directionToLight);
+			glm::dvec3 illumination = glm::dvec3(InShadingPoint.EvaluateBSDF(incident));
 
-			if (record.Material_.SampleHemisphere(sampledRayDirection, rayProbability, record.Normal, eyeRay, record.UV, InRNG))
+			// Every light sample adds to the density of light sampling, which competes with the one BSDF sample
+			double misWeight = 1.0;
+			if (InWillSampleBSDF && lightPDF > 0.0f)
 			{
-				glm::dvec3 indirect = record.Material_.EvaluateBSDF(record.Normal, eyeRay, sampledRayDirection, record.UV, InRNG);
-
-				FRay tracedRay = FRay(hitPosition, sampledRayDirection);
-				glm::dvec3 traceResult = TraceRay(tracedRay, InBounces + 1, InLights, OutAlbedo, OutNormal, InRNG);
-				glm::dvec3 term = indirect * traceResult;
-				glm::dvec3 indirectIllumination = 1.0 / rayProbability * term * glm::abs(glm::dot(sampledRayDirection, glm::dvec3(record.Normal)));
-
-				if (glm::isnan(indirectIllumination.x))
-				{
-					return overallIntensity;
-				}
-				else
-				{
-					overallIntensity.x += glm::min((float)indirectIllumination.x, FIREFLY_CLAMP);
-					overallIntensity.y += glm::min((float)indirectIllumination.y, FIREFLY_CLAMP);
-					overallIntensity.z += glm::min((float)indirectIllumination.z, FIREFLY_CLAMP);
-				}
+				double bsdfPDF = InShadingPoint.EvaluatePDF(incident);
+				misWeight = PowerHeuristic((double)lightSampleCount * lightPMF * lightPDF, bsdfPDF);
 			}
-			
+			sampledLighting += illumination * lightIntensity * glm::abs(glm::dot(directionToLight, glm::dvec3(InShadingPoint.Normal))) * misWeight / (double)lightPMF;
 		}
+	}
+	return directLighting + sampledLighting / (double)lightSampleCount;
+}
 
-		return overallIntensity;
-    }
-    else 
+double FRayTracer::GetEmissionMISWeight(const FHitRecord& InRecord, const glm::dvec3& InHitPosition, const glm::dvec3& InRayDirection, const glm::vec3& InPreviousPosition, const glm::vec3& InPreviousNormal, double InBSDFPDF) const
+{
+	// Emitters without a light, and the back of one-sided emitters, are only ever found by BSDF sampling
+	if (InRecord.LightIndex < 0 || glm::dot(InRayDirection, glm::dvec3(InRecord.Normal)) >= 0.0)
 	{
-		glm::vec3 backgroundColor = GetBackgroundColor(InRay.GetDirection());
-		// Record albedo of first hit
-		if (OutAlbedo.x < 0.0f)
-		{
-			OutAlbedo = backgroundColor;
-		}
-		return backgroundColor;
-    }
+		return 1.0;
+	}
+
+	const FRenderLight& light = RenderLights[InRecord.LightIndex];
+	double lightPDF = (double)LightTree.GetPMF(InPreviousPosition, InPreviousNormal, (uint32_t)InRecord.LightIndex)
+		* light.Hittable->GetSamplePDF(InPreviousPosition, glm::vec3(InHitPosition), InRecord.Normal);
+	return PowerHeuristic(InBSDFPDF, glm::max(Settings.LightSamplesPerHit, 1) * lightPDF);
+}
+
+glm::dvec3 FRayTracer::ClampIndirect(const glm::dvec3& InContribution, size_t InBounce) const
+{
+	if (InBounce == 0 || Settings.FireflyClamp <= 0.0f)
+	{
+		return InContribution;
+	}
+	return glm::min(InContribution, glm::dvec3(Settings.FireflyClamp));
 }
 
 glm::vec3 FRayTracer::GetBackgroundColor(const glm::vec3& InDirection) const
 {
-	if (Settings.HDRI != nullptr && Settings.UseHDRI)
+	if (EnvironmentLight)
 	{
-		return Settings.HDRI->SampleHDRI(InDirection) * Settings.HDRIStrength;
+		return EnvironmentLight->Evaluate(InDirection);
 	}
 	return Settings.BackgroundColor;
 }
 
-void FRayTracer::GetIllumination(const LightComponent& lightComponent, const glm::dvec3& hitPos, glm::dvec3& directionToLight, glm::dvec3& intensity, double& distanceToLight, RNG& InRNG)
+glm::dvec3 FRayTracer::GetEnvironmentLighting(const FShadingPoint& InShadingPoint, bool InWillSampleBSDF, RNG& InRNG)
 {
-	auto lightPtr = lightComponent.GetLightPtr();
-	if (lightPtr->GetType() == ELightType::Directional) 
+	float u = InRNG.Float();
+	float v = InRNG.Float();
+	glm::vec3 directionToLight;
+	float lightPDF = EnvironmentLight->Sample(u, v, directionToLight);
+	if (lightPDF <= 0.0f)
 	{
-		auto directionalLightPtr = static_cast<DirectionalLight*>(lightPtr);
-		glm::vec3 direction = glm::mat4_cast(lightComponent.GetNodePtr()->GetTransform().GetRotation()) * glm::vec4(directionalLightPtr->BaseDirection, 0.0f);
-		distanceToLight = 200000.0f;
-		directionToLight = direction * -1.0f;
-		intensity = directionalLightPtr->GetDiffuseColor() * directionalLightPtr->GetIntensity();
+		return glm::dvec3(0.0);
 	}
-	else if (lightPtr->GetType() == ELightType::Point) 
+
+	glm::vec3 bsdf = InShadingPoint.EvaluateBSDF(directionToLight);
+	if (bsdf == glm::vec3(0.0f) || glm::any(glm::isnan(bsdf)))
 	{
-		//https://developer.blender.org/diffusion/C/browse/master/src/kernel/light/light.h Reference blender's light sampling code for point light with radius
-		auto pointLightPtr = static_cast<PointLight*>(lightPtr);
-		glm::dvec3 center = lightComponent.GetNodePtr()->GetTransform().GetWorldPosition();
-		float radius = pointLightPtr->GetRadius();
-		float pdf = 1.0f;
-		glm::vec3 normalOnLight = glm::normalize(hitPos - center);
-		float inverseArea = 1.0f; // Default to 1.0f
-		if (radius > 0.0f)
-		{
-			inverseArea = 1.0f / (kPi * radius * radius);
-			center += DiskLightSample(normalOnLight, InRNG.Float(), InRNG.Float()) * radius;
-			pdf = 1.0f / (kPi * radius * radius);
-		}
+		return glm::dvec3(0.0);
+	}
+
+	if (IsOccluded(FRay(InShadingPoint.Position, directionToLight), std::numeric_limits<float>::max(), nullptr))
+	{
+		return glm::dvec3(0.0);
+	}
 
-		directionToLight = glm::normalize(center - hitPos);
-		distanceToLight = glm::length(center - hitPos);
+	double misWeight = 1.0;
+	if (InWillSampleBSDF)
+	{
+		misWeight = PowerHeuristic(lightPDF, InShadingPoint.EvaluatePDF(directionToLight));
+	}
+	double cosine = glm::abs(glm::dot(directionToLight, InShadingPoint.Normal));
+	return glm::dvec3(bsdf * EnvironmentLight->Evaluate(directionToLight)) * cosine * misWeight / (double)lightPDF;
+}
 
-		// Calculate lamp light pdf
-		float cosPi = glm::dot(normalOnLight, -(glm::vec3)directionToLight);
-		pdf *= cosPi <= 0.0f ? 0.0f : ((float)distanceToLight * (float)distanceToLight / cosPi);
-		float evalFactor = 1.0f / kPi * 0.25f * inverseArea;
-		if (pdf > 0.0f)
+void FRayTracer::GetIllumination(const FRenderLight& InLight, const glm::dvec3& hitPos, glm::dvec3& directionToLight, glm::dvec3& intensity, double& distanceToLight, float& lightPDF, RNG& InRNG)
+{
+	lightPDF = 0.0f;
+	if (InLight.Type == ELightType::Directional) 
+	{
+		distanceToLight = 200000.0f;
+		directionToLight = InLight.DirectionToLight;
+		intensity = InLight.Color;
+	}
+	else if (InLight.Type == ELightType::Point) 
+	{
+		if (InLight.Radius <= 0.0f)
 		{
-			intensity = (pointLightPtr->GetDiffuseColor() * pointLightPtr->GetIntensity()) * evalFactor / pdf;
+			// Emits Color / (4 pi) per unit solid angle in every direction
+			glm::dvec3 displacement = glm::dvec3(InLight.Position) - hitPos;
+			distanceToLight = glm::length(displacement);
+			directionToLight = displacement / distanceToLight;
+			intensity = glm::dvec3(InLight.Color) / (4.0 * kPi * distanceToLight * distanceToLight);
 		}
 		else
 		{
-			intensity = glm::vec3( 0.0f );
+			// A sphere of uniform radiance with the same total power, sampled over the cone of directions it subtends
+			glm::vec3 outPosition;
+			glm::vec3 outNormal;
+			float pdf = SampleSphereSolidAngle(InLight.Position, InLight.Radius, glm::vec3(hitPos), InRNG.Float(), InRNG.Float(), outPosition, outNormal);
+			glm::dvec3 radiance = glm::dvec3(InLight.Color) / (4.0 * kPi * kPi * InLight.Radius * InLight.Radius);
+			SetSampledLightIllumination(radiance, pdf, outPosition, outNormal, hitPos, directionToLight, intensity, distanceToLight);
 		}
 	}
-	else if (lightPtr->GetType() == ELightType::Hittable) 
+	else if (InLight.Type == ELightType::Hittable) 
 	{
-		auto hittableLightPtr = static_cast<HittableLight*>(lightPtr);
 		glm::vec3 outPosition;
 		glm::vec3 outNormal;
-		glm::vec3 transformedHitPosition = hittableLightPtr->GetHittable()->InverseModelMatrix * glm::vec4(hitPos, 1.0f);
-		float outProbability = hittableLightPtr->GetHittable()->Sample(transformedHitPosition, outPosition, outNormal, InRNG);
-
-		// Transform normal and pos back to world space
-		outNormal = glm::normalize(glm::vec3(hittableLightPtr->GetHittable()->TransposeInverseModelMatrix * glm::vec4(outNormal, 0.0f)));
-		outPosition = glm::vec3(hittableLightPtr->GetHittable()->ModelMatrix * glm::vec4(outPosition, 1.0f));
+		float pdf = InLight.Hittable->Sample(glm::vec3(hitPos), outPosition, outNormal, InRNG);
+		lightPDF = InLight.Hittable->GetSamplePDF(glm::vec3(hitPos), outPosition, outNormal);
 
-		glm::vec3 displacement = (glm::dvec3)outPosition - hitPos;
-		distanceToLight = glm::length(displacement);
-		float cosine = glm::max(glm::dot(-displacement, outNormal), 0.0f) / (float)distanceToLight;
-		float surfaceArea = glm::max(cosine, 0.0f) / (float)(distanceToLight * distanceToLight);
-
-		// TODO: Change GetAlbedo and GetEmittance to use material sample functions. Needs to get UVs from Hittable->Sample
-		intensity = (glm::vec3)hittableLightPtr->GetHittable()->Material_.GetAlbedo() * hittableLightPtr->GetHittable()->Material_.GetEmittance() * surfaceArea / outProbability;
-		directionToLight = displacement / (float)distanceToLight;
+		// TODO: Change Albedo and Emittance to use material sample functions. Needs to get UVs from Hittable->Sample
+		SetSampledLightIllumination(glm::dvec3(InLight.Color), pdf, outPosition, outNormal, hitPos, directionToLight, intensity, distanceToLight);
 	}
 	else 
 	{
@@ -479,28 +1077,73 @@ void FRayTracer::GetIllumination(const LightComponent& lightComponent, const glm
 	}
 }
 
+void FRayTracer::SetSampledLightIllumination(const glm::dvec3& InRadiance, float InPDF, const glm::vec3& InLightPosition, const glm::vec3& InLightNormal, const glm::dvec3& InHitPosition, glm::dvec3& OutDirectionToLight, glm::dvec3& OutIntensity, double& OutDistanceToLight) const
+{
+	glm::dvec3 displacement = glm::dvec3(InLightPosition) - InHitPosition;
+	OutDistanceToLight = glm::length(displacement);
+	OutIntensity = glm::dvec3(0.0);
+	if (InPDF <= 0.0f || OutDistanceToLight <= 0.0)
+	{
+		OutDirectionToLight = glm::dvec3(0.0, 1.0, 0.0);
+		return;
+	}
+
+	// Emitters only light the side their normals face
+	OutDirectionToLight = displacement / OutDistanceToLight;
+	if (glm::dot(OutDirectionToLight, glm::dvec3(InLightNormal)) < 0.0)
+	{
+		OutIntensity = InRadiance / (double)InPDF;
+	}
+}
+
 bool FRayTracer::GetClosestObjectHit(const FRay& InRay, FHitRecord& InRecord, std::shared_ptr<IHittableBase> InHittableToIgnore) const
 {
-	bool objectHit = false;
-	for (int i = 0; i < Hittables.size(); i++)
+	const IHittableBase* hittableToIgnore = InHittableToIgnore.get();
+	const IHittableBase* closestHittable = nullptr;
+	float closestTime = InRecord.Time;
+
+	SceneBVH.Traverse(InRay, 0.0f, closestTime, [&](uint32_t InIndex, float& InOutClosestTime)
 	{
-		if (Hittables[i] != InHittableToIgnore)
-		{
-			// Cast a ray in object space for this hittable
-			FRay objectSpaceRay = FRay(InRay.GetOrigin(), InRay.GetDirection());
-			objectSpaceRay.ApplyTransform(Hittables[i]->InverseModelMatrix);
-			bool bWasHitRecorded = Hittables[i]->Intersect(objectSpaceRay, .00001f, InRecord, Hittables[i]->Material_);
+		const IHittableBase* hittable = Hittables[InIndex].get();
+		if (hittable == hittableToIgnore) return false;
 
-			if (bWasHitRecorded) {
-				// Transform normal back to world space
-				objectHit = true;
-				InRecord.Normal = glm::normalize(glm::vec3(Hittables[i]->TransposeInverseModelMatrix * glm::vec4(InRecord.Normal, 0.0f)));
-				InRecord.Material_ = Hittables[i]->Material_;
-			}
+		// Cast a ray in object space for this hittable. The transform keeps At(1.0) fixed, so hit times are comparable across spaces.
+		FRay objectSpaceRay = FRay(InRay.GetOrigin(), InRay.GetDirection());
+		objectSpaceRay.ApplyTransform(hittable->InverseModelMatrix);
+		if (hittable->Intersect(objectSpaceRay, .00001f, InRecord, Materials[hittable->MaterialIndex].AlphaMap))
+		{
+			closestHittable = hittable;
+			InOutClosestTime = InRecord.Time;
+			return true;
 		}
+		return false;
+	});
+
+	if (closestHittable == nullptr)
+	{
+		return false;
 	}
-		
-	return objectHit;
+
+	// Only the closest hit needs its normal transformed back to world space and its material recorded
+	InRecord.Normal = glm::normalize(glm::vec3(closestHittable->TransposeInverseModelMatrix * glm::vec4(InRecord.Normal, 0.0f)));
+	float volumeScale = glm::abs(glm::determinant(glm::mat3(closestHittable->ModelMatrix)));
+	InRecord.UVScale = volumeScale > 0.0f ? InRecord.UVScale / std::cbrt(volumeScale) : 0.0f; // Treats the transform's scale as uniform
+	InRecord.MaterialIndex = closestHittable->MaterialIndex;
+	InRecord.LightIndex = closestHittable->LightIndex;
+	return true;
+}
+
+bool FRayTracer::IsOccluded(const FRay& InRay, float InMaxTime, const IHittableBase* InHittableToIgnore) const
+{
+	return SceneBVH.Occluded(InRay, 0.0f, InMaxTime, [&](uint32_t InIndex)
+	{
+		const IHittableBase* hittable = Hittables[InIndex].get();
+		if (hittable == InHittableToIgnore) return false;
+
+		FRay objectSpaceRay = FRay(InRay.GetOrigin(), InRay.GetDirection());
+		objectSpaceRay.ApplyTransform(hittable->InverseModelMatrix);
+		return hittable->Occluded(objectSpaceRay, .00001f, InMaxTime, Materials[hittable->MaterialIndex].AlphaMap);
+	});
 }
 
 }
\ No newline at end of file
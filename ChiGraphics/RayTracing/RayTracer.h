@@ -1,12 +1,23 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <string>
 #include <vector>
 #include "glm/glm.hpp"
 #include "ChiGraphics/Collision/FHitRecord.h"
 #include "ChiGraphics/Collision/Hittables/HittableBase.h"
-#include <future>
+#include "ChiGraphics/Collision/Hittables/BVH.h"
+#include "ChiGraphics/Materials/TracingMaterial.h"
+#include "ChiGraphics/RayTracing/EnvironmentLight.h"
+#include "ChiGraphics/RayTracing/LightTree.h"
+#include "ChiGraphics/RayTracing/MeshGeometryCache.h"
+#include "ChiGraphics/RayTracing/RenderCheckpoint.h"
+#include "ChiGraphics/RayTracing/RenderFilm.h"
+#include "ChiGraphics/RayTracing/RenderOutputQueue.h"
+#include "ChiGraphics/RayTracing/RenderThreadPool.h"
+#include "ChiGraphics/RayTracing/Sampler.h"
 
 namespace CHISTUDIO {
 
@@ -23,6 +34,38 @@ public:
     float HDRIStrength;
     bool UseCompositingNodes;
     bool UseIntelDenoise;
+    bool bSaveEXR = false; // Also save every AOV of the film, unclamped, to an OpenEXR file next to the PNGs
+    int NumThreads = 0; // 0 uses one render thread per hardware thread
+    int TileSize = 32; // Width and height in pixels of the tiles handed to render threads
+    size_t RussianRouletteStartBounce = 3; // Paths may be terminated randomly from this bounce on
+    int LightSamplesPerHit = 1; // Lights picked from the light tree at every shading point, each with its own shadow ray
+    float FireflyClamp = 0.0f; // Light arriving through at least one bounce is clamped to this per channel. 0 disables the clamp.
+    int TextureCacheMegabytes = 1024; // Memory budget for the texture tiles sampled during a render
+    bool bUseAdaptiveSampling = false; // If set, SamplesPerPixel is the maximum and pixels stop sampling once converged
+    int MinSamplesPerPixel = 16; // Samples every pixel takes before its noise estimate is trusted
+    float AdaptiveNoiseThreshold = 0.01f; // Converged once the standard error of a pixel's luminance falls below this fraction of its mean
+    float TimeBudgetSeconds = 0.0f; // Once exceeded, remaining pixels only take MinSamplesPerPixel. 0 disables the budget.
+    ESamplerType SamplerType = ESamplerType::Sobol;
+    bool bUseFixedSeed = false; // If set, every render uses Seed and is reproducible. Otherwise the seed comes from the clock.
+    int Seed = 0;
+    std::string CheckpointFile; // If set, renders resume from this checkpoint when it matches and save their progress to it
+    float CheckpointIntervalSeconds = 300.0f; // Least time between checkpoint saves. The finished render is always saved.
+    int MaxQueuedOutputs = 0; // With more than 0, frames are denoised, composited and saved on a background thread while the next frame traces, with at most this many frames waiting
+};
+
+/** Rectangle of pixels [Min, Max) rendered as one unit of work */
+struct FRenderTile
+{
+    glm::ivec2 Min;
+    glm::ivec2 Max;
+};
+
+/** Film that tiles render into. Row y of the render goes to row y - FirstRow of the film, so a band of rows can be
+ *  rendered into a film only as tall as the band. */
+struct FRenderTarget
+{
+    FRenderFilm* Film;
+    int FirstRow = 0;
 };
 
 /** Allows for rendering the scene via ray tracing */
@@ -30,46 +73,210 @@ class FRayTracer
 {
 
 public:
-    FRayTracer(FRayTraceSettings InSettings);
+    /** InGeometryCache and InTextureCache keep mesh geometry and textures across ray tracers, such as one per click of
+     *  the render button. Without them, geometry and textures are only reused across the renders of this ray tracer. */
+    FRayTracer(FRayTraceSettings InSettings, std::shared_ptr<FMeshGeometryCache> InGeometryCache = nullptr,
+        std::shared_ptr<FTextureCache> InTextureCache = nullptr);
 
     /** Ray traces the scene, saving the file to the designated filepath, and outputting the image data to OutputTexture */
     std::unique_ptr<class FTexture> Render(const class Scene& InScene, const std::string& InOutputFile);
+
+    /** Ray traces the scene and saves the file to the designated filepath without touching GL, for headless rendering.
+     *  Returns the rendered image, or nullptr if the scene has no tracing camera. With Settings.MaxQueuedOutputs set, the
+     *  files are written in the background and the returned image is the beauty before denoising. Files that cannot be
+     *  written are reported and counted by GetFailedOutputCount, and the traced image is still returned. */
+    std::unique_ptr<class FImage> RenderImage(const class Scene& InScene, const std::string& InOutputFile);
+
+    /** Ray traces the scene in bands of InBandRows rows, top to bottom, appending each band to the output files as it
+     *  finishes. Memory for pixels is bounded by the band size, so images too large to hold can be rendered. The files
+     *  are uncompressed PNGs, and denoising, compositing, EXR output and checkpoints are skipped since they need the whole
+     *  image.
+     *  Returns false if the scene has no tracing camera or the files cannot be written. */
+    bool RenderImageStreamed(const class Scene& InScene, const std::string& InOutputFile, int InBandRows);
+
+    // Block until the files of every frame rendered so far are written. Also happens when the ray tracer is destroyed.
+    void WaitForOutputs();
+
+    // Frames whose files could not all be written. Frames written in the background are counted once they finish.
+    size_t GetFailedOutputCount() const {
+        return FailedOutputCount;
+    }
     
     // Cached settings for the rendering
     FRayTraceSettings Settings;
 
+    // Every AOV of the last render: beauty, albedo, normal, depth, sample count, and the denoised beauty when denoising.
+    // nullptr before the first render and after streamed renders, which keep no film.
+    const FRenderFilm* GetFilm() const {
+        return Film.get();
+    }
+
 private:
-    // Cached hittables being rendered
+    // Cached hittables being rendered. Ordered to match the leaves of SceneBVH.
     std::vector<std::shared_ptr<IHittableBase>> Hittables;
 
-    // Find all ray-traceable lights in the scene
-    std::vector<class LightComponent*> GetLightComponents(const class Scene& InScene);
+    // Mesh geometry instanced by the cached hittables, kept across renders
+    std::shared_ptr<FMeshGeometryCache> GeometryCache;
+
+    /** What a cached hittable was made from. When every source matches the last render's, only transforms, materials
+     *  and lights can have changed, so the hittables are kept and SceneBVH is refit. */
+    struct FHittableSource
+    {
+        const class SceneNode* Node;
+        const void* Shape; // The VertexObject of a mesh, or the hittable of a tracing component
+        uint64_t Revision; // Revision of the VertexObject, 0 for tracing components
+
+        bool operator==(const FHittableSource& InOther) const {
+            return Node == InOther.Node && Shape == InOther.Shape && Revision == InOther.Revision;
+        }
+    };
+
+    // Sources of the cached hittables, in the order SceneBVH was built from
+    std::vector<FHittableSource> HittableSources;
+
+    // Top-level acceleration structure over the world space bounds of every hittable
+    BVH SceneBVH;
+
+    // SceneBVH.GetCost() when it was last built, to tell when refitting has degraded it
+    float SceneBVHBuildCost = 0.0f;
+
+    // Snapshot of every material used by the cached hittables, indexed by IHittableBase::MaterialIndex and
+    // FHitRecord::MaterialIndex. Index 0 is the default material.
+    std::vector<FTracingMaterial> Materials;
+
+    // Mipmapped, tiled copies of the material textures, sampled by Materials and kept across renders
+    std::shared_ptr<FTextureCache> TextureCache;
+
+    // Angle between the camera rays of neighboring pixels, the spread of the ray cones that pick texture filter widths
+    float PixelSpreadAngle = 0.0f;
+
+    // Importance sampled copy of the HDRI, when one is used. Built at the start of each render.
+    std::unique_ptr<FEnvironmentLight> EnvironmentLight;
+
+    // Every light of the render except ambient lights, flattened with its world space data. Indexed by LightTree.
+    std::vector<FRenderLight> RenderLights;
+
+    // Picks which of RenderLights to sample at each shading point
+    FLightTree LightTree;
+
+    // Sum of every enabled ambient light's color
+    glm::vec3 AmbientColor;
 
-    // Generates necessary hittable data from objects in the scene. Also adds hittable lights to the lights vector
-    void BuildHittableData(const class Scene& InScene, std::vector<class LightComponent*>& InLights);
+    // Generates necessary hittable data from objects in the scene. Also fills the material table, starts RenderLights
+    // with the enabled emissive hittables and builds the scene-level BVH over all hittables. If the scene's shapes are
+    // unchanged since the last call, the hittables are updated in place and the BVH is refit.
+    void BuildHittableData(const class Scene& InScene);
+
+    // Add the scene's enabled point and directional lights to RenderLights, sum its ambient lights, and build LightTree.
+    // Called after BuildHittableData.
+    void BuildRenderLights(const class Scene& InScene);
+
+    // Build SceneBVH from the world space bounds of InHittables, storing them in Hittables in the order of its leaves
+    void BuildSceneBVH(std::vector<std::shared_ptr<IHittableBase>> InHittables);
+
+    // Update SceneBVH for hittables that moved since it was built, keeping its structure unless that makes it much
+    // slower to trace than a rebuild. InHittables must be the ones it was built over, in the order it was built from,
+    // such as the order of HittableSources; they are stored in Hittables in the order of its leaves.
+    void RefitSceneBVH(std::vector<std::shared_ptr<IHittableBase>> InHittables);
 
     // Find the camera to be used for rendering
     std::unique_ptr<class FTracingCamera> GetFirstTracingCamera(const class Scene& InScene);
 
-    // Send a ray into the scene, returning the color result after intersecting and calculating light contributions.
-    // Also finds the albedo and normal of the scene at the intersection, used for denoising data.
-    glm::dvec3 TraceRay(const class FRay& InRay, size_t InBounces, std::vector<class LightComponent*> InLights, glm::vec3& OutAlbedo, glm::vec3& OutNormal, RNG& InRNG);
+    // Find the tracing camera and build the hittables, lights and environment a render traces against. Returns nullptr
+    // if the scene has no tracing camera.
+    std::unique_ptr<class FTracingCamera> PrepareRender(const class Scene& InScene);
+
+    // Report the texture cache use, InRenderTime, and with adaptive sampling the average of InTotalSamples per pixel
+    void PrintRenderStatistics(std::chrono::steady_clock::duration InRenderTime, double InTotalSamples) const;
+
+    // Send a ray into the scene and follow its path for up to MaxBounces, returning the color result after intersecting and
+    // calculating light contributions. Also finds the albedo and normal of the scene at the first intersection, used for denoising data,
+    // and the distance to it, which is left unchanged if the ray hits nothing.
+    glm::dvec3 TraceRay(const class FRay& InRay, glm::vec3& OutAlbedo, glm::vec3& OutNormal, float& OutDepth, RNG& InRNG);
+
+    // Estimate the light reaching a shading point from Settings.LightSamplesPerHit lights picked by LightTree, testing shadow
+    // rays for occlusion. Ambient light is added in full. When the path continues by sampling the BSDF (InWillSampleBSDF),
+    // light from hittables is weighted against it with the power heuristic.
+    glm::dvec3 GetDirectLighting(const struct FShadingPoint& InShadingPoint, bool InWillSampleBSDF, RNG& InRNG);
+
+    // Power heuristic weight of emission reached by a BSDF sample with pdf InBSDFPDF, taken at InPreviousPosition with
+    // normal InPreviousNormal. Hits on hittables that next event estimation samples share the light with it.
+    double GetEmissionMISWeight(const FHitRecord& InRecord, const glm::dvec3& InHitPosition, const glm::dvec3& InRayDirection, const glm::vec3& InPreviousPosition, const glm::vec3& InPreviousNormal, double InBSDFPDF) const;
+
+    // With Settings.FireflyClamp set, clamp light arriving through at least one bounce to suppress fireflies. Camera ray
+    // contributions always pass through unchanged.
+    glm::dvec3 ClampIndirect(const glm::dvec3& InContribution, size_t InBounce) const;
 
     // Return the background color of a ray, used when no hittable is intersected. Can be solid colors, or sampled hdr images.
     glm::vec3 GetBackgroundColor(const glm::vec3& InDirection) const;
 
+    // Next event estimation toward the HDRI: sample a direction from EnvironmentLight and, if unoccluded, return its
+    // contribution. When the path continues by sampling the BSDF (InWillSampleBSDF), the two strategies are weighted
+    // with the power heuristic.
+    glm::dvec3 GetEnvironmentLighting(const struct FShadingPoint& InShadingPoint, bool InWillSampleBSDF, RNG& InRNG);
+
     // Calculate light illumination of a single light to a given position. Outputs various data including the overall intensity, direction to light, and distance to light (from the given hit position).
-    void GetIllumination(const LightComponent& lightComponent, const glm::dvec3& hitPos, glm::dvec3& directionToLight, glm::dvec3& intensity, double& distanceToLight, RNG& InRNG);
+    // Also outputs the solid angle pdf of sampling that direction for MIS, which is 0 for lights that BSDF sampling can never hit.
+    void GetIllumination(const FRenderLight& InLight, const glm::dvec3& hitPos, glm::dvec3& directionToLight, glm::dvec3& intensity, double& distanceToLight, float& lightPDF, RNG& InRNG);
 
-    // Given InRay, find the closest object hit from cached Hittables. Can take in a mask hittable to ignore.
+    // Finish GetIllumination for a light sampled at InLightPosition with a solid angle pdf: light arrives from the front
+    // of the sampled surface with InRadiance, weighted by the inverse pdf.
+    void SetSampledLightIllumination(const glm::dvec3& InRadiance, float InPDF, const glm::vec3& InLightPosition, const glm::vec3& InLightNormal, const glm::dvec3& InHitPosition, glm::dvec3& OutDirectionToLight, glm::dvec3& OutIntensity, double& OutDistanceToLight) const;
+
+    // Given InRay, find the closest object hit by traversing SceneBVH. Can take in a mask hittable to ignore.
     bool GetClosestObjectHit(const class FRay& InRay, FHitRecord& InRecord, std::shared_ptr<IHittableBase> InHittableToIgnore) const;
 
-    // Used for multithreading, creates data for a single thread to render out a row of pixels.
-    void RenderRow(size_t InY, std::vector<LightComponent*>* InLights, FTracingCamera* InTracingCamera, FImage* InOutputImage, FImage* InAlbedoImage, FImage* InNormalImage, int InRNGSeed);
+    // Whether any hittable blocks InRay closer than InMaxTime, stopping at the first blocking hit found. Used for shadow rays.
+    // Can take in a mask hittable to ignore.
+    bool IsOccluded(const class FRay& InRay, float InMaxTime, const IHittableBase* InHittableToIgnore) const;
+
+    // Split rows [InMinRow, InMaxRow) of the image into tiles of Settings.TileSize pixels, in row-major order
+    std::vector<FRenderTile> MakeRenderTiles(int InMinRow, int InMaxRow) const;
+
+    // Used for multithreading, renders out a single tile of pixels on a worker thread. Every pixel seeds its own RNG stream
+    // from InSeed, so results do not depend on the tile size, band size or thread count. Pixels are sampled until they have
+    // taken InSampleLimit samples in total, continuing from their accumulators in Checkpoint when there is one.
+    void RenderTile(const FRenderTile& InTile, FTracingCamera* InTracingCamera, const FRenderTarget& InTarget, uint32_t InSeed, int InSampleLimit);
+
+    // Save Checkpoint to Settings.CheckpointFile, reporting rather than throwing errors
+    void SaveCheckpoint() const;
+
+    // With adaptive sampling, whether a pixel that has taken InSampleCount samples can stop. InMean and InSquaredDeviationSum
+    // are the running (Welford) mean and sum of squared deviations of its sample luminances.
+    bool IsPixelConverged(int InSampleCount, double InMean, double InSquaredDeviationSum) const;
+
+    // Film of the last render. Shared with its output while that is written in the background.
+    std::shared_ptr<FRenderFilm> Film;
+
+    // Accumulated state of every pixel while rendering with Settings.CheckpointFile, nullptr otherwise
+    std::unique_ptr<FRenderCheckpoint> Checkpoint;
+
+    // Time after which adaptive sampling stops refining pixels, when Settings.TimeBudgetSeconds is set
+    std::chrono::steady_clock::time_point RenderDeadline;
+
+    // Worker threads, kept alive across every frame rendered by this ray tracer
+    std::unique_ptr<FRenderThreadPool> ThreadPool;
+
+    /** Film of a finished render and everything needed to write it, independent of the ray tracer's later frames */
+    struct FRenderOutput
+    {
+        FRayTraceSettings Settings;
+        std::string File; // Output path without extension
+        std::shared_ptr<FRenderFilm> Film;
+        class WImageCompositor* Compositor = nullptr; // Applied to the saved beauty image, when compositing is enabled
+    };
+
+    // Save the albedo, normal and sample count images, denoise the beauty into the film's denoised AOV, save the EXR,
+    // then composite and save the beauty image. Returns the AOV saved as the beauty, the denoised one unless denoising failed.
+    static int WriteOutput(FRenderOutput& InOutput);
+
+    // WriteOutput, reporting and counting a failure instead of throwing. Returns the beauty AOV when it fails.
+    int TryWriteOutput(FRenderOutput& InOutput);
+
+    std::atomic<size_t> FailedOutputCount{ 0 };
 
-    // Multi-threading
-    std::vector<std::future<void>> Futures;
-    int RowsComplete;
+    // Writes frames in the background when Settings.MaxQueuedOutputs is set. Destroyed first, finishing every frame.
+    std::unique_ptr<FRenderOutputQueue> OutputQueue;
 };
 
 }
@@ -0,0 +1,162 @@
+#include "RenderCheckpoint.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace CHISTUDIO {
+
+namespace {
+
+const char kCheckpointMagic[8] = { 'C', 'H', 'I', 'C', 'K', 'P', 'T', '2' };
+
+// Bytes each pixel takes in the file. Fields are written one by one, so the file does not depend on struct padding.
+const size_t kPixelRecordSize = sizeof(float) * 10 + sizeof(int32_t) + sizeof(double) * 2 + sizeof(uint64_t);
+
+template <typename T>
+void WriteValue(char*& InOutCursor, const T& InValue)
+{
+    std::memcpy(InOutCursor, &InValue, sizeof(T));
+    InOutCursor += sizeof(T);
+}
+
+template <typename T>
+void ReadValue(const char*& InOutCursor, T& OutValue)
+{
+    std::memcpy(&OutValue, InOutCursor, sizeof(T));
+    InOutCursor += sizeof(T);
+}
+
+void WriteVec3(char*& InOutCursor, const glm::vec3& InValue)
+{
+    WriteValue(InOutCursor, InValue.x);
+    WriteValue(InOutCursor, InValue.y);
+    WriteValue(InOutCursor, InValue.z);
+}
+
+void ReadVec3(const char*& InOutCursor, glm::vec3& OutValue)
+{
+    ReadValue(InOutCursor, OutValue.x);
+    ReadValue(InOutCursor, OutValue.y);
+    ReadValue(InOutCursor, OutValue.z);
+}
+
+}
+
+void FRenderCheckpoint::Save(const std::string& InPath) const
+{
+    std::string temporaryPath = InPath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            throw std::runtime_error("Unable to write checkpoint " + temporaryPath);
+        }
+
+        int32_t samplerType = (int32_t)SamplerType;
+        file.write(kCheckpointMagic, sizeof(kCheckpointMagic));
+        file.write(reinterpret_cast<const char*>(&ImageSize.x), sizeof(int32_t));
+        file.write(reinterpret_cast<const char*>(&ImageSize.y), sizeof(int32_t));
+        file.write(reinterpret_cast<const char*>(&Seed), sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(&samplerType), sizeof(int32_t));
+
+        // Written a row at a time to keep the staging buffer small
+        size_t width = (size_t)ImageSize.x;
+        std::vector<char> row(width * kPixelRecordSize);
+        for (size_t rowStart = 0; rowStart < Pixels.size(); rowStart += width)
+        {
+            char* cursor = row.data();
+            for (size_t i = rowStart; i < rowStart + width; i++)
+            {
+                const FPixelAccumulator& pixel = Pixels[i];
+                WriteVec3(cursor, pixel.ColorSum);
+                WriteVec3(cursor, pixel.AlbedoSum);
+                WriteVec3(cursor, pixel.NormalSum);
+                WriteValue(cursor, pixel.SampleCount);
+                WriteValue(cursor, pixel.MinDepth);
+                WriteValue(cursor, pixel.LuminanceMean);
+                WriteValue(cursor, pixel.LuminanceSquaredDeviationSum);
+                WriteValue(cursor, pixel.RNGState);
+            }
+            file.write(row.data(), row.size());
+        }
+
+        if (!file)
+        {
+            throw std::runtime_error("Unable to write checkpoint " + temporaryPath);
+        }
+    }
+
+    // rename does not replace existing files everywhere, so the old checkpoint is removed first
+    std::remove(InPath.c_str());
+    if (std::rename(temporaryPath.c_str(), InPath.c_str()) != 0)
+    {
+        throw std::runtime_error("Unable to replace checkpoint " + InPath);
+    }
+}
+
+bool FRenderCheckpoint::Load(const std::string& InPath)
+{
+    std::ifstream file(InPath, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    char magic[sizeof(kCheckpointMagic)];
+    int32_t samplerType = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&ImageSize.x), sizeof(int32_t));
+    file.read(reinterpret_cast<char*>(&ImageSize.y), sizeof(int32_t));
+    file.read(reinterpret_cast<char*>(&Seed), sizeof(uint32_t));
+    file.read(reinterpret_cast<char*>(&samplerType), sizeof(int32_t));
+    if (!file || std::memcmp(magic, kCheckpointMagic, sizeof(magic)) != 0 || ImageSize.x <= 0 || ImageSize.y <= 0)
+    {
+        std::cout << InPath << " is not a render checkpoint" << std::endl;
+        return false;
+    }
+    SamplerType = (ESamplerType)samplerType;
+
+    // Check the pixels the header claims against the file before allocating them, so a corrupt size cannot exhaust memory
+    std::streamoff pixelsStart = file.tellg();
+    file.seekg(0, std::ios::end);
+    uint64_t pixelBytes = (uint64_t)(file.tellg() - pixelsStart);
+    file.seekg(pixelsStart);
+    uint64_t pixelCount = (uint64_t)ImageSize.x * (uint64_t)ImageSize.y;
+    if (pixelBytes % kPixelRecordSize != 0 || pixelBytes / kPixelRecordSize != pixelCount)
+    {
+        std::cout << "Render checkpoint " << InPath << " is truncated or does not match its image size" << std::endl;
+        return false;
+    }
+
+    size_t width = (size_t)ImageSize.x;
+    Pixels.resize(width * (size_t)ImageSize.y);
+    std::vector<char> row(width * kPixelRecordSize);
+    for (size_t rowStart = 0; rowStart < Pixels.size(); rowStart += width)
+    {
+        if (!file.read(row.data(), row.size()))
+        {
+            std::cout << "Unable to read render checkpoint " << InPath << std::endl;
+            Pixels.clear();
+            return false;
+        }
+
+        const char* cursor = row.data();
+        for (size_t i = rowStart; i < rowStart + width; i++)
+        {
+            FPixelAccumulator& pixel = Pixels[i];
+            ReadVec3(cursor, pixel.ColorSum);
+            ReadVec3(cursor, pixel.AlbedoSum);
+            ReadVec3(cursor, pixel.NormalSum);
+            ReadValue(cursor, pixel.SampleCount);
+            ReadValue(cursor, pixel.MinDepth);
+            ReadValue(cursor, pixel.LuminanceMean);
+            ReadValue(cursor, pixel.LuminanceSquaredDeviationSum);
+            ReadValue(cursor, pixel.RNGState);
+        }
+    }
+    return true;
+}
+
+}
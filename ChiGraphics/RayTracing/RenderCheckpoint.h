@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+#include "ChiGraphics/RayTracing/Sampler.h"
+
+namespace CHISTUDIO {
+
+/** Everything a pixel has accumulated so far, enough to continue sampling it exactly where it stopped */
+struct FPixelAccumulator
+{
+    glm::vec3 ColorSum = glm::vec3(0.0f);
+    glm::vec3 AlbedoSum = glm::vec3(0.0f);
+    glm::vec3 NormalSum = glm::vec3(0.0f);
+    int32_t SampleCount = 0;
+
+    // Distance to the nearest first hit of the pixel's camera rays, infinite if none hit anything
+    float MinDepth = std::numeric_limits<float>::infinity();
+
+    // Running (Welford) statistics of the sample luminances, for adaptive sampling
+    double LuminanceMean = 0.0;
+    double LuminanceSquaredDeviationSum = 0.0;
+
+    // State of the pixel's RNG stream after its last sample
+    uint64_t RNGState = 0;
+};
+
+/** Accumulation buffers of a render in progress, saved to disk so the render can resume after the process dies, or be
+ *  continued later with more samples per pixel. Only the sampling state is stored, so resuming assumes the scene and
+ *  settings other than the sample counts are unchanged.
+ */
+struct FRenderCheckpoint
+{
+    glm::ivec2 ImageSize = glm::ivec2(0);
+    uint32_t Seed = 0;
+    ESamplerType SamplerType = ESamplerType::Independent;
+
+    // Row-major, ImageSize.x * ImageSize.y pixels
+    std::vector<FPixelAccumulator> Pixels;
+
+    // Write to a temporary file next to InPath, then replace InPath with it, so an interrupted save never leaves a
+    // truncated checkpoint. Throws std::runtime_error on failure.
+    void Save(const std::string& InPath) const;
+
+    // Returns false if InPath does not exist or is not a valid checkpoint
+    bool Load(const std::string& InPath);
+};
+
+}
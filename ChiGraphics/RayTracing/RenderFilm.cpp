@@ -0,0 +1,224 @@
+#include "RenderFilm.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include "stb_image_write.h"
+#include "ChiGraphics/Textures/FImage.h"
+#include "ChiGraphics/Utilities.h"
+
+namespace CHISTUDIO {
+
+namespace {
+
+/** A float channel of the EXR file and where it comes from in the film */
+struct FEXRChannel
+{
+    std::string Name;
+    int AOV;
+    int Channel;
+};
+
+uint8_t ToByte(float InValue)
+{
+    return (uint8_t)(glm::clamp(InValue, 0.0f, 1.0f) * 255.0f);
+}
+
+template <typename T>
+void AppendValue(std::vector<uint8_t>& OutBytes, const T& InValue)
+{
+    size_t offset = OutBytes.size();
+    OutBytes.resize(offset + sizeof(T));
+    std::memcpy(&OutBytes[offset], &InValue, sizeof(T));
+}
+
+void AppendString(std::vector<uint8_t>& OutBytes, const std::string& InString)
+{
+    OutBytes.insert(OutBytes.end(), InString.begin(), InString.end());
+    OutBytes.push_back(0);
+}
+
+// Attribute header of the EXR header, to be followed by InSize bytes of value
+void AppendAttribute(std::vector<uint8_t>& OutBytes, const std::string& InName, const std::string& InType, int32_t InSize)
+{
+    AppendString(OutBytes, InName);
+    AppendString(OutBytes, InType);
+    AppendValue(OutBytes, InSize);
+}
+
+void AppendBox(std::vector<uint8_t>& OutBytes, const std::string& InName, int InWidth, int InHeight)
+{
+    AppendAttribute(OutBytes, InName, "box2i", 16);
+    AppendValue(OutBytes, (int32_t)0);
+    AppendValue(OutBytes, (int32_t)0);
+    AppendValue(OutBytes, (int32_t)(InWidth - 1));
+    AppendValue(OutBytes, (int32_t)(InHeight - 1));
+}
+
+}
+
+FRenderFilm::FRenderFilm(int InWidth, int InHeight, const std::vector<FRenderAOV>& InAOVs)
+    : Width(InWidth), Height(InHeight), AOVs(InAOVs), PixelStride(0)
+{
+    for (const FRenderAOV& aov : AOVs)
+    {
+        AOVOffsets.push_back(PixelStride);
+        PixelStride += aov.ChannelCount;
+    }
+    Data.resize((size_t)Width * Height * PixelStride, 0.0f);
+}
+
+int FRenderFilm::FindAOV(const std::string& InName) const
+{
+    for (size_t i = 0; i < AOVs.size(); i++)
+    {
+        if (AOVs[i].Name == InName)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void FRenderFilm::GetRowBytes(int InAOV, int y, float InScale, float InBias, uint8_t* OutBytes) const
+{
+    bool bIsGrey = AOVs[InAOV].ChannelCount == 1;
+    const float* channels = GetPixel(InAOV, 0, y);
+    for (int x = 0; x < Width; x++, channels += PixelStride)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            *OutBytes++ = ToByte(channels[bIsGrey ? 0 : c] * InScale + InBias);
+        }
+    }
+}
+
+std::unique_ptr<FImage> FRenderFilm::ToImage(int InAOV) const
+{
+    bool bIsGrey = AOVs[InAOV].ChannelCount == 1;
+    auto image = make_unique<FImage>(Width, Height);
+    for (int y = 0; y < Height; y++)
+    {
+        for (int x = 0; x < Width; x++)
+        {
+            const float* channels = GetPixel(InAOV, x, y);
+            image->SetPixel(x, y, bIsGrey ? glm::vec3(channels[0]) : glm::vec3(channels[0], channels[1], channels[2]));
+        }
+    }
+    return image;
+}
+
+void FRenderFilm::SavePNG(const std::string& InPath, int InAOV, float InScale, float InBias) const
+{
+    // PNG rows start at the top of the image
+    size_t rowSize = (size_t)Width * 3;
+    std::vector<uint8_t> buffer(rowSize * Height);
+    for (int row = 0; row < Height; row++)
+    {
+        GetRowBytes(InAOV, Height - 1 - row, InScale, InBias, &buffer[row * rowSize]);
+    }
+
+    if (stbi_write_png(InPath.c_str(), Width, Height, 3, buffer.data(), (int)rowSize) == 0)
+    {
+        throw std::runtime_error("Unable to write " + InPath);
+    }
+}
+
+void FRenderFilm::SaveEXR(const std::string& InPath) const
+{
+    const char* colorChannelNames[3] = { "R", "G", "B" };
+    std::vector<FEXRChannel> channels;
+    for (size_t aov = 0; aov < AOVs.size(); aov++)
+    {
+        if (AOVs[aov].ChannelCount == 1)
+        {
+            channels.push_back({ AOVs[aov].Name, (int)aov, 0 });
+            continue;
+        }
+
+        std::string prefix = aov == 0 ? "" : AOVs[aov].Name + ".";
+        for (int c = 0; c < AOVs[aov].ChannelCount; c++)
+        {
+            channels.push_back({ prefix + colorChannelNames[c], (int)aov, c });
+        }
+    }
+
+    // Channels are listed, and stored within each scanline, in alphabetical order
+    std::sort(channels.begin(), channels.end(), [](const FEXRChannel& InA, const FEXRChannel& InB) { return InA.Name < InB.Name; });
+
+    std::vector<uint8_t> header = { 0x76, 0x2F, 0x31, 0x01, 2, 0, 0, 0 }; // Magic number, then version 2 with single part scanline flags
+
+    int32_t channelListSize = 1;
+    for (const FEXRChannel& channel : channels)
+    {
+        channelListSize += (int32_t)channel.Name.size() + 1 + 16;
+    }
+    AppendAttribute(header, "channels", "chlist", channelListSize);
+    for (const FEXRChannel& channel : channels)
+    {
+        AppendString(header, channel.Name);
+        AppendValue(header, (int32_t)2); // FLOAT
+        AppendValue(header, (uint32_t)0); // pLinear and reserved bytes
+        AppendValue(header, (int32_t)1); // x sampling
+        AppendValue(header, (int32_t)1); // y sampling
+    }
+    header.push_back(0);
+
+    AppendAttribute(header, "compression", "compression", 1);
+    header.push_back(0); // NO_COMPRESSION
+    AppendBox(header, "dataWindow", Width, Height);
+    AppendBox(header, "displayWindow", Width, Height);
+    AppendAttribute(header, "lineOrder", "lineOrder", 1);
+    header.push_back(0); // INCREASING_Y
+    AppendAttribute(header, "pixelAspectRatio", "float", 4);
+    AppendValue(header, 1.0f);
+    AppendAttribute(header, "screenWindowCenter", "v2f", 8);
+    AppendValue(header, 0.0f);
+    AppendValue(header, 0.0f);
+    AppendAttribute(header, "screenWindowWidth", "float", 4);
+    AppendValue(header, 1.0f);
+    header.push_back(0);
+
+    // Uncompressed files store one scanline per block, each a y coordinate and data size followed by the data
+    size_t scanlineDataSize = (size_t)Width * channels.size() * sizeof(float);
+    size_t blockSize = sizeof(int32_t) * 2 + scanlineDataSize;
+    uint64_t firstBlockOffset = header.size() + (uint64_t)Height * sizeof(uint64_t);
+    for (int y = 0; y < Height; y++)
+    {
+        AppendValue(header, firstBlockOffset + (uint64_t)y * blockSize);
+    }
+
+    std::ofstream file(InPath, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        throw std::runtime_error("Unable to write " + InPath);
+    }
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+    // EXR scanlines start at the top of the image
+    std::vector<uint8_t> block;
+    block.reserve(blockSize);
+    for (int y = 0; y < Height; y++)
+    {
+        int filmY = Height - 1 - y;
+        block.clear();
+        AppendValue(block, (int32_t)y);
+        AppendValue(block, (int32_t)scanlineDataSize);
+        for (const FEXRChannel& channel : channels)
+        {
+            const float* value = GetPixel(channel.AOV, 0, filmY) + channel.Channel;
+            for (int x = 0; x < Width; x++, value += PixelStride)
+            {
+                AppendValue(block, *value);
+            }
+        }
+        file.write(reinterpret_cast<const char*>(block.data()), block.size());
+    }
+
+    if (!file)
+    {
+        throw std::runtime_error("Unable to write " + InPath);
+    }
+}
+
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+
+namespace CHISTUDIO {
+
+/** A named image stored in a film, with 1 or 3 float channels per pixel */
+struct FRenderAOV
+{
+    std::string Name;
+    int ChannelCount;
+};
+
+/** Float framebuffer of a render, holding every AOV of every pixel in one allocation. A pixel's AOVs are stored back to
+ *  back in the order they were given, and rows are stored from the bottom of the image up like FImage, so pixel (x, y)
+ *  of the render is pixel (x, y) of the film. Denoisers and writers read the AOVs in place through the byte offsets and
+ *  strides below instead of copying them into images of their own.
+ */
+class FRenderFilm
+{
+public:
+    FRenderFilm(int InWidth, int InHeight, const std::vector<FRenderAOV>& InAOVs);
+
+    int GetWidth() const {
+        return Width;
+    }
+
+    int GetHeight() const {
+        return Height;
+    }
+
+    const std::vector<FRenderAOV>& GetAOVs() const {
+        return AOVs;
+    }
+
+    // Index of the AOV called InName, or -1 if the film has none
+    int FindAOV(const std::string& InName) const;
+
+    // First channel of an AOV at pixel (x, y)
+    float* GetPixel(int InAOV, int x, int y) {
+        return &Data[((size_t)y * Width + x) * PixelStride + AOVOffsets[InAOV]];
+    }
+
+    const float* GetPixel(int InAOV, int x, int y) const {
+        return &Data[((size_t)y * Width + x) * PixelStride + AOVOffsets[InAOV]];
+    }
+
+    // Set a 3 channel AOV
+    void SetPixel(int InAOV, int x, int y, const glm::vec3& InValue) {
+        float* channels = GetPixel(InAOV, x, y);
+        channels[0] = InValue.x;
+        channels[1] = InValue.y;
+        channels[2] = InValue.z;
+    }
+
+    // Set a single channel AOV
+    void SetPixel(int InAOV, int x, int y, float InValue) {
+        *GetPixel(InAOV, x, y) = InValue;
+    }
+
+    // Layout of the data in bytes, for viewing an AOV from other APIs
+    float* GetData() {
+        return Data.data();
+    }
+
+    const float* GetData() const {
+        return Data.data();
+    }
+
+    size_t GetAOVByteOffset(int InAOV) const {
+        return AOVOffsets[InAOV] * sizeof(float);
+    }
+
+    size_t GetPixelByteStride() const {
+        return PixelStride * sizeof(float);
+    }
+
+    size_t GetRowByteStride() const {
+        return PixelStride * sizeof(float) * Width;
+    }
+
+    // Write row y of an AOV as Width * 3 bytes of 8-bit RGB, mapping every value v to v * InScale + InBias before clamping
+    // it to [0, 1]. Single channel AOVs are written as grey.
+    void GetRowBytes(int InAOV, int y, float InScale, float InBias, uint8_t* OutBytes) const;
+
+    // Copy an AOV into an image, for viewing and compositing. Single channel AOVs are copied to every channel.
+    std::unique_ptr<class FImage> ToImage(int InAOV) const;
+
+    // Save an AOV as an 8-bit PNG, mapped like GetRowBytes. Throws std::runtime_error on failure.
+    void SavePNG(const std::string& InPath, int InAOV, float InScale = 1.0f, float InBias = 0.0f) const;
+
+    // Save every AOV to an uncompressed OpenEXR file of 32-bit float channels. The first AOV is the file's main RGB
+    // image; other AOVs are layers named after them, such as Albedo.R, or single channels such as Depth. Throws
+    // std::runtime_error on failure.
+    void SaveEXR(const std::string& InPath) const;
+
+private:
+    int Width;
+    int Height;
+    std::vector<FRenderAOV> AOVs;
+
+    // Index of each AOV's first channel within a pixel
+    std::vector<size_t> AOVOffsets;
+
+    // Floats per pixel, the channels of every AOV
+    size_t PixelStride;
+
+    std::vector<float> Data;
+};
+
+}
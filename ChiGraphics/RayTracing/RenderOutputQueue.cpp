@@ -0,0 +1,71 @@
+#include "RenderOutputQueue.h"
+#include <iostream>
+#include <stdexcept>
+
+namespace CHISTUDIO {
+
+FRenderOutputQueue::FRenderOutputQueue(size_t InMaxQueuedJobs)
+	: MaxQueuedJobs(InMaxQueuedJobs > 0 ? InMaxQueuedJobs : 1), bIsJobRunning(false), bShuttingDown(false)
+{
+	Worker = std::thread(&FRenderOutputQueue::WorkerLoop, this);
+}
+
+FRenderOutputQueue::~FRenderOutputQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		bShuttingDown = true;
+	}
+	JobAvailable.notify_all();
+	Worker.join();
+}
+
+void FRenderOutputQueue::Submit(std::function<void()> InJob)
+{
+	std::unique_lock<std::mutex> lock(Mutex);
+	JobFinished.wait(lock, [this]() { return Jobs.size() + (bIsJobRunning ? 1 : 0) < MaxQueuedJobs; });
+	Jobs.push_back(std::move(InJob));
+	lock.unlock();
+	JobAvailable.notify_one();
+}
+
+void FRenderOutputQueue::WaitForAll()
+{
+	std::unique_lock<std::mutex> lock(Mutex);
+	JobFinished.wait(lock, [this]() { return Jobs.empty() && !bIsJobRunning; });
+}
+
+void FRenderOutputQueue::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(Mutex);
+	while (true)
+	{
+		// Shutting down still drains the queue, so no submitted frame is lost
+		JobAvailable.wait(lock, [this]() { return bShuttingDown || !Jobs.empty(); });
+		if (Jobs.empty())
+		{
+			return;
+		}
+
+		std::function<void()> job = std::move(Jobs.front());
+		Jobs.pop_front();
+		bIsJobRunning = true;
+		lock.unlock();
+
+		// A frame that fails to save should not take the remaining frames down with it
+		try
+		{
+			job();
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Failed to write render output: " << e.what() << std::endl;
+		}
+
+		lock.lock();
+		bIsJobRunning = false;
+		JobFinished.notify_all();
+	}
+}
+
+}
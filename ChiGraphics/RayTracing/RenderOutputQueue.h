@@ -0,0 +1,45 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace CHISTUDIO {
+
+/** Background thread that finishes rendered frames (denoising, compositing and saving) while the ray tracer moves on
+ *  to the next frame. Jobs run one at a time in submission order. At most a fixed number of jobs are queued or running,
+ *  and Submit blocks until there is room, so the memory held by frames waiting on their output stays bounded.
+ */
+class FRenderOutputQueue
+{
+public:
+    explicit FRenderOutputQueue(size_t InMaxQueuedJobs);
+
+    // Finishes every submitted job before returning
+    ~FRenderOutputQueue();
+
+    FRenderOutputQueue(const FRenderOutputQueue&) = delete;
+    FRenderOutputQueue& operator=(const FRenderOutputQueue&) = delete;
+
+    void Submit(std::function<void()> InJob);
+
+    // Block until every submitted job has finished
+    void WaitForAll();
+
+private:
+    void WorkerLoop();
+
+    std::mutex Mutex;
+    std::condition_variable JobAvailable;
+    std::condition_variable JobFinished;
+    std::deque<std::function<void()>> Jobs;
+    size_t MaxQueuedJobs;
+    bool bIsJobRunning;
+    bool bShuttingDown;
+
+    std::thread Worker;
+};
+
+}
@@ -0,0 +1,149 @@
+#include "RenderThreadPool.h"
+#include <chrono>
+
+namespace CHISTUDIO {
+
+FRenderThreadPool::FRenderThreadPool(int InNumThreads)
+	: CurrentTask(nullptr), Generation(0), ActiveWorkers(0), bShuttingDown(false), CompletedTasks(0)
+{
+	size_t numThreads = InNumThreads > 0 ? (size_t)InNumThreads : (size_t)std::thread::hardware_concurrency();
+	if (numThreads == 0)
+	{
+		numThreads = 1;
+	}
+
+	for (size_t i = 0; i < numThreads; i++)
+	{
+		Queues.push_back(std::unique_ptr<FWorkQueue>(new FWorkQueue()));
+	}
+	for (size_t i = 0; i < numThreads; i++)
+	{
+		Workers.emplace_back(&FRenderThreadPool::WorkerLoop, this, i);
+	}
+}
+
+FRenderThreadPool::~FRenderThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(StateMutex);
+		bShuttingDown = true;
+	}
+	WorkAvailable.notify_all();
+	for (std::thread& worker : Workers)
+	{
+		worker.join();
+	}
+}
+
+void FRenderThreadPool::Run(size_t InTaskCount, const std::function<void(size_t)>& InTask, const std::function<void(size_t, size_t)>& InOnProgress)
+{
+	if (InTaskCount == 0)
+	{
+		return;
+	}
+
+	// Neighbouring tasks start on the same worker, so stealing from the back takes work far from the victim's current task
+	size_t numWorkers = Workers.size();
+	for (size_t worker = 0; worker < numWorkers; worker++)
+	{
+		size_t begin = worker * InTaskCount / numWorkers;
+		size_t end = (worker + 1) * InTaskCount / numWorkers;
+		std::lock_guard<std::mutex> queueLock(Queues[worker]->Mutex);
+		for (size_t task = begin; task < end; task++)
+		{
+			Queues[worker]->Tasks.push_back(task);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(StateMutex);
+		CurrentTask = &InTask;
+		CompletedTasks = 0;
+		ActiveWorkers = numWorkers;
+		Generation++;
+	}
+	WorkAvailable.notify_all();
+
+	std::unique_lock<std::mutex> lock(StateMutex);
+	while (!WorkFinished.wait_for(lock, std::chrono::milliseconds(100), [this]() { return ActiveWorkers == 0; }))
+	{
+		if (InOnProgress)
+		{
+			lock.unlock();
+			InOnProgress(CompletedTasks.load(), InTaskCount);
+			lock.lock();
+		}
+	}
+	CurrentTask = nullptr;
+	lock.unlock();
+
+	if (InOnProgress)
+	{
+		InOnProgress(InTaskCount, InTaskCount);
+	}
+}
+
+void FRenderThreadPool::WorkerLoop(size_t InWorkerIndex)
+{
+	uint64_t completedGeneration = 0;
+	while (true)
+	{
+		const std::function<void(size_t)>* task;
+		{
+			std::unique_lock<std::mutex> lock(StateMutex);
+			WorkAvailable.wait(lock, [&]() { return bShuttingDown || Generation != completedGeneration; });
+			if (bShuttingDown)
+			{
+				return;
+			}
+			completedGeneration = Generation;
+			task = CurrentTask;
+		}
+
+		size_t taskIndex;
+		while (PopTask(InWorkerIndex, taskIndex))
+		{
+			(*task)(taskIndex);
+			CompletedTasks++;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(StateMutex);
+			ActiveWorkers--;
+			if (ActiveWorkers == 0)
+			{
+				WorkFinished.notify_all();
+			}
+		}
+	}
+}
+
+bool FRenderThreadPool::PopTask(size_t InWorkerIndex, size_t& OutTask)
+{
+	{
+		FWorkQueue& ownQueue = *Queues[InWorkerIndex];
+		std::lock_guard<std::mutex> lock(ownQueue.Mutex);
+		if (!ownQueue.Tasks.empty())
+		{
+			OutTask = ownQueue.Tasks.front();
+			ownQueue.Tasks.pop_front();
+			return true;
+		}
+	}
+
+	size_t numQueues = Queues.size();
+	for (size_t offset = 1; offset < numQueues; offset++)
+	{
+		FWorkQueue& victimQueue = *Queues[(InWorkerIndex + offset) % numQueues];
+		std::lock_guard<std::mutex> lock(victimQueue.Mutex);
+		if (!victimQueue.Tasks.empty())
+		{
+			OutTask = victimQueue.Tasks.back();
+			victimQueue.Tasks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+}
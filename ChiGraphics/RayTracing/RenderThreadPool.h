@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace CHISTUDIO {
+
+/** Fixed set of worker threads that persists across renders. Each Run deals the task indices out to per-worker queues
+ *  in contiguous blocks; workers take from the front of their own queue and steal from the back of others when empty.
+ */
+class FRenderThreadPool
+{
+public:
+    // InNumThreads of 0 or less starts one worker per hardware thread
+    explicit FRenderThreadPool(int InNumThreads = 0);
+    ~FRenderThreadPool();
+
+    FRenderThreadPool(const FRenderThreadPool&) = delete;
+    FRenderThreadPool& operator=(const FRenderThreadPool&) = delete;
+
+    /** Calls InTask for every index in [0, InTaskCount) on the workers and blocks until all tasks have finished.
+     *  InOnProgress, if set, is called periodically on the calling thread with the completed and total task counts.
+     */
+    void Run(size_t InTaskCount, const std::function<void(size_t)>& InTask, const std::function<void(size_t, size_t)>& InOnProgress = nullptr);
+
+    size_t GetNumThreads() const {
+        return Workers.size();
+    }
+
+    size_t GetCompletedTaskCount() const {
+        return CompletedTasks.load();
+    }
+
+private:
+    struct FWorkQueue
+    {
+        std::mutex Mutex;
+        std::deque<size_t> Tasks;
+    };
+
+    void WorkerLoop(size_t InWorkerIndex);
+
+    // Takes the next task from the worker's own queue, or steals one from another worker. Returns false once all are empty.
+    bool PopTask(size_t InWorkerIndex, size_t& OutTask);
+
+    std::vector<std::thread> Workers;
+    std::vector<std::unique_ptr<FWorkQueue>> Queues;
+
+    std::mutex StateMutex;
+    std::condition_variable WorkAvailable;
+    std::condition_variable WorkFinished;
+    const std::function<void(size_t)>* CurrentTask;
+    uint64_t Generation;
+    size_t ActiveWorkers;
+    bool bShuttingDown;
+
+    std::atomic<size_t> CompletedTasks;
+};
+
+}
@@ -0,0 +1,252 @@
+#include "Sampler.h"
+#include "ChiGraphics/RNG.h"
+#include "ChiGraphics/Utilities.h"
+#include <algorithm>
+#include <cmath>
+
+namespace CHISTUDIO {
+
+// Integer hash with good avalanche behaviour (lowbias32, https://nullprogram.com/blog/2018/07/31/)
+static uint32_t HashUInt32(uint32_t InValue)
+{
+	InValue ^= InValue >> 16;
+	InValue *= 0x7feb352du;
+	InValue ^= InValue >> 15;
+	InValue *= 0x846ca68bu;
+	InValue ^= InValue >> 16;
+	return InValue;
+}
+
+static uint32_t HashCombine(uint32_t InSeed, uint32_t InValue)
+{
+	return HashUInt32(InSeed ^ (InValue + 0x9e3779b9u + (InSeed << 6) + (InSeed >> 2)));
+}
+
+static uint32_t ReverseBits(uint32_t InValue)
+{
+	InValue = (InValue << 16) | (InValue >> 16);
+	InValue = ((InValue & 0x00ff00ffu) << 8) | ((InValue & 0xff00ff00u) >> 8);
+	InValue = ((InValue & 0x0f0f0f0fu) << 4) | ((InValue & 0xf0f0f0f0u) >> 4);
+	InValue = ((InValue & 0x33333333u) << 2) | ((InValue & 0xccccccccu) >> 2);
+	InValue = ((InValue & 0x55555555u) << 1) | ((InValue & 0xaaaaaaaau) >> 1);
+	return InValue;
+}
+
+// Hash that only lets each bit depend on the bits below it. Applied to reversed bits this is an Owen scramble.
+static uint32_t LaineKarrasPermutation(uint32_t InValue, uint32_t InSeed)
+{
+	InValue += InSeed;
+	InValue ^= InValue * 0x6c50b47cu;
+	InValue ^= InValue * 0xb82f1e52u;
+	InValue ^= InValue * 0xc7afe638u;
+	InValue ^= InValue * 0x8d22f6e6u;
+	return InValue;
+}
+
+static uint32_t NestedUniformScramble(uint32_t InValue, uint32_t InSeed)
+{
+	return ReverseBits(LaineKarrasPermutation(ReverseBits(InValue), InSeed));
+}
+
+// Second Sobol dimension, whose generator matrix is Pascal's triangle mod 2
+static uint32_t SobolDimension1(uint32_t InIndex)
+{
+	uint32_t result = 0;
+	for (uint32_t direction = 1u << 31; InIndex != 0; InIndex >>= 1, direction ^= direction >> 1)
+	{
+		if (InIndex & 1)
+		{
+			result ^= direction;
+		}
+	}
+	return result;
+}
+
+FSobolSampler::FSobolSampler(uint32_t InSeed)
+	: Seed(HashUInt32(InSeed)), PixelSeed(0), SampleIndex(0), Dimension(0), PairedValue(0.0f)
+{
+}
+
+void FSobolSampler::StartPixelSample(const glm::ivec2& InPixel, uint32_t InSampleIndex)
+{
+	PixelSeed = HashCombine(HashCombine(Seed, (uint32_t)InPixel.x), (uint32_t)InPixel.y);
+	SampleIndex = InSampleIndex;
+	Dimension = 0;
+}
+
+float FSobolSampler::Next1D()
+{
+	uint32_t dimension = Dimension++;
+	if (dimension & 1)
+	{
+		return PairedValue;
+	}
+
+	uint32_t pairSeed = HashCombine(PixelSeed, dimension >> 1);
+
+	// Shuffling the index keeps power of two prefixes stratified while decorrelating the pairs
+	uint32_t index = NestedUniformScramble(SampleIndex, pairSeed);
+	uint32_t x = NestedUniformScramble(ReverseBits(index), HashCombine(pairSeed, 1));
+	uint32_t y = NestedUniformScramble(SobolDimension1(index), HashCombine(pairSeed, 2));
+
+	PairedValue = UInt32ToUnitFloat(y);
+	return UInt32ToUnitFloat(x);
+}
+
+// Ranks every pixel of a toroidal tile with Ulichney's void-and-cluster method (Ulichney 1993, The void-and-cluster
+// method for dither array generation), using a Gaussian energy filter.
+static std::vector<uint32_t> GenerateBlueNoiseTile()
+{
+	const int size = FBlueNoiseSampler::kTileSize;
+	const int count = size * size;
+	const float sigma = 1.5f;
+
+	// Filter weight for every wrapped offset in the tile
+	std::vector<float> kernel(count);
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			int dx = std::min(x, size - x);
+			int dy = std::min(y, size - y);
+			kernel[y * size + x] = std::exp(-(float)(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+		}
+	}
+
+	std::vector<uint8_t> pattern(count, 0);
+	std::vector<float> energy(count, 0.0f);
+	auto splat = [&](std::vector<float>& InOutEnergy, int InIndex, float InSign)
+	{
+		int px = InIndex % size;
+		int py = InIndex / size;
+		for (int y = 0; y < size; y++)
+		{
+			const float* kernelRow = &kernel[((y - py + size) % size) * size];
+			for (int x = 0; x < size; x++)
+			{
+				InOutEnergy[y * size + x] += InSign * kernelRow[(x - px + size) % size];
+			}
+		}
+	};
+	auto tightestCluster = [&](const std::vector<uint8_t>& InPattern, const std::vector<float>& InEnergy)
+	{
+		int best = -1;
+		for (int i = 0; i < count; i++)
+		{
+			if (InPattern[i] && (best < 0 || InEnergy[i] > InEnergy[best])) best = i;
+		}
+		return best;
+	};
+	auto largestVoid = [&](const std::vector<uint8_t>& InPattern, const std::vector<float>& InEnergy)
+	{
+		int best = -1;
+		for (int i = 0; i < count; i++)
+		{
+			if (!InPattern[i] && (best < 0 || InEnergy[i] < InEnergy[best])) best = i;
+		}
+		return best;
+	};
+
+	// Initial pattern: random minority pixels, relaxed until moving the tightest cluster to the largest void changes nothing
+	RNG rng(0x5eed, 0);
+	int initialCount = count / 10;
+	for (int placed = 0; placed < initialCount; )
+	{
+		int index = (int)(rng.UInt32() % (uint32_t)count);
+		if (!pattern[index])
+		{
+			pattern[index] = 1;
+			splat(energy, index, 1.0f);
+			placed++;
+		}
+	}
+	for (int iteration = 0; iteration < count; iteration++)
+	{
+		int cluster = tightestCluster(pattern, energy);
+		pattern[cluster] = 0;
+		splat(energy, cluster, -1.0f);
+		int emptiest = largestVoid(pattern, energy);
+		pattern[emptiest] = 1;
+		splat(energy, emptiest, 1.0f);
+		if (emptiest == cluster) break;
+	}
+
+	std::vector<int> ranks(count, 0);
+
+	// Phase 1: rank the initial pattern by repeatedly removing its tightest cluster
+	{
+		std::vector<uint8_t> phasePattern = pattern;
+		std::vector<float> phaseEnergy = energy;
+		for (int rank = initialCount - 1; rank >= 0; rank--)
+		{
+			int cluster = tightestCluster(phasePattern, phaseEnergy);
+			phasePattern[cluster] = 0;
+			splat(phaseEnergy, cluster, -1.0f);
+			ranks[cluster] = rank;
+		}
+	}
+
+	// Phases 2 and 3: rank the rest by repeatedly filling the largest void. The filter sums to a constant over the tile,
+	// so past half full this is the same as removing the tightest cluster of the remaining empty pixels.
+	for (int rank = initialCount; rank < count; rank++)
+	{
+		int emptiest = largestVoid(pattern, energy);
+		pattern[emptiest] = 1;
+		splat(energy, emptiest, 1.0f);
+		ranks[emptiest] = rank;
+	}
+
+	// Center each rank in its interval of [0, 1), stored as 32 bit fixed point
+	std::vector<uint32_t> tile(count);
+	for (int i = 0; i < count; i++)
+	{
+		tile[i] = (uint32_t)((((uint64_t)ranks[i] * 2 + 1) << 31) / (uint64_t)count);
+	}
+	return tile;
+}
+
+const std::vector<uint32_t>& FBlueNoiseSampler::GetBlueNoiseTile()
+{
+	static const std::vector<uint32_t> tile = GenerateBlueNoiseTile();
+	return tile;
+}
+
+FBlueNoiseSampler::FBlueNoiseSampler(uint32_t InSeed)
+	: Seed(HashUInt32(InSeed)), Pixel(0), SampleIndex(0), Dimension(0), Tile(GetBlueNoiseTile())
+{
+}
+
+void FBlueNoiseSampler::StartPixelSample(const glm::ivec2& InPixel, uint32_t InSampleIndex)
+{
+	Pixel = InPixel;
+	SampleIndex = InSampleIndex;
+	Dimension = 0;
+}
+
+float FBlueNoiseSampler::Next1D()
+{
+	uint32_t dimensionHash = HashCombine(Seed, Dimension++);
+
+	// Each dimension reads the tile at its own offset, so dimensions are not correlated with each other
+	int x = (Pixel.x + (int)(dimensionHash & (kTileSize - 1))) & (kTileSize - 1);
+	int y = (Pixel.y + (int)((dimensionHash >> 8) & (kTileSize - 1))) & (kTileSize - 1);
+
+	// Cranley-Patterson rotation by a random offset plus the golden ratio per sample, wrapping around 1 in fixed point
+	uint32_t rotation = HashUInt32(dimensionHash) + SampleIndex * 2654435769u;
+	return UInt32ToUnitFloat(Tile[y * kTileSize + x] + rotation);
+}
+
+std::unique_ptr<ISampler> MakeSampler(ESamplerType InType, uint32_t InSeed)
+{
+	switch (InType)
+	{
+	case ESamplerType::Sobol:
+		return make_unique<FSobolSampler>(InSeed);
+	case ESamplerType::BlueNoise:
+		return make_unique<FBlueNoiseSampler>(InSeed);
+	default:
+		return nullptr;
+	}
+}
+
+}
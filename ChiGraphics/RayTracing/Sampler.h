@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "glm/glm.hpp"
+
+namespace CHISTUDIO {
+
+enum class ESamplerType
+{
+    Independent, // Every value comes straight from the RNG
+    Sobol,
+    BlueNoise
+};
+
+/** Produces the values for one pixel sample at a time. Dimensions are handed out in order by Next1D (normally through
+ *  RNG::Float), so a given dimension drives the same decision on every sample of a pixel.
+ */
+class ISampler
+{
+public:
+    virtual ~ISampler() {}
+
+    // Begin sample InSampleIndex of InPixel, restarting at dimension 0
+    virtual void StartPixelSample(const glm::ivec2& InPixel, uint32_t InSampleIndex) = 0;
+
+    // Value in [0, 1) for the next dimension of the current sample
+    virtual float Next1D() = 0;
+};
+
+/** Owen-scrambled Sobol sampler. Each consecutive pair of dimensions uses the first two Sobol dimensions, a (0,2)
+ *  sequence, decorrelated from other pairs and pixels by hashed scrambling and a shuffle of the sample index.
+ *  Ref: Burley 2020, Practical Hash-based Owen Scrambling.
+ */
+class FSobolSampler : public ISampler
+{
+public:
+    explicit FSobolSampler(uint32_t InSeed);
+
+    void StartPixelSample(const glm::ivec2& InPixel, uint32_t InSampleIndex) override;
+    float Next1D() override;
+
+private:
+    uint32_t Seed;
+    uint32_t PixelSeed;
+    uint32_t SampleIndex;
+    uint32_t Dimension;
+
+    // Second value of the current dimension pair, returned by the next call
+    float PairedValue;
+};
+
+/** Blue-noise sampler. Every dimension reads a void-and-cluster blue-noise tile at its own offset and applies a
+ *  Cranley-Patterson rotation that advances by the golden ratio each sample, so neighbouring pixels get
+ *  well-spread values and the error of a frame shows up as high frequency noise.
+ */
+class FBlueNoiseSampler : public ISampler
+{
+public:
+    explicit FBlueNoiseSampler(uint32_t InSeed);
+
+    void StartPixelSample(const glm::ivec2& InPixel, uint32_t InSampleIndex) override;
+    float Next1D() override;
+
+    static const int kTileSize = 64;
+
+    // Void-and-cluster ranks of the tile as 32 bit fixed point values in [0, 1), generated once on first use
+    static const std::vector<uint32_t>& GetBlueNoiseTile();
+
+private:
+    uint32_t Seed;
+    glm::ivec2 Pixel;
+    uint32_t SampleIndex;
+    uint32_t Dimension;
+    const std::vector<uint32_t>& Tile;
+};
+
+// Creates a sampler of the given type. Returns nullptr for Independent, which draws from the RNG directly.
+std::unique_ptr<ISampler> MakeSampler(ESamplerType InType, uint32_t InSeed);
+
+}
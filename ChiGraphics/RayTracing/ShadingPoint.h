@@ -0,0 +1,53 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include "ChiGraphics/Collision/FHitRecord.h"
+#include "ChiGraphics/Materials/TracingMaterial.h"
+
+namespace CHISTUDIO {
+
+/** Everything shading needs at one path vertex. Every texture channel the material uses is sampled exactly once when
+ *  the shading point is made, filtered over InFootprint (a width in UV units), then reused by the albedo output,
+ *  emission, ambient light, each light sample and the bounce. Only holds a pointer to the material, so it lives on the
+ *  stack for the duration of one vertex.
+ */
+struct FShadingPoint
+{
+    FShadingPoint(const FTracingMaterial& InMaterial, const FHitRecord& InRecord, const glm::dvec3& InPosition, const glm::vec3& InTowardViewer, float InFootprint)
+        : Material(&InMaterial),
+        Position(InPosition),
+        Normal(InRecord.Normal),
+        TowardViewer(InTowardViewer),
+        BSDF(InMaterial.ResolveBSDF(InRecord.UV, InFootprint)),
+        Emission(InMaterial.SampleEmittance(InRecord.UV, InFootprint) * BSDF.Albedo)
+    {
+    }
+
+    glm::vec3 EvaluateBSDF(const glm::vec3& InTowardIncident) const
+    {
+        return Material->EvaluateBSDF(BSDF, Normal, TowardViewer, InTowardIncident);
+    }
+
+    float EvaluatePDF(const glm::vec3& InTowardIncident) const
+    {
+        return Material->EvaluatePDF(BSDF, Normal, TowardViewer, InTowardIncident);
+    }
+
+    bool SampleBSDF(glm::vec3& OutDirection, float& OutPDF, RNG& InRNG) const
+    {
+        return Material->SampleHemisphere(OutDirection, OutPDF, BSDF, Normal, TowardViewer, InRNG);
+    }
+
+    const FTracingMaterial* Material;
+
+    glm::dvec3 Position;
+    glm::vec3 Normal;
+    glm::vec3 TowardViewer; // w_o in the rendering equation
+
+    FBSDFParameters BSDF;
+
+    // Emitted radiance, albedo times emittance
+    glm::vec3 Emission;
+};
+
+}
@@ -11,7 +11,12 @@
 namespace CHISTUDIO {
 
 ShaderProgram::ShaderProgram(const std::unordered_map<GLenum, std::string>& InShaderFilenames)
+	: ShaderProgram_(0)
 {
+	// Scene nodes still own shaders when there is no GL context, they are just never compiled or used.
+	if (IsHeadless())
+		return;
+
 	assert(InShaderFilenames.count(GL_VERTEX_SHADER) == 1);
 	assert(InShaderFilenames.count(GL_FRAGMENT_SHADER) == 1);
 	for (auto& kv : InShaderFilenames) {
@@ -50,16 +55,25 @@ ShaderProgram::ShaderProgram(const std::unordered_map<GLenum, std::string>& InSh
 
 ShaderProgram::~ShaderProgram()
 {
+	if (IsHeadless())
+		return;
+
 	GL_CHECK(glDeleteProgram(ShaderProgram_));
 }
 
 void ShaderProgram::Bind() const
 {
+	if (IsHeadless())
+		return;
+
 	GL_CHECK(glUseProgram(ShaderProgram_));
 }
 
 void ShaderProgram::Unbind() const
 {
+	if (IsHeadless())
+		return;
+
 	GL_CHECK(glUseProgram(0));
 }
 
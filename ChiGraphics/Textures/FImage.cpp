@@ -1,6 +1,7 @@
 #define NOMINMAX
 
 #include "FImage.h"
+#include <atomic>
 #include <stdexcept>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -30,9 +31,20 @@ const glm::vec3& FImage::GetPixel(int x, int y) const
     return Data[sampleY * Width + sampleX];
 }
 
+uint64_t FImage::GetRevision() const
+{
+    static std::atomic<uint64_t> nextRevision(1);
+    if (Revision == 0)
+    {
+        Revision = nextRevision++;
+    }
+    return Revision;
+}
+
 void FImage::SetData(const std::vector<glm::vec3>& InData)
 {
     Data = InData;
+    Revision = 0;
 }
 
 std::unique_ptr<FImage> FImage::LoadPNG(const std::string& filename, bool y_reversed)
@@ -89,29 +101,35 @@ void FImage::SavePNG(const std::string& filename) const
 
 std::vector<uint8_t> FImage::ToByteData() const
 {
-    std::vector<uint8_t> buffer;
+    std::vector<uint8_t> buffer(Width * Height * 3);
 
-    for (int y = (int)Height - 1; y >= 0; y--)
-        for (size_t x = 0; x < Width; x++) {
-            const glm::vec3& color = GetPixel(x, static_cast<size_t>(y));
-            buffer.push_back(ClampColor(color[0]));
-            buffer.push_back(ClampColor(color[1]));
-            buffer.push_back(ClampColor(color[2]));
-        }
+    for (size_t row = 0; row < Height; row++)
+        GetRowBytes(Height - 1 - row, &buffer[row * Width * 3]);
 
     return buffer;
 }
 
+void FImage::GetRowBytes(size_t InY, uint8_t* OutBytes) const
+{
+    const glm::vec3* pixel = &Data[InY * Width];
+    for (size_t x = 0; x < Width; x++, pixel++) {
+        *OutBytes++ = ClampColor(pixel->r);
+        *OutBytes++ = ClampColor(pixel->g);
+        *OutBytes++ = ClampColor(pixel->b);
+    }
+}
+
 std::vector<float> FImage::ToFloatData() const
 {
-    std::vector<float> buffer;
+    std::vector<float> buffer(Width * Height * 3);
 
+    float* value = buffer.data();
     for (int y = (int)Height - 1; y >= 0; y--)
         for (size_t x = 0; x < Width; x++) {
-            const glm::vec3& color = GetPixel(x, static_cast<size_t>(y));
-            buffer.push_back(color[0]);
-            buffer.push_back(color[1]);
-            buffer.push_back(color[2]);
+            const glm::vec3& color = Data[y * Width + x];
+            *value++ = color[0];
+            *value++ = color[1];
+            *value++ = color[2];
         }
 
     return buffer;
@@ -126,6 +144,7 @@ void FImage::SetFloatData(const std::vector<float>& InData, bool InInvert)
         size_t y = Height - 1 - index / Width;
         Data[y * Width + x] = glm::vec3(InData[i], InData[i+1], InData[i+2]);
     }
+    Revision = 0;
 }
 
 void FImage::RemapNormalData()
@@ -135,9 +154,10 @@ void FImage::RemapNormalData()
         glm::vec3 remappedValue = (Data[i] + 1.0f) * .5f;
         Data[i] = remappedValue;
     }
+    Revision = 0;
 }
 
-glm::vec3 FImage::SampleHDRI(const glm::vec3& InDirection)
+glm::vec3 FImage::SampleHDRI(const glm::vec3& InDirection) const
 {
     glm::vec3 direction = glm::normalize(InDirection);
     float azimuth = atan2(direction.z, direction.x) + kPi;
@@ -147,7 +167,7 @@ glm::vec3 FImage::SampleHDRI(const glm::vec3& InDirection)
     return BilinearSample(x,y);
 }
 
-glm::vec3 FImage::BilinearSample(float InX, float InY)
+glm::vec3 FImage::BilinearSample(float InX, float InY) const
 {
     int x0 = glm::floor(InX);
     int y0 = glm::floor(InY);
@@ -157,7 +177,7 @@ glm::vec3 FImage::BilinearSample(float InX, float InY)
     return glm::lerp(glm::lerp(GetPixel(x0, y0), GetPixel(x0 + 1, y0), ax), glm::lerp(GetPixel(x0, y0 + 1), GetPixel(x0 + 1, y0 + 1), ax), ay);
 }
 
-glm::vec3 FImage::SampleWithUV(glm::vec2 InUV)
+glm::vec3 FImage::SampleWithUV(glm::vec2 InUV) const
 {
     return BilinearSample((Width - 1) * InUV.x, (Height - 1) * (1.0f - InUV.y));
 }
@@ -209,6 +229,7 @@ void FImage::ApplyGaussianBlur(int InNumIterations)
         horizontal = !horizontal;
         Data = NewData;
     }
+    Revision = 0;
     
 }
 
@@ -2,6 +2,7 @@
 #define NOMINMAX
 
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <iostream>
 #include <stdexcept>
 #include <vector>
@@ -20,6 +21,10 @@ public:
         Data.resize(Width * Height);
     }
 
+    // Changes whenever the pixels change. Revisions are unique across every image, so a revision identifies one state of
+    // the pixels, shared by copies of the image until either is changed.
+    uint64_t GetRevision() const;
+
     size_t GetWidth() const {
         return Width;
     }
@@ -33,11 +38,13 @@ public:
         Width = InWidth;
         Height = InHeight;
         Data.resize(Width * Height);
+        Revision = 0;
     }
 
     void SetPixel(size_t x, size_t y, const glm::vec3& color) {
         if (x < Width && y < Height) {
             Data[y * Width + x] = color;
+            Revision = 0;
         }
         else {
             throw std::runtime_error("Unable to set a pixel outside of image range.");
@@ -51,15 +58,18 @@ public:
     static std::unique_ptr<FImage> MakeImageCopy(FImage* InImageToCopy);
     void SavePNG(const std::string& filename) const;
     std::vector<uint8_t> ToByteData() const;
+
+    // Write row InY as Width * 3 bytes of 8-bit RGB, clamped the same way as ToByteData
+    void GetRowBytes(size_t InY, uint8_t* OutBytes) const;
     std::vector<float> ToFloatData() const;
     void SetFloatData(const std::vector<float>& InData, bool InInvert = false);
 
     // Takes normal data in [-1, 1] range and remaps it in [0, 1] for visual display
     void RemapNormalData();
 
-    glm::vec3 SampleHDRI(const glm::vec3& InDirection);
-    glm::vec3 BilinearSample(float InX, float InY);
-    glm::vec3 SampleWithUV(glm::vec2 InUV);
+    glm::vec3 SampleHDRI(const glm::vec3& InDirection) const;
+    glm::vec3 BilinearSample(float InX, float InY) const;
+    glm::vec3 SampleWithUV(glm::vec2 InUV) const;
     std::string ImportedFileName;
 
     // Apply a gaussian blur with a number of iterations
@@ -73,6 +83,9 @@ private:
     std::vector<glm::vec3> Data;
     size_t Width;
     size_t Height;
+
+    // Assigned on the first GetRevision after the pixels change, so writing a pixel only has to clear it
+    mutable uint64_t Revision = 0;
 };
 
 }
@@ -0,0 +1,183 @@
+#include "PNGStreamWriter.h"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace CHISTUDIO {
+
+namespace {
+
+// Image data is written to the file in IDAT chunks of about this many bytes
+const size_t kImageDataChunkSize = 1 << 20;
+
+// Largest payload of a stored deflate block
+const size_t kMaxStoredBlockSize = 65535;
+
+const uint32_t kAdlerModulus = 65521;
+
+// Bytes that can be summed before the Adler-32 sums need reducing to avoid overflowing 32 bits
+const size_t kAdlerBlockSize = 5552;
+
+std::array<uint32_t, 256> MakeCRCTable()
+{
+    std::array<uint32_t, 256> table;
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+uint32_t UpdateCRC(uint32_t InCRC, const uint8_t* InData, size_t InSize)
+{
+    static const std::array<uint32_t, 256> table = MakeCRCTable();
+    for (size_t i = 0; i < InSize; i++)
+    {
+        InCRC = table[(InCRC ^ InData[i]) & 0xFF] ^ (InCRC >> 8);
+    }
+    return InCRC;
+}
+
+void AppendBigEndian(std::vector<uint8_t>& OutBytes, uint32_t InValue)
+{
+    OutBytes.push_back((uint8_t)(InValue >> 24));
+    OutBytes.push_back((uint8_t)(InValue >> 16));
+    OutBytes.push_back((uint8_t)(InValue >> 8));
+    OutBytes.push_back((uint8_t)InValue);
+}
+
+}
+
+FPNGStreamWriter::FPNGStreamWriter(const std::string& InPath, size_t InWidth, size_t InHeight)
+    : File(InPath, std::ios::binary | std::ios::trunc), Path(InPath), Width(InWidth), Height(InHeight)
+{
+    if (!File || Width == 0 || Height == 0)
+    {
+        throw std::runtime_error("Unable to write " + InPath);
+    }
+
+    const uint8_t signature[8] = { 0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A };
+    File.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    // 8 bits per channel, RGB, default compression and filtering, not interlaced
+    std::vector<uint8_t> header;
+    AppendBigEndian(header, (uint32_t)Width);
+    AppendBigEndian(header, (uint32_t)Height);
+    header.push_back(8);
+    header.push_back(2);
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+    WriteChunk("IHDR", header.data(), header.size());
+
+    // Zlib header: deflate with a 32K window, no preset dictionary, header check bits making it a multiple of 31
+    PendingData.push_back(0x78);
+    PendingData.push_back(0x01);
+
+    RemainingStreamBytes = (uint64_t)Height * (1 + Width * 3);
+    Scanline.resize(1 + Width * 3);
+}
+
+void FPNGStreamWriter::WriteRow(const uint8_t* InRow)
+{
+    if (RowsWritten == Height)
+    {
+        throw std::runtime_error("Too many rows written to " + Path);
+    }
+
+    // Filter type 0, the row's bytes unchanged
+    Scanline[0] = 0;
+    std::copy(InRow, InRow + Width * 3, Scanline.begin() + 1);
+    AppendStoredBlocks(Scanline.data(), Scanline.size());
+    RowsWritten++;
+
+    if (PendingData.size() >= kImageDataChunkSize)
+    {
+        FlushImageData();
+    }
+}
+
+void FPNGStreamWriter::Finish()
+{
+    if (RowsWritten != Height)
+    {
+        throw std::runtime_error("Missing rows in " + Path);
+    }
+
+    AdlerA %= kAdlerModulus;
+    AdlerB %= kAdlerModulus;
+    AppendBigEndian(PendingData, (AdlerB << 16) | AdlerA);
+    FlushImageData();
+    WriteChunk("IEND", nullptr, 0);
+
+    File.close();
+    if (!File)
+    {
+        throw std::runtime_error("Unable to write " + Path);
+    }
+}
+
+void FPNGStreamWriter::AppendStoredBlocks(const uint8_t* InData, size_t InSize)
+{
+    for (size_t offset = 0; offset < InSize; offset += kMaxStoredBlockSize)
+    {
+        size_t blockSize = std::min(InSize - offset, kMaxStoredBlockSize);
+        RemainingStreamBytes -= blockSize;
+
+        // Block header: BFINAL on the stream's last block and BTYPE 00 (stored), then LEN and its complement NLEN
+        PendingData.push_back(RemainingStreamBytes == 0 ? 1 : 0);
+        PendingData.push_back((uint8_t)blockSize);
+        PendingData.push_back((uint8_t)(blockSize >> 8));
+        PendingData.push_back((uint8_t)~blockSize);
+        PendingData.push_back((uint8_t)(~blockSize >> 8));
+        PendingData.insert(PendingData.end(), InData + offset, InData + offset + blockSize);
+    }
+
+    for (size_t offset = 0; offset < InSize; offset += kAdlerBlockSize)
+    {
+        size_t end = std::min(offset + kAdlerBlockSize, InSize);
+        for (size_t i = offset; i < end; i++)
+        {
+            AdlerA += InData[i];
+            AdlerB += AdlerA;
+        }
+        AdlerA %= kAdlerModulus;
+        AdlerB %= kAdlerModulus;
+    }
+}
+
+void FPNGStreamWriter::FlushImageData()
+{
+    if (!PendingData.empty())
+    {
+        WriteChunk("IDAT", PendingData.data(), PendingData.size());
+        PendingData.clear();
+    }
+}
+
+void FPNGStreamWriter::WriteChunk(const char* InType, const uint8_t* InData, size_t InSize)
+{
+    std::vector<uint8_t> length;
+    AppendBigEndian(length, (uint32_t)InSize);
+    File.write(reinterpret_cast<const char*>(length.data()), length.size());
+
+    // The CRC covers the chunk type and data, not the length
+    uint32_t crc = UpdateCRC(0xFFFFFFFFu, reinterpret_cast<const uint8_t*>(InType), 4);
+    File.write(InType, 4);
+    if (InSize > 0)
+    {
+        File.write(reinterpret_cast<const char*>(InData), InSize);
+        crc = UpdateCRC(crc, InData, InSize);
+    }
+
+    std::vector<uint8_t> crcBytes;
+    AppendBigEndian(crcBytes, crc ^ 0xFFFFFFFFu);
+    File.write(reinterpret_cast<const char*>(crcBytes.data()), crcBytes.size());
+}
+
+}
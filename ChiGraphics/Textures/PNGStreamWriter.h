@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace CHISTUDIO {
+
+/** Writes an 8-bit RGB PNG one row at a time, top row first, so images far larger than memory can be saved while they
+ *  are rendered. Rows go into the file as uncompressed (stored) deflate blocks, which needs no compression library and
+ *  no buffering beyond the current image data chunk, at the cost of a file as large as the raw pixels.
+ */
+class FPNGStreamWriter
+{
+public:
+    // Create InPath and write the PNG header. Throws std::runtime_error if the file cannot be created.
+    FPNGStreamWriter(const std::string& InPath, size_t InWidth, size_t InHeight);
+
+    FPNGStreamWriter(const FPNGStreamWriter&) = delete;
+    FPNGStreamWriter& operator=(const FPNGStreamWriter&) = delete;
+
+    // Append the next row, InWidth * 3 bytes of RGB
+    void WriteRow(const uint8_t* InRow);
+
+    // Write the end of the image once every row is written. Throws std::runtime_error if rows are missing or the file
+    // could not be written.
+    void Finish();
+
+private:
+    // Add InSize bytes of scanline data to the zlib stream as stored deflate blocks
+    void AppendStoredBlocks(const uint8_t* InData, size_t InSize);
+
+    // Write PendingData as an IDAT chunk
+    void FlushImageData();
+
+    void WriteChunk(const char* InType, const uint8_t* InData, size_t InSize);
+
+    std::ofstream File;
+    std::string Path;
+    size_t Width;
+    size_t Height;
+    size_t RowsWritten = 0;
+
+    // Scanline bytes, filter bytes included, that the zlib stream has yet to receive
+    uint64_t RemainingStreamBytes;
+
+    // Running Adler-32 checksum of the scanline bytes, closing the zlib stream
+    uint32_t AdlerA = 1;
+    uint32_t AdlerB = 0;
+
+    // Zlib stream bytes not yet written to the file as an IDAT chunk
+    std::vector<uint8_t> PendingData;
+
+    // The current row with its filter byte in front
+    std::vector<uint8_t> Scanline;
+};
+
+}
@@ -0,0 +1,549 @@
+#define NOMINMAX
+
+#include "TextureCache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <glm/gtc/packing.hpp>
+#include "FImage.h"
+
+namespace CHISTUDIO {
+
+namespace {
+
+int WrapCoordinate(int InCoordinate, int InSize)
+{
+    int wrapped = InCoordinate % InSize;
+    return wrapped < 0 ? wrapped + InSize : wrapped;
+}
+
+// The store can outgrow 2GB, past what fseek's long offsets reach on Windows
+bool SeekFile(FILE* InFile, uint64_t InOffset)
+{
+#ifdef _MSC_VER
+    return _fseeki64(InFile, (__int64)InOffset, SEEK_SET) == 0;
+#else
+    return fseeko(InFile, (off_t)InOffset, SEEK_SET) == 0;
+#endif
+}
+
+}
+
+FTextureCache::FTextureCache(size_t InMemoryBudget)
+    : Store(new FStore()), LiveStoreBytes(0), BuiltCount(0), ReusedCount(0), MemoryBudget(InMemoryBudget), ResidentBytes(0),
+      PeakResidentBytes(0), TileLoadCount(0), TileEvictionCount(0), UseClock(0)
+{
+}
+
+void FTextureCache::SetMemoryBudget(size_t InMemoryBudget)
+{
+    std::lock_guard<std::mutex> lock(Mutex);
+    MemoryBudget = InMemoryBudget;
+    if (ResidentBytes > MemoryBudget)
+    {
+        EvictTiles(nullptr);
+    }
+}
+
+void FTextureCache::BeginBuild()
+{
+    BuiltCount = 0;
+    ReusedCount = 0;
+    for (const std::unique_ptr<FCachedTexture>& texture : Textures)
+    {
+        if (texture)
+        {
+            texture->bUsed = false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    PeakResidentBytes = ResidentBytes;
+    TileLoadCount = 0;
+    TileEvictionCount = 0;
+}
+
+uint32_t FTextureCache::AddTexture(const FImage& InImage)
+{
+    auto existing = TextureIds.find(InImage.GetRevision());
+    if (existing != TextureIds.end())
+    {
+        FCachedTexture& texture = *Textures[existing->second];
+        if (!texture.bUsed)
+        {
+            texture.bUsed = true;
+            ReusedCount++;
+        }
+        return existing->second;
+    }
+
+    std::unique_ptr<FCachedTexture> texture = BuildTexture(InImage);
+    LiveStoreBytes += texture->StoreBytes;
+    BuiltCount++;
+
+    uint32_t id;
+    if (FreeIds.empty())
+    {
+        id = (uint32_t)Textures.size();
+        Textures.push_back(std::move(texture));
+    }
+    else
+    {
+        id = FreeIds.back();
+        FreeIds.pop_back();
+        Textures[id] = std::move(texture);
+    }
+    TextureIds[Textures[id]->Revision] = id;
+    return id;
+}
+
+void FTextureCache::EndBuild()
+{
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        size_t kept = 0;
+        for (size_t i = 0; i < ResidentTiles.size(); i++)
+        {
+            if (ResidentTiles[i].Texture->bUsed)
+            {
+                ResidentTiles[kept++] = ResidentTiles[i];
+            }
+            else
+            {
+                ResidentBytes -= ResidentTiles[i].Bytes;
+            }
+        }
+        ResidentTiles.resize(kept);
+    }
+
+    for (uint32_t id = 0; id < (uint32_t)Textures.size(); id++)
+    {
+        if (Textures[id] && !Textures[id]->bUsed)
+        {
+            TextureIds.erase(Textures[id]->Revision);
+            LiveStoreBytes -= Textures[id]->StoreBytes;
+            Textures[id].reset();
+            FreeIds.push_back(id);
+        }
+    }
+
+    // Released textures leave their bytes behind in the store, so it is rewritten once they are most of it
+    if (Store->Size > LiveStoreBytes * 2)
+    {
+        CompactStore();
+    }
+}
+
+std::unique_ptr<FTextureCache::FCachedTexture> FTextureCache::BuildTexture(const FImage& InImage)
+{
+    // Pick the smallest storage that holds the image: 8 bits for values in [0, 1], such as every loaded PNG, one
+    // channel for grey images such as most roughness and metallic maps
+    bool bIsUnitRange = true;
+    bool bIsGrey = true;
+    for (const glm::vec3& pixel : InImage.GetData())
+    {
+        bIsUnitRange = bIsUnitRange && glm::all(glm::greaterThanEqual(pixel, glm::vec3(0.0f))) && glm::all(glm::lessThanEqual(pixel, glm::vec3(1.0f)));
+        bIsGrey = bIsGrey && pixel.x == pixel.y && pixel.x == pixel.z;
+    }
+
+    auto texture = std::unique_ptr<FCachedTexture>(new FCachedTexture());
+    texture->Revision = InImage.GetRevision();
+    texture->Format = bIsUnitRange ? EFormat::UNorm8 : EFormat::Half;
+    texture->Channels = bIsGrey ? 1 : 3;
+
+    // Halve down to a single texel, rounding odd sizes down
+    int width = glm::max((int)InImage.GetWidth(), 1);
+    int height = glm::max((int)InImage.GetHeight(), 1);
+    while (true)
+    {
+        FLevel level;
+        level.Width = width;
+        level.Height = height;
+        level.TilesX = (width + kTileSize - 1) / kTileSize;
+        level.TilesY = (height + kTileSize - 1) / kTileSize;
+        level.Slots.reset(new FTileSlot[(size_t)level.TilesX * level.TilesY]);
+        texture->Levels.push_back(std::move(level));
+
+        if (width == 1 && height == 1)
+        {
+            break;
+        }
+        width = glm::max(width / 2, 1);
+        height = glm::max(height / 2, 1);
+    }
+
+    std::lock_guard<std::mutex> lock(StoreMutex);
+    texture->StoreOffset = Store->Size;
+
+    // Tile every level into the store, finer levels first. Each coarser level box filters 2x2 texels of the finer one,
+    // clamping at its edges, from a float copy of it, so only one level's floats are held besides the image.
+    std::vector<glm::vec3> finerTexels;
+    std::vector<glm::vec3> texels;
+    for (size_t levelIndex = 0; levelIndex < texture->Levels.size(); levelIndex++)
+    {
+        FLevel& level = texture->Levels[levelIndex];
+        texels.resize((size_t)level.Width * level.Height);
+        if (levelIndex == 0)
+        {
+            for (int y = 0; y < level.Height; y++)
+            {
+                for (int x = 0; x < level.Width; x++)
+                {
+                    texels[(size_t)y * level.Width + x] = InImage.GetPixel(x, y);
+                }
+            }
+        }
+        else
+        {
+            const FLevel& finerLevel = texture->Levels[levelIndex - 1];
+            for (int y = 0; y < level.Height; y++)
+            {
+                for (int x = 0; x < level.Width; x++)
+                {
+                    glm::vec3 sum(0.0f);
+                    for (int dy = 0; dy < 2; dy++)
+                    {
+                        for (int dx = 0; dx < 2; dx++)
+                        {
+                            int finerX = glm::min(x * 2 + dx, finerLevel.Width - 1);
+                            int finerY = glm::min(y * 2 + dy, finerLevel.Height - 1);
+                            sum += finerTexels[(size_t)finerY * finerLevel.Width + finerX];
+                        }
+                    }
+                    texels[(size_t)y * level.Width + x] = sum * 0.25f;
+                }
+            }
+        }
+
+        FTile tile;
+        for (int tileY = 0; tileY < level.TilesY; tileY++)
+        {
+            for (int tileX = 0; tileX < level.TilesX; tileX++)
+            {
+                int originX = tileX * kTileSize;
+                int originY = tileY * kTileSize;
+                tile.Width = glm::min(kTileSize, level.Width - originX);
+                tile.Height = glm::min(kTileSize, level.Height - originY);
+                tile.Texels.resize(GetTileByteCount(*texture, tile.Width, tile.Height));
+                for (int y = 0; y < tile.Height; y++)
+                {
+                    for (int x = 0; x < tile.Width; x++)
+                    {
+                        SetTexel(*texture, tile, x, y, texels[(size_t)(originY + y) * level.Width + originX + x]);
+                    }
+                }
+                level.Slots[tileY * level.TilesX + tileX].StoreOffset = Store->Size - texture->StoreOffset;
+                if (!Store->Append(tile.Texels.data(), tile.Texels.size()))
+                {
+                    throw std::runtime_error("Unable to write the texture cache's temporary file");
+                }
+            }
+        }
+        finerTexels.swap(texels);
+    }
+    texture->StoreBytes = Store->Size - texture->StoreOffset;
+    texture->bUsed = true;
+    return texture;
+}
+
+glm::vec3 FTextureCache::Sample(uint32_t InTextureId, const glm::vec2& InUV, float InFootprint) const
+{
+    const FCachedTexture& texture = *Textures[InTextureId];
+    const FLevel& finestLevel = texture.Levels[0];
+    int coarsestLevel = (int)texture.Levels.size() - 1;
+
+    // Level whose texels are as wide as the footprint, blending the two levels around it
+    float level = 0.0f;
+    if (InFootprint > 0.0f)
+    {
+        level = glm::clamp(std::log2(InFootprint * (float)glm::max(finestLevel.Width, finestLevel.Height)), 0.0f, (float)coarsestLevel);
+    }
+    int fineLevel = (int)level;
+    float blend = level - (float)fineLevel;
+
+    glm::vec3 value = SampleLevel(texture, fineLevel, InUV);
+    if (blend > 0.0f && fineLevel < coarsestLevel)
+    {
+        value = glm::mix(value, SampleLevel(texture, fineLevel + 1, InUV), blend);
+    }
+    return value;
+}
+
+glm::vec3 FTextureCache::SampleLevel(const FCachedTexture& InTexture, int InLevel, const glm::vec2& InUV) const
+{
+    const FLevel& level = InTexture.Levels[InLevel];
+    float x = (level.Width - 1) * InUV.x;
+    float y = (level.Height - 1) * (1.0f - InUV.y);
+    float floorX = std::floor(x);
+    float floorY = std::floor(y);
+    float ax = x - floorX;
+    float ay = y - floorY;
+
+    // Coordinates far outside [0, 1] would overflow int, wrap them while still in float
+    floorX = std::fmod(floorX, (float)level.Width);
+    floorY = std::fmod(floorY, (float)level.Height);
+    int x0 = WrapCoordinate((int)floorX, level.Width);
+    int y0 = WrapCoordinate((int)floorY, level.Height);
+    int x1 = x0 + 1 < level.Width ? x0 + 1 : 0;
+    int y1 = y0 + 1 < level.Height ? y0 + 1 : 0;
+
+    // The four texels usually share a tile, so each distinct tile is acquired once
+    int texelX[4] = { x0, x1, x0, x1 };
+    int texelY[4] = { y0, y0, y1, y1 };
+    int tileIndices[4];
+    std::shared_ptr<const FTile> tiles[4];
+    glm::vec3 texels[4];
+    for (int i = 0; i < 4; i++)
+    {
+        tileIndices[i] = (texelY[i] / kTileSize) * level.TilesX + texelX[i] / kTileSize;
+        for (int j = 0; j < i; j++)
+        {
+            if (tileIndices[j] == tileIndices[i])
+            {
+                tiles[i] = tiles[j];
+                break;
+            }
+        }
+        if (!tiles[i])
+        {
+            tiles[i] = AcquireTile(InTexture, InLevel, tileIndices[i]);
+        }
+        texels[i] = GetTexel(InTexture, *tiles[i], texelX[i] % kTileSize, texelY[i] % kTileSize);
+    }
+
+    return glm::mix(glm::mix(texels[0], texels[1], ax), glm::mix(texels[2], texels[3], ax), ay);
+}
+
+std::shared_ptr<const FTextureCache::FTile> FTextureCache::AcquireTile(const FCachedTexture& InTexture, int InLevel, int InTileIndex) const
+{
+    FTileSlot& slot = InTexture.Levels[InLevel].Slots[InTileIndex];
+    std::shared_ptr<const FTile> tile = std::atomic_load(&slot.Tile);
+    if (!tile)
+    {
+        return LoadTile(InTexture, InLevel, InTileIndex);
+    }
+
+    // Only write when the clock moved, so threads sharing a hot tile do not contend on its cache line
+    uint32_t now = UseClock.load(std::memory_order_relaxed);
+    if (slot.LastUse.load(std::memory_order_relaxed) != now)
+    {
+        slot.LastUse.store(now, std::memory_order_relaxed);
+    }
+    return tile;
+}
+
+std::shared_ptr<const FTextureCache::FTile> FTextureCache::LoadTile(const FCachedTexture& InTexture, int InLevel, int InTileIndex) const
+{
+    const FLevel& level = InTexture.Levels[InLevel];
+    int tileX = InTileIndex % level.TilesX;
+    int tileY = InTileIndex / level.TilesX;
+    int originX = tileX * kTileSize;
+    int originY = tileY * kTileSize;
+
+    // Read without holding the lock, so loads of different tiles overlap. A failed read leaves the tile black rather
+    // than throwing on a render thread.
+    std::shared_ptr<FTile> tile = std::make_shared<FTile>();
+    tile->Width = glm::min(kTileSize, level.Width - originX);
+    tile->Height = glm::min(kTileSize, level.Height - originY);
+    tile->Texels.resize(GetTileByteCount(InTexture, tile->Width, tile->Height));
+    bool bIsRead;
+    {
+        std::lock_guard<std::mutex> storeLock(StoreMutex);
+        bIsRead = Store->Read(InTexture.StoreOffset + level.Slots[InTileIndex].StoreOffset, tile->Texels.data(), tile->Texels.size());
+    }
+    if (!bIsRead)
+    {
+        std::fill(tile->Texels.begin(), tile->Texels.end(), (uint8_t)0);
+    }
+
+    std::lock_guard<std::mutex> lock(Mutex);
+    FTileSlot& slot = level.Slots[InTileIndex];
+
+    // Another thread may have loaded the same tile meanwhile
+    std::shared_ptr<const FTile> existing = std::atomic_load(&slot.Tile);
+    if (existing)
+    {
+        return existing;
+    }
+
+    uint32_t now = UseClock.fetch_add(1, std::memory_order_relaxed) + 1;
+    slot.LastUse.store(now, std::memory_order_relaxed);
+    std::atomic_store(&slot.Tile, std::shared_ptr<const FTile>(tile));
+
+    FResidentTile resident;
+    resident.Slot = &slot;
+    resident.Texture = &InTexture;
+    resident.Bytes = tile->Texels.size() + sizeof(FTile);
+    resident.LastUseSnapshot = now;
+    ResidentTiles.push_back(resident);
+    ResidentBytes += resident.Bytes;
+    PeakResidentBytes = std::max(PeakResidentBytes, ResidentBytes);
+    TileLoadCount++;
+
+    if (ResidentBytes > MemoryBudget)
+    {
+        EvictTiles(&slot);
+    }
+    return tile;
+}
+
+void FTextureCache::CompactStore()
+{
+    std::lock_guard<std::mutex> lock(StoreMutex);
+    std::unique_ptr<FStore> store(new FStore());
+    std::vector<uint8_t> buffer;
+    for (const std::unique_ptr<FCachedTexture>& texture : Textures)
+    {
+        if (!texture)
+        {
+            continue;
+        }
+
+        buffer.resize((size_t)texture->StoreBytes);
+        if (!Store->Read(texture->StoreOffset, buffer.data(), buffer.size()) || !store->Append(buffer.data(), buffer.size()))
+        {
+            return;
+        }
+    }
+
+    // Textures keep their order in the new store, so offsets only need to be assigned once every copy succeeded
+    uint64_t offset = 0;
+    for (const std::unique_ptr<FCachedTexture>& texture : Textures)
+    {
+        if (texture)
+        {
+            texture->StoreOffset = offset;
+            offset += texture->StoreBytes;
+        }
+    }
+    Store = std::move(store);
+}
+
+bool FTextureCache::FStore::Append(const uint8_t* InBytes, size_t InSize)
+{
+    if (File)
+    {
+        if (!SeekFile(File, Size) || std::fwrite(InBytes, 1, InSize, File) != InSize)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        Memory.insert(Memory.end(), InBytes, InBytes + InSize);
+    }
+    Size += InSize;
+    return true;
+}
+
+bool FTextureCache::FStore::Read(uint64_t InOffset, uint8_t* OutBytes, size_t InSize) const
+{
+    if (InOffset + InSize > Size)
+    {
+        return false;
+    }
+    if (!File)
+    {
+        std::memcpy(OutBytes, &Memory[(size_t)InOffset], InSize);
+        return true;
+    }
+    return SeekFile(File, InOffset) && std::fread(OutBytes, 1, InSize, File) == InSize;
+}
+
+void FTextureCache::EvictTiles(const FTileSlot* InKeepSlot) const
+{
+    // Evicting to below the budget leaves headroom, so the sort is paid once per batch of loads rather than per load
+    size_t target = MemoryBudget / 10 * 9;
+
+    // Sort on a snapshot, as keys changing during the sort would break its ordering
+    for (FResidentTile& resident : ResidentTiles)
+    {
+        resident.LastUseSnapshot = resident.Slot->LastUse.load(std::memory_order_relaxed);
+    }
+    std::sort(ResidentTiles.begin(), ResidentTiles.end(), [](const FResidentTile& InA, const FResidentTile& InB) {
+        return InA.LastUseSnapshot < InB.LastUseSnapshot;
+    });
+
+    size_t kept = 0;
+    for (size_t i = 0; i < ResidentTiles.size(); i++)
+    {
+        FResidentTile& resident = ResidentTiles[i];
+        if (ResidentBytes > target && resident.Slot != InKeepSlot)
+        {
+            std::atomic_store(&resident.Slot->Tile, std::shared_ptr<const FTile>());
+            ResidentBytes -= resident.Bytes;
+            TileEvictionCount++;
+        }
+        else
+        {
+            ResidentTiles[kept++] = resident;
+        }
+    }
+    ResidentTiles.resize(kept);
+}
+
+glm::vec3 FTextureCache::GetTexel(const FCachedTexture& InTexture, const FTile& InTile, int InX, int InY)
+{
+    size_t index = ((size_t)InY * InTile.Width + InX) * InTexture.Channels;
+    if (InTexture.Format == EFormat::UNorm8)
+    {
+        const uint8_t* texel = &InTile.Texels[index];
+        if (InTexture.Channels == 1)
+        {
+            return glm::vec3(texel[0] * (1.0f / 255.0f));
+        }
+        return glm::vec3(texel[0], texel[1], texel[2]) * (1.0f / 255.0f);
+    }
+
+    uint16_t texel[3];
+    std::memcpy(texel, &InTile.Texels[index * 2], sizeof(uint16_t) * InTexture.Channels);
+    if (InTexture.Channels == 1)
+    {
+        return glm::vec3(glm::unpackHalf1x16(texel[0]));
+    }
+    return glm::vec3(glm::unpackHalf1x16(texel[0]), glm::unpackHalf1x16(texel[1]), glm::unpackHalf1x16(texel[2]));
+}
+
+size_t FTextureCache::GetTileByteCount(const FCachedTexture& InTexture, int InWidth, int InHeight)
+{
+    size_t bytesPerChannel = InTexture.Format == EFormat::UNorm8 ? 1 : 2;
+    return (size_t)InWidth * InHeight * InTexture.Channels * bytesPerChannel;
+}
+
+void FTextureCache::SetTexel(const FCachedTexture& InTexture, FTile& InTile, int InX, int InY, const glm::vec3& InValue)
+{
+    size_t index = ((size_t)InY * InTile.Width + InX) * InTexture.Channels;
+    for (int channel = 0; channel < InTexture.Channels; channel++)
+    {
+        if (InTexture.Format == EFormat::UNorm8)
+        {
+            InTile.Texels[index + channel] = (uint8_t)(glm::clamp(InValue[channel], 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+        else
+        {
+            uint16_t half = glm::packHalf1x16(InValue[channel]);
+            std::memcpy(&InTile.Texels[(index + channel) * 2], &half, sizeof(uint16_t));
+        }
+    }
+}
+
+size_t FTextureCache::GetTileLoadCount() const
+{
+    std::lock_guard<std::mutex> lock(Mutex);
+    return TileLoadCount;
+}
+
+size_t FTextureCache::GetTileEvictionCount() const
+{
+    std::lock_guard<std::mutex> lock(Mutex);
+    return TileEvictionCount;
+}
+
+size_t FTextureCache::GetPeakResidentBytes() const
+{
+    std::lock_guard<std::mutex> lock(Mutex);
+    return PeakResidentBytes;
+}
+
+}
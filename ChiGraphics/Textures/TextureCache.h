@@ -0,0 +1,219 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace CHISTUDIO {
+
+class FImage;
+
+/** Render-time storage for the textures materials sample. Each texture is stored as a mip pyramid of 64x64 tiles in
+ *  8-bit channels when its values fit in [0, 1] and half floats otherwise, with a single channel for grey images.
+ *  Adding a texture converts its whole pyramid into tiles of that compact format in a backing store, a temporary file,
+ *  and the source image is not used again. Tiles are paged in from the store the first time a lookup touches them, and
+ *  the least recently used tiles are evicted once the resident tiles exceed the memory budget, so the cache holds no
+ *  more texture data in memory than the budget. Sampling is thread safe.
+ *
+ *  Textures are kept across renders and looked up by the revision of their image, so a render only converts the images
+ *  added or changed since the last one. Textures are added between BeginBuild and EndBuild, once per render, and the
+ *  ones not added since BeginBuild are released at EndBuild. Builds are not thread safe and must not overlap sampling.
+ */
+class FTextureCache
+{
+public:
+    static const int kTileSize = 64;
+
+    // If no temporary file can be created, the store is kept in memory instead, still in the compact format
+    explicit FTextureCache(size_t InMemoryBudget);
+
+    FTextureCache(const FTextureCache&) = delete;
+    FTextureCache& operator=(const FTextureCache&) = delete;
+
+    // Change the memory budget, evicting tiles if they no longer fit. Not thread safe.
+    void SetMemoryBudget(size_t InMemoryBudget);
+
+    void BeginBuild();
+
+    // Id to sample the current pixels of InImage with, converting them on a miss. Ids stay valid until the texture is
+    // released. Throws std::runtime_error if the store cannot be written.
+    uint32_t AddTexture(const FImage& InImage);
+
+    // Release the textures not added since BeginBuild, as their images may have changed or no longer exist
+    void EndBuild();
+
+    // Trilinearly filtered value at InUV, using the same texel mapping and repeat wrapping as FImage::SampleWithUV.
+    // InFootprint is the width of the lookup's footprint in UV units and picks the mip level; 0 samples the full resolution.
+    glm::vec3 Sample(uint32_t InTextureId, const glm::vec2& InUV, float InFootprint) const;
+
+    size_t GetTextureCount() const {
+        return TextureIds.size();
+    }
+
+    // Statistics of the current or last build, the tile statistics covering the renders since it began
+    size_t GetBuiltCount() const {
+        return BuiltCount;
+    }
+
+    size_t GetReusedCount() const {
+        return ReusedCount;
+    }
+
+    size_t GetTileLoadCount() const;
+    size_t GetTileEvictionCount() const;
+    size_t GetPeakResidentBytes() const;
+
+private:
+    enum class EFormat
+    {
+        UNorm8,
+        Half
+    };
+
+    struct FTile
+    {
+        int Width;
+        int Height;
+        // Row-major texels of Channels values each, as uint8_t for UNorm8 or as the bytes of uint16_t halves
+        std::vector<uint8_t> Texels;
+    };
+
+    struct FTileSlot
+    {
+        FTileSlot() : StoreOffset(0), LastUse(0) {}
+
+        // Where the tile's texels start, relative to the start of its texture in the store
+        uint64_t StoreOffset;
+
+        // Null while the tile is not resident. Only accessed through std::atomic_load and std::atomic_store, so a tile
+        // evicted during a lookup stays alive until the lookup drops it.
+        std::shared_ptr<const FTile> Tile;
+
+        // Value of UseClock when the tile was last sampled
+        std::atomic<uint32_t> LastUse;
+    };
+
+    struct FLevel
+    {
+        int Width;
+        int Height;
+        int TilesX;
+        int TilesY;
+        std::unique_ptr<FTileSlot[]> Slots;
+    };
+
+    struct FCachedTexture
+    {
+        uint64_t Revision;
+        EFormat Format;
+        int Channels;
+        std::vector<FLevel> Levels;
+
+        // Every tile of every level is stored back to back in this range of the store
+        uint64_t StoreOffset;
+        uint64_t StoreBytes;
+
+        // Whether the texture was added since BeginBuild
+        bool bUsed;
+    };
+
+    struct FResidentTile
+    {
+        FTileSlot* Slot;
+        const FCachedTexture* Texture;
+        size_t Bytes;
+
+        // Copy of Slot->LastUse taken under Mutex before sorting, since render threads keep updating the slot meanwhile
+        uint64_t LastUseSnapshot;
+    };
+
+    /** Bytes appended to a temporary file, or to Memory when there is no file */
+    struct FStore
+    {
+        FStore() : File(std::tmpfile()), Size(0) {}
+
+        ~FStore() {
+            if (File)
+            {
+                std::fclose(File);
+            }
+        }
+
+        FStore(const FStore&) = delete;
+        FStore& operator=(const FStore&) = delete;
+
+        // Add InSize bytes at the end of the store. Returns false if they could not be written.
+        bool Append(const uint8_t* InBytes, size_t InSize);
+
+        // Read InSize bytes at InOffset. Returns false if the read failed.
+        bool Read(uint64_t InOffset, uint8_t* OutBytes, size_t InSize) const;
+
+        FILE* File;
+        std::vector<uint8_t> Memory;
+        uint64_t Size;
+    };
+
+    glm::vec3 SampleLevel(const FCachedTexture& InTexture, int InLevel, const glm::vec2& InUV) const;
+
+    // Resident tile of a level, loading it on a miss
+    std::shared_ptr<const FTile> AcquireTile(const FCachedTexture& InTexture, int InLevel, int InTileIndex) const;
+
+    // Read a tile from the store, then make it resident, evicting as needed
+    std::shared_ptr<const FTile> LoadTile(const FCachedTexture& InTexture, int InLevel, int InTileIndex) const;
+
+    // Convert InImage's whole pyramid into tiles at the end of the store. Throws std::runtime_error if the store cannot
+    // be written.
+    std::unique_ptr<FCachedTexture> BuildTexture(const FImage& InImage);
+
+    // Copy the textures still cached into a new store, dropping the bytes of released ones. Keeps the current store if
+    // the copy fails.
+    void CompactStore();
+
+    // Texel (InX, InY) of a level, relative to the tile's corner
+    static glm::vec3 GetTexel(const FCachedTexture& InTexture, const FTile& InTile, int InX, int InY);
+    static void SetTexel(const FCachedTexture& InTexture, FTile& InTile, int InX, int InY, const glm::vec3& InValue);
+
+    // Bytes of texels in a tile of the given size
+    static size_t GetTileByteCount(const FCachedTexture& InTexture, int InWidth, int InHeight);
+
+    // Evict least recently used tiles, other than InKeepSlot, until resident tiles fit well within the budget.
+    // Called with Mutex locked.
+    void EvictTiles(const FTileSlot* InKeepSlot) const;
+
+    // Indexed by texture id. Null at the ids of released textures, which later textures reuse from FreeIds.
+    std::vector<std::unique_ptr<FCachedTexture>> Textures;
+    std::vector<uint32_t> FreeIds;
+
+    // Ids of the cached textures by the revision of their image
+    std::unordered_map<uint64_t, uint32_t> TextureIds;
+
+    // Tiles are read from the store while sampling, so it is only accessed with StoreMutex locked
+    std::unique_ptr<FStore> Store;
+    mutable std::mutex StoreMutex;
+
+    // Bytes of the store holding cached textures, the rest belonging to released ones
+    uint64_t LiveStoreBytes;
+
+    size_t BuiltCount;
+    size_t ReusedCount;
+
+    size_t MemoryBudget;
+
+    // Guards the resident tile list, the byte counts and statistics, and tile slot writes
+    mutable std::mutex Mutex;
+    mutable std::vector<FResidentTile> ResidentTiles;
+    mutable size_t ResidentBytes;
+    mutable size_t PeakResidentBytes;
+    mutable size_t TileLoadCount;
+    mutable size_t TileEvictionCount;
+
+    // Advanced on every tile load, so tiles touched between two loads count as equally recent
+    mutable std::atomic<uint32_t> UseClock;
+};
+
+}
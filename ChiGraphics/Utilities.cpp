@@ -73,6 +73,16 @@ std::string GetAssetDir() {
     return GetProjectRootDir() + "assets/";
 }
 
+static bool bIsHeadlessProcess = false;
+
+void SetHeadless(bool InIsHeadless) {
+    bIsHeadlessProcess = InIsHeadless;
+}
+
+bool IsHeadless() {
+    return bIsHeadlessProcess;
+}
+
 std::unique_ptr<FNormalArray> CalculateNormals(FPositionArray& positions, FIndexArray& indices)
 {
     auto normals = make_unique<FNormalArray>(positions.size(), glm::vec3(0.0f));
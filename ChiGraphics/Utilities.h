@@ -59,6 +59,11 @@ std::string GetProjectRootDir();
 std::string GetShaderGLSLDir();
 std::string GetAssetDir();
 
+// Headless processes (such as the command line renderer) never create a GL context. While set, the GL wrappers
+// skip their GL calls and only keep their CPU side data.
+void SetHeadless(bool InIsHeadless);
+bool IsHeadless();
+
 // C++11 does not have make_unique sadly; it appeared in C++14.
 // MSVC already has make_unique defined.
 #ifdef _MSC_VER
@@ -96,16 +101,12 @@ float static RandomFloat(float min, float max) {
     return min + (max - min) * rand() / (RAND_MAX + 1.0f);;
 }
 
+/* Uniform point in the unit disk. Maps two samples instead of rejecting, so exactly two sample dimensions are used. */
 glm::vec2 static RandomInUnitDisk(RNG& InRNG)
 {
-    while (true) 
-    {
-        float x = InRNG.Float() * 2.0f - 1.0f;
-        float y = InRNG.Float() * 2.0f - 1.0f;
-        auto p = glm::vec2(x, y);
-        if (glm::length(p) >= 1) continue;
-        return p;
-    }
+    float phi = kPi * 2 * InRNG.Float();
+    float r = glm::sqrt(InRNG.Float());
+    return glm::vec2(r * glm::cos(phi), r * glm::sin(phi));
 }
 
 /* Distribute uniform xy on [0,1] over unit disk [-1,1] */
@@ -144,6 +145,74 @@ glm::vec3 static DiskLightSample(const glm::vec3& InNormal, float InRandomU, flo
     return EllipseSample(Ru, Rv, InRandomU, InRandomV);
 }
 
+/* Convert the pdf of a surface point sampled per unit area to a pdf per unit solid angle seen from InTargetPoint.
+ * InGeometricNormal is the surface's true normal at the point, since it sets how much area a solid angle covers. */
+float static AreaToSolidAnglePDF(float InAreaPDF, const glm::vec3& InTargetPoint, const glm::vec3& InPoint, const glm::vec3& InGeometricNormal)
+{
+    glm::vec3 displacement = InPoint - InTargetPoint;
+    float distanceSquared = glm::dot(displacement, displacement);
+    if (distanceSquared <= 0.0f)
+    {
+        return 0.0f;
+    }
+    float cosine = glm::abs(glm::dot(InGeometricNormal, displacement)) / glm::sqrt(distanceSquared);
+    return cosine > 0.0f ? InAreaPDF * distanceSquared / cosine : 0.0f;
+}
+
+/* Sample a point on the part of a sphere visible from InTargetPoint, uniformly over the cone of directions the sphere
+ * subtends, as in pbrt. Points inside the sphere sample its whole surface by area instead. Outputs the point and the
+ * sphere's outward normal there, and returns the pdf per unit solid angle. */
+float static SampleSphereSolidAngle(const glm::vec3& InCenter, float InRadius, const glm::vec3& InTargetPoint, float InRandomU, float InRandomV, glm::vec3& OutPoint, glm::vec3& OutNormal)
+{
+    glm::vec3 toCenter = InCenter - InTargetPoint;
+    float distanceSquared = glm::dot(toCenter, toCenter);
+    float radiusSquared = InRadius * InRadius;
+    float phi = kPi * 2 * InRandomV;
+
+    if (distanceSquared <= radiusSquared)
+    {
+        float z = 1.0f - 2.0f * InRandomU;
+        float r = glm::sqrt(glm::max(1.0f - z * z, 0.0f));
+        OutNormal = glm::vec3(r * glm::cos(phi), r * glm::sin(phi), z);
+        OutPoint = InCenter + InRadius * OutNormal;
+        return AreaToSolidAnglePDF(1.0f / (4.0f * kPi * radiusSquared), InTargetPoint, OutPoint, OutNormal);
+    }
+
+    // Uniform cos(theta) within the cone. Small cones use a Taylor expansion, as 1 - cos(theta) loses all precision.
+    float sin2ThetaMax = radiusSquared / distanceSquared;
+    float sinThetaMax = glm::sqrt(sin2ThetaMax);
+    float cosThetaMax = glm::sqrt(glm::max(1.0f - sin2ThetaMax, 0.0f));
+    float oneMinusCosThetaMax = 1.0f - cosThetaMax;
+    float cosTheta = (cosThetaMax - 1.0f) * InRandomU + 1.0f;
+    float sin2Theta = 1.0f - cosTheta * cosTheta;
+    if (sin2ThetaMax < 0.00068523f) // sin^2(1.5 degrees)
+    {
+        sin2Theta = sin2ThetaMax * InRandomU;
+        cosTheta = glm::sqrt(1.0f - sin2Theta);
+        oneMinusCosThetaMax = sin2ThetaMax * 0.5f;
+    }
+
+    // Angle at the center between the target point and the point the sampled direction first hits
+    float cosAlpha = sin2Theta / sinThetaMax + cosTheta * glm::sqrt(glm::max(1.0f - sin2Theta / sin2ThetaMax, 0.0f));
+    float sinAlpha = glm::sqrt(glm::max(1.0f - cosAlpha * cosAlpha, 0.0f));
+
+    glm::vec3 axis = -toCenter / glm::sqrt(distanceSquared);
+    glm::vec3 tangent, bitangent;
+    MakeOrthonormals(axis, tangent, bitangent);
+    OutNormal = sinAlpha * glm::cos(phi) * tangent + sinAlpha * glm::sin(phi) * bitangent + cosAlpha * axis;
+    OutPoint = InCenter + InRadius * OutNormal;
+    return 1.0f / (2.0f * kPi * oneMinusCosThetaMax);
+}
+
+/* Multiple importance sampling weight for a sample drawn from the strategy with pdf InPdf, when another strategy
+ * could have produced it with pdf InOtherPdf. Veach's power heuristic with beta = 2. */
+double static PowerHeuristic(double InPdf, double InOtherPdf)
+{
+    double pdfSquared = InPdf * InPdf;
+    double sum = pdfSquared + InOtherPdf * InOtherPdf;
+    return sum > 0.0 ? pdfSquared / sum : 0.0;
+}
+
 // Silence compiler warning for unused variables
 #define UNUSED(expr) \
   do {               \
@@ -0,0 +1,340 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ChiCore/ChiStudioApplication.h"
+#include "ChiCore/Serialization/FileSerializer.h"
+#include "ChiGraphics/Keyframing/KeyframeManager.h"
+#include "ChiGraphics/Materials/MaterialManager.h"
+#include "ChiGraphics/RayTracing/RayTracer.h"
+#include "ChiGraphics/Textures/FImage.h"
+#include "ChiGraphics/Utilities.h"
+#include "core.h"
+
+using namespace CHISTUDIO;
+
+/** Headless batch renderer. Loads a .chistudio scene without opening a window and ray traces it with the CPU tracer. */
+
+namespace {
+
+struct FCommandLineOptions
+{
+    std::string ScenePath;
+    std::string OutputPattern = "Output";
+    bool bRenderFrameRange = false;
+    int StartFrame = 0;
+    int EndFrame = 0;
+    std::string HDRIPath;
+    std::string CheckpointPattern;
+    int StreamBandRows = 0;
+};
+
+void PrintUsage()
+{
+    std::cout <<
+        "Usage: ChiStudioRender <scene.chistudio> [options]\n"
+        "  --output <pattern>        Output path without extension. A run of '#' is replaced by the zero padded frame\n"
+        "                            number, otherwise frames are suffixed with _<frame>. (default: Output)\n"
+        "  --width <pixels>          Image width (default: 300)\n"
+        "  --height <pixels>         Image height (default: 300)\n"
+        "  --spp <count>             Samples per pixel, the maximum when adaptive sampling (default: 1)\n"
+        "  --bounces <count>         Maximum path bounces (default: 1)\n"
+        "  --rr-start <bounce>       Bounce at which Russian roulette starts (default: 3)\n"
+        "  --light-samples <count>   Lights sampled at every shading point (default: 1)\n"
+        "  --firefly-clamp <value>   Clamp light arriving through a bounce to this, 0 disables (default: 0)\n"
+        "  --texture-cache <MB>      Memory budget for texture tiles (default: 1024)\n"
+        "  --frames <start>[:<end>]  Render an inclusive range of animation frames\n"
+        "  --threads <count>         Render threads, 0 uses every hardware thread (default: 0)\n"
+        "  --tile-size <pixels>      Width and height of render tiles (default: 32)\n"
+        "  --sampler <name>          independent, sobol or bluenoise (default: sobol)\n"
+        "  --seed <value>            Use a fixed seed so renders are reproducible\n"
+        "  --adaptive                Enable adaptive sampling\n"
+        "  --min-spp <count>         Minimum samples per pixel with adaptive sampling (default: 16)\n"
+        "  --noise-threshold <value> Relative noise at which adaptive pixels converge (default: 0.01)\n"
+        "  --time-budget <seconds>   Time budget for adaptive sampling, 0 for none (default: 0)\n"
+        "  --background <r,g,b>      Background color when no HDRI is used (default: 0.5,0.7,1.0)\n"
+        "  --hdri <file>             Environment image\n"
+        "  --hdri-strength <value>   Environment image multiplier (default: 1.0)\n"
+        "  --denoise                 Denoise the beauty image with Intel Open Image Denoise\n"
+        "  --exr                     Also save every AOV as 32-bit floats to <output>.exr\n"
+        "  --stream-rows <rows>      Render in bands of this many rows, writing each to uncompressed PNGs as it finishes,\n"
+        "                            so memory does not grow with the image. Skips denoising, EXR and checkpoints.\n"
+        "  --checkpoint <pattern>    Save render progress to this file and resume from it when it exists. Frames of a\n"
+        "                            range are numbered like --output. Raise --spp to add samples to a finished render.\n"
+        "  --checkpoint-interval <s> Least seconds between checkpoint saves (default: 300)\n"
+        "  --help                    Show this message\n";
+}
+
+// Replace the first run of '#' in InPattern with the zero padded frame number
+std::string GetFramePath(const std::string& InPattern, int InFrame, bool InIsFrameRange)
+{
+    size_t runStart = InPattern.find('#');
+    if (runStart == std::string::npos)
+    {
+        return InIsFrameRange ? fmt::format("{}_{}", InPattern, InFrame) : InPattern;
+    }
+
+    size_t runEnd = InPattern.find_first_not_of('#', runStart);
+    if (runEnd == std::string::npos)
+    {
+        runEnd = InPattern.size();
+    }
+
+    std::string frameString = std::to_string(InFrame);
+    if (frameString.size() < runEnd - runStart)
+    {
+        frameString.insert(0, runEnd - runStart - frameString.size(), '0');
+    }
+    return InPattern.substr(0, runStart) + frameString + InPattern.substr(runEnd);
+}
+
+bool ParseSamplerType(const std::string& InName, ESamplerType& OutType)
+{
+    if (InName == "independent")
+        OutType = ESamplerType::Independent;
+    else if (InName == "sobol")
+        OutType = ESamplerType::Sobol;
+    else if (InName == "bluenoise")
+        OutType = ESamplerType::BlueNoise;
+    else
+        return false;
+    return true;
+}
+
+// Fill OutOptions and OutSettings from the command line. Throws std::runtime_error on malformed arguments.
+void ParseCommandLine(int argc, char** argv, FCommandLineOptions& OutOptions, FRayTraceSettings& OutSettings)
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        const std::string& arg = args[i];
+        auto nextValue = [&]() -> const std::string& {
+            if (i + 1 >= args.size())
+                throw std::runtime_error(fmt::format("Missing value for {}", arg));
+            return args[++i];
+        };
+
+        try
+        {
+            if (arg == "--output")
+                OutOptions.OutputPattern = nextValue();
+            else if (arg == "--width")
+                OutSettings.ImageSize.x = std::stoi(nextValue());
+            else if (arg == "--height")
+                OutSettings.ImageSize.y = std::stoi(nextValue());
+            else if (arg == "--spp")
+                OutSettings.SamplesPerPixel = std::stoi(nextValue());
+            else if (arg == "--bounces")
+                OutSettings.MaxBounces = (size_t)std::stoi(nextValue());
+            else if (arg == "--rr-start")
+                OutSettings.RussianRouletteStartBounce = (size_t)std::stoi(nextValue());
+            else if (arg == "--light-samples")
+                OutSettings.LightSamplesPerHit = std::stoi(nextValue());
+            else if (arg == "--firefly-clamp")
+                OutSettings.FireflyClamp = std::stof(nextValue());
+            else if (arg == "--texture-cache")
+                OutSettings.TextureCacheMegabytes = std::stoi(nextValue());
+            else if (arg == "--frames")
+            {
+                std::string range = nextValue();
+                size_t separator = range.find(':');
+                OutOptions.StartFrame = std::stoi(range.substr(0, separator));
+                OutOptions.EndFrame = separator == std::string::npos ? OutOptions.StartFrame : std::stoi(range.substr(separator + 1));
+                OutOptions.bRenderFrameRange = true;
+            }
+            else if (arg == "--threads")
+                OutSettings.NumThreads = std::stoi(nextValue());
+            else if (arg == "--tile-size")
+                OutSettings.TileSize = std::stoi(nextValue());
+            else if (arg == "--sampler")
+            {
+                if (!ParseSamplerType(nextValue(), OutSettings.SamplerType))
+                    throw std::runtime_error(fmt::format("Unknown sampler {}", args[i]));
+            }
+            else if (arg == "--seed")
+            {
+                OutSettings.Seed = std::stoi(nextValue());
+                OutSettings.bUseFixedSeed = true;
+            }
+            else if (arg == "--adaptive")
+                OutSettings.bUseAdaptiveSampling = true;
+            else if (arg == "--min-spp")
+                OutSettings.MinSamplesPerPixel = std::stoi(nextValue());
+            else if (arg == "--noise-threshold")
+                OutSettings.AdaptiveNoiseThreshold = std::stof(nextValue());
+            else if (arg == "--time-budget")
+                OutSettings.TimeBudgetSeconds = std::stof(nextValue());
+            else if (arg == "--background")
+            {
+                std::vector<std::string> channels = Split(nextValue(), ',');
+                if (channels.size() != 3)
+                    throw std::runtime_error("Background color must be given as r,g,b");
+                OutSettings.BackgroundColor = glm::vec3(std::stof(channels[0]), std::stof(channels[1]), std::stof(channels[2]));
+            }
+            else if (arg == "--hdri")
+                OutOptions.HDRIPath = nextValue();
+            else if (arg == "--hdri-strength")
+                OutSettings.HDRIStrength = std::stof(nextValue());
+            else if (arg == "--denoise")
+                OutSettings.UseIntelDenoise = true;
+            else if (arg == "--exr")
+                OutSettings.bSaveEXR = true;
+            else if (arg == "--stream-rows")
+                OutOptions.StreamBandRows = std::stoi(nextValue());
+            else if (arg == "--checkpoint")
+                OutOptions.CheckpointPattern = nextValue();
+            else if (arg == "--checkpoint-interval")
+                OutSettings.CheckpointIntervalSeconds = std::stof(nextValue());
+            else if (arg.size() > 1 && arg[0] == '-')
+                throw std::runtime_error(fmt::format("Unknown option {}", arg));
+            else if (OutOptions.ScenePath.empty())
+                OutOptions.ScenePath = arg;
+            else
+                throw std::runtime_error(fmt::format("Unexpected argument {}", arg));
+        }
+        catch (const std::logic_error&)
+        {
+            // std::stoi and std::stof report unparsable numbers as invalid_argument or out_of_range
+            throw std::runtime_error(fmt::format("Invalid value for {}", arg));
+        }
+    }
+
+    if (OutOptions.ScenePath.empty())
+        throw std::runtime_error("No scene file given");
+    if (OutSettings.ImageSize.x <= 0 || OutSettings.ImageSize.y <= 0)
+        throw std::runtime_error("Image size must be positive");
+    if (OutSettings.SamplesPerPixel <= 0)
+        throw std::runtime_error("Samples per pixel must be positive");
+    if (OutSettings.LightSamplesPerHit <= 0)
+        throw std::runtime_error("Light samples must be positive");
+    if (OutSettings.TileSize <= 0)
+        throw std::runtime_error("Tile size must be positive");
+    if (OutSettings.TextureCacheMegabytes <= 0)
+        throw std::runtime_error("Texture cache size must be positive");
+    if (OutOptions.StreamBandRows < 0)
+        throw std::runtime_error("Stream band rows must not be negative");
+    if (OutSettings.CheckpointIntervalSeconds < 0.0f)
+        throw std::runtime_error("Checkpoint interval must not be negative");
+    if (OutOptions.EndFrame < OutOptions.StartFrame)
+        throw std::runtime_error("Frame range must not end before it starts");
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    // Same defaults as the rendering widget
+    FRayTraceSettings settings;
+    settings.ImageSize = glm::ivec2(300, 300);
+    settings.MaxBounces = 1;
+    settings.BackgroundColor = glm::vec3(.5f, .7f, 1.0f);
+    settings.bShadowsEnabled = false;
+    settings.SamplesPerPixel = 1;
+    settings.HDRI = nullptr;
+    settings.UseHDRI = false;
+    settings.HDRIStrength = 1.0f;
+    settings.UseCompositingNodes = false; // Compositing nodes only exist in the editor's GUI
+    settings.UseIntelDenoise = false;
+
+    FCommandLineOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+    }
+
+    try
+    {
+        ParseCommandLine(argc, argv, options, settings);
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cerr << e.what() << std::endl;
+        PrintUsage();
+        return 1;
+    }
+
+    std::unique_ptr<FImage> hdri;
+    if (!options.HDRIPath.empty())
+    {
+        try
+        {
+            hdri = FImage::LoadPNG(options.HDRIPath, false);
+        }
+        catch (const std::runtime_error& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        settings.HDRI = hdri.get();
+        settings.UseHDRI = true;
+    }
+
+    std::unique_ptr<ChiStudioApplication> application =
+        make_unique<ChiStudioApplication>("Chi Studio Render", settings.ImageSize, true);
+    application->SetupScene(false);
+    MaterialManager::GetInstance().ClearAllMaterialsExceptDefault();
+
+    FileSerializer serializer(*application);
+    bool bLoadedScene;
+    try
+    {
+        bLoadedScene = serializer.Deserialize(options.ScenePath);
+    }
+    catch (const std::exception& e)
+    {
+        // Scene files with missing or mistyped fields throw while their nodes are read
+        std::cerr << e.what() << std::endl;
+        bLoadedScene = false;
+    }
+
+    if (!bLoadedScene)
+    {
+        std::cerr << "Failed to load scene " << options.ScenePath << std::endl;
+        return 1;
+    }
+
+    // Frames of a range are written in the background while the next frame traces. Streamed frames are written as they trace.
+    if (options.bRenderFrameRange && options.StreamBandRows == 0)
+    {
+        settings.MaxQueuedOutputs = 2;
+    }
+    FRayTracer rayTracer(settings);
+    int startFrame = options.bRenderFrameRange ? options.StartFrame : KeyframeManager::GetInstance().GetCurrentFrame();
+    int endFrame = options.bRenderFrameRange ? options.EndFrame : startFrame;
+    for (int frameNumber = startFrame; frameNumber <= endFrame; frameNumber++)
+    {
+        if (options.bRenderFrameRange)
+        {
+            std::cout << "Rendering frame " << frameNumber << std::endl;
+            KeyframeManager::GetInstance().SetCurrentFrame(frameNumber);
+        }
+
+        std::string outputPath = GetFramePath(options.OutputPattern, frameNumber, options.bRenderFrameRange);
+        if (!options.CheckpointPattern.empty())
+        {
+            rayTracer.Settings.CheckpointFile = GetFramePath(options.CheckpointPattern, frameNumber, options.bRenderFrameRange);
+        }
+        if (options.StreamBandRows > 0)
+        {
+            if (!rayTracer.RenderImageStreamed(application->GetScene(), outputPath, options.StreamBandRows))
+            {
+                return 1;
+            }
+        }
+        else if (rayTracer.RenderImage(application->GetScene(), outputPath) == nullptr)
+        {
+            return 1;
+        }
+    }
+    rayTracer.WaitForOutputs();
+
+    if (rayTracer.GetFailedOutputCount() > 0)
+    {
+        return 1;
+    }
+    return 0;
+}